@@ -0,0 +1,690 @@
+#pragma once
+
+#include <coroutine>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <optional>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace ImageForensics {
+
+/**
+ * @brief 取消原因
+ */
+enum class CancelReason {
+    None,
+    Cancelled,
+    DeadlineExceeded,
+    ClientDisconnected
+};
+
+/**
+ * @brief 操作被取消时抛出的异常
+ */
+class OperationCancelled : public std::runtime_error {
+public:
+    explicit OperationCancelled(CancelReason reason);
+
+    CancelReason reason() const noexcept { return cancelReason; }
+
+private:
+    CancelReason cancelReason;
+};
+
+/**
+ * @brief 协作式取消令牌，携带请求截止时间和客户端存活探测
+ *
+ * 令牌按值传递，所有副本共享同一状态。处理流程在各阶段之间调用throwIfCancelled，
+ * 超过截止时间或客户端断开后尽快放弃剩余工作。默认构造的令牌永不取消。
+ */
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief 构造一个永不取消的令牌
+     */
+    CancellationToken();
+
+    /**
+     * @brief 构造一个在指定时间后到期的令牌
+     * @param timeout 超时时间
+     * @return 令牌
+     */
+    static CancellationToken withTimeout(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief 设置存活探测函数，返回false表示请求方已经不再等待结果（例如客户端断开）
+     * @param probe 探测函数，必须线程安全
+     */
+    void setAliveProbe(std::function<bool()> probe);
+
+    /**
+     * @brief 主动取消
+     */
+    void cancel();
+
+    /**
+     * @brief 检查是否已取消
+     * @return 取消原因，未取消时返回CancelReason::None
+     */
+    CancelReason check() const;
+
+    /**
+     * @brief 是否已取消
+     */
+    bool isCancelled() const { return check() != CancelReason::None; }
+
+    /**
+     * @brief 已取消时抛出OperationCancelled
+     */
+    void throwIfCancelled() const;
+
+private:
+    struct State {
+        std::atomic<bool> cancelled{false};
+        std::optional<Clock::time_point> deadline;
+        std::function<bool()> aliveProbe;
+    };
+
+    std::shared_ptr<State> state;
+};
+
+/**
+ * @brief 固定大小的工作线程池，用于承载从网络反应器线程卸载的CPU密集任务
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief 构造函数
+     * @param threads 工作线程数量，为0时使用硬件并发数
+     */
+    explicit ThreadPool(size_t threads = 0);
+
+    /**
+     * @brief 析构函数，等待队列中剩余任务执行完毕
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief 投递一个任务
+     * @param task 任务函数
+     */
+    void post(std::function<void()> task);
+
+    /**
+     * @brief 投递一个带返回值的任务
+     * @param fn 任务函数
+     * @return 任务结果的future
+     */
+    template<typename F>
+    auto submit(F&& fn) -> std::future<std::invoke_result_t<std::decay_t<F>>>;
+
+    /**
+     * @brief 获取等待执行的任务数量
+     * @return 队列深度
+     */
+    size_t queueDepth() const;
+
+    /**
+     * @brief 获取工作线程数量
+     * @return 线程数量
+     */
+    size_t size() const;
+
+    /**
+     * @brief 停止接收新任务并等待所有工作线程退出
+     */
+    void shutdown();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    mutable std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false;
+};
+
+/**
+ * @brief 有界阻塞队列，用于在流水线各阶段之间传递数据并提供背压
+ */
+template<typename T>
+class BoundedQueue {
+public:
+    /**
+     * @brief 构造函数
+     * @param capacity 队列容量
+     */
+    explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+    /**
+     * @brief 放入元素，队列满时阻塞
+     * @param item 元素
+     * @return 队列已关闭时返回false
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]() { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 非阻塞地放入元素
+     * @param item 元素
+     * @return 队列已满或已关闭时返回false
+     */
+    bool tryPush(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (closed || items.size() >= capacity) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 取出元素，队列空时阻塞
+     * @return 队列已关闭且取空时返回std::nullopt
+     */
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this]() { return closed || !items.empty(); });
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return item;
+    }
+
+    /**
+     * @brief 非阻塞地取出元素
+     * @return 队列为空时返回std::nullopt
+     */
+    std::optional<T> tryPop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return item;
+    }
+
+    /**
+     * @brief 关闭队列，剩余元素仍可被取出
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    bool closed = false;
+};
+
+/**
+ * @brief 返回结果的协程任务，可以被另一个协程co_await
+ *
+ * 任务在调用时立即开始执行，挂起后由恢复它的线程继续；完成时直接恢复等待它的协程。
+ * 同步调用方用get()阻塞等待结果。任务对象销毁前必须已经完成；发布完成状态之后协程不再访问promise，
+ * 等待者看到完成即可销毁任务。
+ */
+template<typename T>
+class Task {
+public:
+    struct promise_type {
+        Task get_return_object() noexcept {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                auto& promise = handle.promise();
+                // 交换之后promise可能已被等待者销毁，只能使用取出的等待者
+                void* waiter = promise.state.exchange(promise.finishedMarker(), std::memory_order_acq_rel);
+                if (waiter) {
+                    return std::coroutine_handle<>::from_address(waiter);
+                }
+                return std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        template<typename U>
+        void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+
+        void* finishedMarker() noexcept { return this; }
+
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::atomic<void*> state{nullptr};  ///< 等待者的协程地址；完成后为finishedMarker()
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task& operator=(Task&&) = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return finished(); }
+
+    bool await_suspend(std::coroutine_handle<> waiter) noexcept {
+        // 任务在登记等待者之前已经完成时不挂起
+        void* expected = nullptr;
+        return handle.promise().state.compare_exchange_strong(expected, waiter.address(), std::memory_order_acq_rel);
+    }
+
+    T await_resume() { return takeResult(); }
+
+    /**
+     * @brief 阻塞当前线程直到任务完成
+     *
+     * 登记一个通知协程作为等待者，任务完成时恢复它，由它在调用方自己的锁下发出通知。
+     * @return 任务结果；任务抛出的异常在这里重新抛出
+     */
+    T get() {
+        SyncWait wait;
+        Signal signaller = signal(wait);
+        if (await_suspend(signaller.handle)) {
+            std::unique_lock<std::mutex> lock(wait.mutex);
+            wait.condition.wait(lock, [&wait]() { return wait.done; });
+        } else {
+            // 任务已经完成，通知协程没有运行过
+            signaller.handle.destroy();
+        }
+        return takeResult();
+    }
+
+    /**
+     * @brief 任务是否已经完成
+     */
+    bool finished() const noexcept {
+        return handle.promise().state.load(std::memory_order_acquire) == handle.promise().finishedMarker();
+    }
+
+private:
+    struct SyncWait {
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool done = false;
+    };
+
+    /**
+     * @brief get()使用的通知协程：创建时挂起，被任务恢复后通知等待的线程并自行销毁
+     */
+    struct Signal {
+        struct promise_type {
+            Signal get_return_object() noexcept {
+                return {std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept {}
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    // 在锁内通知，等待的线程在解锁之前无法返回，wait在通知结束前不会被销毁
+    static Signal signal(SyncWait& wait) {
+        std::lock_guard<std::mutex> lock(wait.mutex);
+        wait.done = true;
+        wait.condition.notify_all();
+        co_return;
+    }
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    T takeResult() {
+        auto& promise = handle.promise();
+        if (promise.error) {
+            std::rethrow_exception(promise.error);
+        }
+        return std::move(*promise.value);
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief 请求合并：同一个键同时只执行一次计算，并发的重复调用等待并共享同一个结果
+ *
+ * 第一个到达的调用者在自己的线程上执行计算；协程调用方通过join()等待时挂起，不占用工作线程。
+ * 计算完成后，挂起的等待者各自投递到构造时给出的线程池上恢复；没有线程池时在执行计算的线程上依次恢复。
+ */
+template<typename Value>
+class SingleFlight {
+    struct Flight {
+        std::optional<Value> value;
+        std::exception_ptr error;
+        bool done = false;
+        std::vector<std::coroutine_handle<>> waiters;
+        std::condition_variable finished;
+    };
+
+    /**
+     * @brief 等待另一个调用者正在执行的计算，计算已完成时不挂起
+     */
+    struct FlightAwaiter {
+        SingleFlight& owner;
+        std::shared_ptr<Flight> flight;
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> lock(owner.mutex);
+            if (flight->done) {
+                return false;
+            }
+            flight->waiters.push_back(handle);
+            return true;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+public:
+    /**
+     * @brief 构造函数
+     * @param pool 恢复挂起的等待者的线程池，为空时由执行计算的线程恢复
+     */
+    explicit SingleFlight(ThreadPool* pool = nullptr) : pool(pool) {}
+
+    /**
+     * @brief 执行或加入一次计算，同步等待结果
+     * @param key 计算的键
+     * @param fn 计算函数，只由第一个到达的调用者执行
+     * @param token 等待者的取消令牌，等待期间被取消时不再等待结果
+     * @return 计算结果；计算抛出的异常会传递给所有等待者
+     */
+    template<typename F>
+    Value run(const std::string& key, F&& fn, const CancellationToken& token = CancellationToken()) {
+        auto [flight, leader] = acquire(key);
+        if (leader) {
+            complete(key, *flight, std::forward<F>(fn));
+        } else {
+            // 计算完成时被唤醒；定时醒来只是为了检查取消
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!flight->done) {
+                flight->finished.wait_for(lock, std::chrono::milliseconds(10));
+                if (!flight->done) {
+                    token.throwIfCancelled();
+                }
+            }
+        }
+        return result(*flight);
+    }
+
+    /**
+     * @brief 执行或加入一次计算，在协程中等待结果
+     *
+     * 等待者挂起而不占用线程。挂起期间无法响应等待者自己的取消令牌，最迟在计算结束时恢复，
+     * 计算按第一个调用者的令牌限时；恢复后先检查自己的令牌，已取消时不再使用结果。
+     * @param key 计算的键
+     * @param fn 计算函数，只由第一个到达的调用者执行
+     * @param token 等待者的取消令牌
+     * @return 计算结果；计算抛出的异常会传递给所有等待者
+     * @throws OperationCancelled 等待者在计算结束前已被取消
+     */
+    Task<Value> join(std::string key, std::function<Value()> fn, CancellationToken token = CancellationToken()) {
+        std::pair<std::shared_ptr<Flight>, bool> acquired = acquire(key);
+        if (acquired.second) {
+            complete(key, *acquired.first, fn);
+        } else {
+            FlightAwaiter awaiter{*this, acquired.first};
+            co_await awaiter;
+            token.throwIfCancelled();
+        }
+        co_return result(*acquired.first);
+    }
+
+    /**
+     * @brief 获取正在进行的计算数量
+     * @return 计算数量
+     */
+    size_t inflightCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return inflight.size();
+    }
+
+private:
+    std::pair<std::shared_ptr<Flight>, bool> acquire(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = inflight.find(key);
+        if (it != inflight.end()) {
+            return {it->second, false};
+        }
+        auto flight = std::make_shared<Flight>();
+        inflight.emplace(key, flight);
+        return {flight, true};
+    }
+
+    template<typename F>
+    void complete(const std::string& key, Flight& flight, F&& fn) {
+        try {
+            flight.value.emplace(fn());
+        } catch (...) {
+            flight.error = std::current_exception();
+        }
+
+        std::vector<std::coroutine_handle<>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inflight.erase(key);
+            flight.done = true;
+            waiters.swap(flight.waiters);
+        }
+        flight.finished.notify_all();
+
+        for (auto waiter : waiters) {
+            resume(waiter);
+        }
+    }
+
+    void resume(std::coroutine_handle<> waiter) {
+        if (pool) {
+            try {
+                pool->post([waiter]() { waiter.resume(); });
+                return;
+            } catch (const std::exception&) {
+                // 线程池正在关闭，改为就地恢复
+            }
+        }
+        waiter.resume();
+    }
+
+    static Value result(const Flight& flight) {
+        if (flight.error) {
+            std::rethrow_exception(flight.error);
+        }
+        return *flight.value;
+    }
+
+    ThreadPool* pool;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> inflight;
+    mutable std::mutex mutex;
+};
+
+/**
+ * @brief 即发即弃的协程类型，用于异步路由处理器
+ *
+ * 协程在调用时立即执行到第一个co_await，之后由恢复它的线程继续执行，
+ * 结束时自动销毁协程帧。
+ */
+struct DetachedTask {
+    /**
+     * @brief 由协程帧持有到协程结束的作用域对象
+     *
+     * 调用方无法等待即发即弃的协程，需要知道协程何时结束时（如统计处理中的请求），
+     * 把作用域对象作为协程的参数传入，promise从协程参数中取得并持有。
+     */
+    using Scope = std::shared_ptr<void>;
+
+    struct promise_type {
+        template<typename... Args>
+        promise_type(Args&... args) noexcept {
+            (takeScope(args), ...);
+        }
+
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept;
+        
+        Scope scope;  ///< 随协程帧一起销毁
+
+    private:
+        template<typename Arg>
+        void takeScope(Arg& arg) noexcept {
+            if constexpr (std::is_same_v<std::remove_cv_t<Arg>, Scope>) {
+                if (!scope) {
+                    scope = arg;
+                }
+            }
+        }
+    };
+};
+
+/**
+ * @brief 将函数卸载到线程池执行的等待体，完成后在工作线程上恢复协程
+ */
+template<typename T>
+class OffloadAwaitable {
+public:
+    OffloadAwaitable(ThreadPool& pool, std::function<T()> fn)
+        : pool(pool), fn(std::move(fn)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        pool.post([this, handle]() {
+            try {
+                result.emplace(fn());
+            } catch (...) {
+                error = std::current_exception();
+            }
+            handle.resume();
+        });
+    }
+
+    T await_resume() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*result);
+    }
+
+private:
+    ThreadPool& pool;
+    std::function<T()> fn;
+    std::optional<T> result;
+    std::exception_ptr error;
+};
+
+/**
+ * @brief 在线程池上执行函数并在协程中等待其结果
+ * @param pool 线程池
+ * @param fn 任务函数
+ * @return 可co_await的等待体
+ */
+template<typename F>
+auto offload(ThreadPool& pool, F&& fn) {
+    using Result = std::invoke_result_t<std::decay_t<F>>;
+    return OffloadAwaitable<Result>(pool, std::function<Result()>(std::forward<F>(fn)));
+}
+
+/**
+ * @brief 切换到线程池的等待体，协程在工作线程上继续执行
+ */
+class ResumeOnAwaitable {
+public:
+    explicit ResumeOnAwaitable(ThreadPool& pool) : pool(pool) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        pool.post([handle]() { handle.resume(); });
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    ThreadPool& pool;
+};
+
+/**
+ * @brief 让协程剩余的部分在线程池上执行
+ * @param pool 线程池
+ * @return 可co_await的等待体
+ */
+inline ResumeOnAwaitable resumeOn(ThreadPool& pool) {
+    return ResumeOnAwaitable(pool);
+}
+
+} // namespace ImageForensics
+
+// 模板函数实现
+namespace ImageForensics {
+
+template<typename F>
+auto ThreadPool::submit(F&& fn) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+    using Result = std::invoke_result_t<std::decay_t<F>>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(fn));
+    auto future = task->get_future();
+    post([task]() { (*task)(); });
+    return future;
+}
+
+} // namespace ImageForensics
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <bit>
+#include <algorithm>
+#include <cstdint>
+
+namespace ImageForensics {
+
+/**
+ * @brief 访问频率估计（4行Count-Min Sketch，4位饱和计数器）
+ *
+ * 每个64位字打包16个计数器，使用原子操作更新，读路径无需加锁。累计增加次数达到采样上限后所有计数减半，
+ * 使估计值反映近期的访问频率。
+ */
+class FrequencySketch {
+public:
+    /**
+     * @brief 构造函数
+     * @param expectedEntries 预计的条目数量，决定计数器宽度
+     */
+    explicit FrequencySketch(size_t expectedEntries);
+
+    /**
+     * @brief 记录一次访问
+     * @param hash 键的哈希值
+     */
+    void increment(uint64_t hash);
+
+    /**
+     * @brief 估计访问频率
+     * @param hash 键的哈希值
+     * @return 频率估计值（0-15）
+     */
+    unsigned estimate(uint64_t hash) const;
+
+private:
+    static constexpr size_t ROWS = 4;
+    static constexpr uint64_t MAX_COUNT = 15;
+    static constexpr size_t COUNTERS_PER_WORD = 16;
+
+    size_t indexOf(uint64_t hash, size_t row) const;
+    void halve();
+
+    size_t widthMask;
+    size_t sampleSize;
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    std::atomic<size_t> additions{0};
+    std::mutex resetMutex;
+};
+
+/**
+ * @brief 分片并发缓存，按字节限制内存占用，使用W-TinyLFU准入和淘汰
+ *
+ * 键按哈希分布到2的幂个分片，每个分片有独立的读写锁。每个分片分为窗口区（约1%）
+ * 和主区，主区再分为试用段和保护段（约80%）。新条目先进入窗口区；窗口区溢出时，
+ * 被挤出的条目只有在访问频率高于主区淘汰候选时才被接纳，只访问一次的条目不会挤掉
+ * 热点数据。
+ *
+ * 命中只在所属分片上持有共享锁：设置条目的访问位并增加频率计数，队列顺序的调整
+ * 推迟到写入时按CLOCK方式进行。值以shared_ptr<const Value>保存和返回，命中时不复制。
+ */
+template<typename Value>
+class ShardedCache {
+public:
+    using Clock = std::chrono::steady_clock;
+    using ValuePtr = std::shared_ptr<const Value>;
+
+    /**
+     * @brief 构造函数
+     * @param maxAge 条目的最大存活时间
+     * @param maxBytes 内存预算（字节），平均分配给各分片
+     * @param shardCount 分片数量，向上取整为2的幂；为0时按硬件并发数选择。
+     *                   每个分片的预算不足MIN_SHARD_BYTES时减少分片数量
+     */
+    ShardedCache(std::chrono::seconds maxAge, size_t maxBytes, size_t shardCount = 0)
+        : maxAge(maxAge), sketch(std::max<size_t>(1, maxBytes / AVERAGE_ENTRY_BYTES)) {
+        if (shardCount == 0) {
+            shardCount = 4 * std::max(1u, std::thread::hardware_concurrency());
+        }
+        shardCount = std::bit_ceil(shardCount);
+        while (shardCount > 1 && maxBytes / shardCount < MIN_SHARD_BYTES) {
+            shardCount /= 2;
+        }
+
+        shards = std::make_unique<Shard[]>(shardCount);
+        shardMask = shardCount - 1;
+        shardCapacity = std::max<size_t>(1, maxBytes / shardCount);
+        windowCapacity = std::max<size_t>(1, shardCapacity / 100);
+        protectedCapacity = (shardCapacity - std::min(windowCapacity, shardCapacity)) / 10 * 8;
+    }
+
+    ShardedCache(const ShardedCache&) = delete;
+    ShardedCache& operator=(const ShardedCache&) = delete;
+
+    /**
+     * @brief 写入或替换条目，必要时按W-TinyLFU淘汰
+     * @param key 键
+     * @param value 值
+     * @param charge 条目占用的字节数
+     * @return 超过单个分片预算而未缓存时返回false
+     */
+    bool put(const std::string& key, ValuePtr value, size_t charge) {
+        if (charge > shardCapacity) {
+            return false;
+        }
+
+        uint64_t hash = hashKey(key);
+        sketch.increment(hash);
+
+        Shard& shard = shardFor(hash);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+        auto [it, inserted] = shard.entries.try_emplace(key);
+        Node* node = &*it;
+        Entry& entry = it->second;
+
+        if (!inserted) {
+            shard.bytes(entry.segment) -= entry.charge;
+            entry.referenced.store(true, std::memory_order_relaxed);
+        } else {
+            entry.hash = hash;
+            entry.segment = Segment::Window;
+            shard.window.push_back(node);
+            entry.position = std::prev(shard.window.end());
+        }
+
+        entry.value = std::move(value);
+        entry.storedAt = Clock::now();
+        entry.charge = charge;
+        shard.bytes(entry.segment) += charge;
+
+        rebalance(shard);
+        return true;
+    }
+
+    /**
+     * @brief 更新条目占用的字节数，用于写入后仍会增长的值，必要时淘汰其他条目
+     * @param key 键
+     * @param value 写入时的值，条目已被替换或删除时不做任何事
+     * @param charge 条目当前占用的字节数
+     */
+    void recharge(const std::string& key, const Value* value, size_t charge) {
+        Shard& shard = shardFor(hashKey(key));
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end() || it->second.value.get() != value) {
+            return;
+        }
+        if (charge > shardCapacity) {
+            remove(shard, &*it);
+            return;
+        }
+
+        Entry& entry = it->second;
+        shard.bytes(entry.segment) -= entry.charge;
+        entry.charge = charge;
+        shard.bytes(entry.segment) += charge;
+
+        demoteProtected(shard);
+        rebalance(shard);
+    }
+
+    /**
+     * @brief 读取条目
+     * @param key 键
+     * @return 缓存的值，不存在或已过期时返回nullptr
+     */
+    ValuePtr get(const std::string& key) {
+        uint64_t hash = hashKey(key);
+        Shard& shard = shardFor(hash);
+        auto now = Clock::now();
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.entries.find(key);
+            if (it == shard.entries.end()) {
+                return nullptr;
+            }
+
+            const Entry& entry = it->second;
+            if (now - entry.storedAt <= maxAge) {
+                sketch.increment(hash);
+                // 已设置时不再写入，避免热点条目的缓存行在核间来回传递
+                if (!entry.referenced.load(std::memory_order_relaxed)) {
+                    entry.referenced.store(true, std::memory_order_relaxed);
+                }
+                return entry.value;
+            }
+        }
+
+        // 已过期，换成独占锁后删除；期间可能已被重新写入，需要再次检查
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() && now - it->second.storedAt > maxAge) {
+            remove(shard, &*it);
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief 删除条目
+     * @param key 键
+     */
+    void erase(const std::string& key) {
+        Shard& shard = shardFor(hashKey(key));
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            remove(shard, &*it);
+        }
+    }
+
+    /**
+     * @brief 删除所有过期条目，逐个分片加锁
+     * @return 删除的条目数量
+     */
+    size_t removeExpired() {
+        auto now = Clock::now();
+        size_t removed = 0;
+        for (size_t i = 0; i <= shardMask; ++i) {
+            Shard& shard = shards[i];
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+                auto next = std::next(it);
+                if (now - it->second.storedAt > maxAge) {
+                    remove(shard, &*it);
+                    removed++;
+                }
+                it = next;
+            }
+        }
+        return removed;
+    }
+
+    /**
+     * @brief 获取条目数量（各分片分别加锁统计，仅供监控使用）
+     * @return 条目数量
+     */
+    size_t size() const {
+        size_t total = 0;
+        for (size_t i = 0; i <= shardMask; ++i) {
+            std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+            total += shards[i].entries.size();
+        }
+        return total;
+    }
+
+    /**
+     * @brief 获取已占用的字节数（仅供监控使用）
+     * @return 字节数
+     */
+    size_t bytes() const {
+        size_t total = 0;
+        for (size_t i = 0; i <= shardMask; ++i) {
+            std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+            total += shards[i].totalBytes();
+        }
+        return total;
+    }
+
+    /**
+     * @brief 获取分片数量
+     * @return 分片数量
+     */
+    size_t shardCount() const { return shardMask + 1; }
+
+    /**
+     * @brief 每个分片的最小预算，分片过多时每个分片放不下几个条目
+     */
+    static constexpr size_t MIN_SHARD_BYTES = 1024 * 1024;
+
+private:
+    // 用于按内存预算估计频率计数器宽度
+    static constexpr size_t AVERAGE_ENTRY_BYTES = 4096;
+
+    enum class Segment : uint8_t { Window, Probation, Protected };
+
+    struct Entry;
+    using Node = std::pair<const std::string, Entry>;
+    using Queue = std::list<Node*>;
+
+    // 值、写入时间和队列位置放在同一个条目中，一次查找即可得到
+    struct Entry {
+        ValuePtr value;
+        Clock::time_point storedAt;
+        size_t charge = 0;
+        uint64_t hash = 0;
+        Segment segment = Segment::Window;
+        typename Queue::iterator position;
+        mutable std::atomic<bool> referenced{false};
+    };
+
+    // 对齐到缓存行，避免相邻分片的锁互相干扰
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        Queue window;
+        Queue probation;
+        Queue protectedQueue;
+        size_t windowBytes = 0;
+        size_t probationBytes = 0;
+        size_t protectedBytes = 0;
+
+        Queue& queue(Segment segment) {
+            switch (segment) {
+                case Segment::Window: return window;
+                case Segment::Probation: return probation;
+                default: return protectedQueue;
+            }
+        }
+
+        size_t& bytes(Segment segment) {
+            switch (segment) {
+                case Segment::Window: return windowBytes;
+                case Segment::Probation: return probationBytes;
+                default: return protectedBytes;
+            }
+        }
+
+        size_t totalBytes() const { return windowBytes + probationBytes + protectedBytes; }
+    };
+
+    static uint64_t hashKey(const std::string& key) {
+        // 混合高位，避免std::hash低位分布不均时分片倾斜
+        uint64_t hash = std::hash<std::string>{}(key);
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    Shard& shardFor(uint64_t hash) {
+        return shards[hash & shardMask];
+    }
+
+    // 把条目移到另一段的队尾
+    void move(Shard& shard, Node* node, Segment segment) {
+        Entry& entry = node->second;
+        shard.bytes(entry.segment) -= entry.charge;
+        shard.queue(segment).splice(shard.queue(segment).end(), shard.queue(entry.segment), entry.position);
+        entry.segment = segment;
+        shard.bytes(segment) += entry.charge;
+    }
+
+    void remove(Shard& shard, Node* node) {
+        Entry& entry = node->second;
+        shard.bytes(entry.segment) -= entry.charge;
+        shard.queue(entry.segment).erase(entry.position);
+        shard.entries.erase(shard.entries.find(node->first));
+    }
+
+    // 保护段超出配额时，按CLOCK把未被访问的条目降级回试用段
+    void demoteProtected(Shard& shard) {
+        while (shard.protectedBytes > protectedCapacity && !shard.protectedQueue.empty()) {
+            Node* node = shard.protectedQueue.front();
+            if (node->second.referenced.exchange(false, std::memory_order_relaxed)) {
+                move(shard, node, Segment::Protected);
+            } else {
+                move(shard, node, Segment::Probation);
+            }
+        }
+    }
+
+    // 按CLOCK选出主区的淘汰候选：试用段中被访问过的条目晋升到保护段，
+    // 试用段只剩下准入候选本身时从保护段选
+    Node* selectVictim(Shard& shard, Node* exclude) {
+        while (!shard.probation.empty() && shard.probation.front() != exclude) {
+            Node* node = shard.probation.front();
+            if (!node->second.referenced.exchange(false, std::memory_order_relaxed)) {
+                return node;
+            }
+            move(shard, node, Segment::Protected);
+            demoteProtected(shard);
+        }
+
+        while (!shard.protectedQueue.empty()) {
+            Node* node = shard.protectedQueue.front();
+            if (!node->second.referenced.exchange(false, std::memory_order_relaxed)) {
+                return node;
+            }
+            move(shard, node, Segment::Protected);
+        }
+        return nullptr;
+    }
+
+    // 窗口区挤出的候选与主区淘汰候选比较频率，频率更高者留下
+    void admit(Shard& shard, Node* candidate) {
+        while (shard.totalBytes() > shardCapacity) {
+            Node* victim = selectVictim(shard, candidate);
+            if (!victim) {
+                return;
+            }
+            if (sketch.estimate(candidate->second.hash) > sketch.estimate(victim->second.hash)) {
+                remove(shard, victim);
+            } else {
+                remove(shard, candidate);
+                return;
+            }
+        }
+    }
+
+    void rebalance(Shard& shard) {
+        // 窗口区超出配额：最旧的未访问条目移入试用段并参与准入比较；窗口至少保留最新的一个条目
+        while (shard.windowBytes > windowCapacity && shard.window.size() > 1) {
+            Node* node = shard.window.front();
+            if (node->second.referenced.exchange(false, std::memory_order_relaxed)) {
+                move(shard, node, Segment::Window);
+                continue;
+            }
+            move(shard, node, Segment::Probation);
+            admit(shard, node);
+        }
+
+        // 替换为更大的值等情况下仍可能超出预算，依次从主区和窗口区淘汰
+        while (shard.totalBytes() > shardCapacity) {
+            Node* victim = selectVictim(shard, nullptr);
+            if (!victim) {
+                break;
+            }
+            remove(shard, victim);
+        }
+        while (shard.totalBytes() > shardCapacity && !shard.window.empty()) {
+            remove(shard, shard.window.front());
+        }
+    }
+
+    std::chrono::seconds maxAge;
+    FrequencySketch sketch;
+    std::unique_ptr<Shard[]> shards;
+    size_t shardMask = 0;
+    size_t shardCapacity = 0;
+    size_t windowCapacity = 0;
+    size_t protectedCapacity = 0;
+};
+
+} // namespace ImageForensics
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace ImageForensics {
+
+/**
+ * @brief 缓存条目的压缩编解码
+ *
+ * 序列化后的元数据在不同图像之间高度重复（相同的EXIF/XMP键名和厂商字符串），
+ * 使用在本服务自己的结果上训练的zstd字典压缩。每个条目以一个字节的格式标记开头，
+ * 压缩条目随后是4字节的字典ID，解码时按ID选择字典，因此重新训练字典后旧条目仍可读取。
+ * 未编译zstd支持时条目以不压缩的格式保存。
+ */
+class EntryCodec {
+public:
+    /**
+     * @brief 是否编译了zstd支持
+     * @return 支持压缩返回true
+     */
+    static bool available();
+
+    /**
+     * @brief 设置压缩级别，同时启用或关闭压缩
+     * @param enabled 是否压缩新条目；关闭后已有的压缩条目仍可解码
+     * @param level zstd压缩级别
+     */
+    static void configure(bool enabled, int level = 3);
+
+    /**
+     * @brief 加载目录中所有的字典文件（*.dict）
+     *
+     * 修改时间最新的字典用于压缩新条目，其余字典只用于解码旧条目。
+     * @param directory 字典目录
+     * @return 成功加载的字典数量
+     */
+    static size_t loadDictionaries(const std::filesystem::path& directory);
+
+    /**
+     * @brief 加载单个字典
+     * @param path 字典文件路径
+     * @param makeCurrent 是否用于压缩新条目
+     * @return 字典ID，文件无法读取或不是zstd字典时返回std::nullopt
+     */
+    static std::optional<uint32_t> loadDictionary(const std::filesystem::path& path, bool makeCurrent = true);
+
+    /**
+     * @brief 获取用于压缩新条目的字典ID
+     * @return 字典ID，没有字典时返回0
+     */
+    static uint32_t currentDictionaryId();
+
+    /**
+     * @brief 编码一个条目
+     * @param data 序列化后的数据
+     * @return 编码后的条目
+     */
+    static std::string encode(std::string_view data);
+
+    /**
+     * @brief 解码一个条目
+     * @param entry 编码后的条目；不带格式标记的旧条目按原样返回
+     * @return 原始数据，条目损坏或所需字典未加载时返回std::nullopt
+     */
+    static std::optional<std::string> decode(std::string_view entry);
+
+    /**
+     * @brief 获取字典内容中记录的字典ID
+     * @param dictionary 字典内容
+     * @return 字典ID，不是zstd字典或未编译zstd支持时返回0
+     */
+    static uint32_t dictionaryId(std::string_view dictionary);
+
+    /**
+     * @brief 用样本训练字典
+     * @param samples 样本
+     * @param dictionarySize 字典大小上限（字节）
+     * @return 字典内容，训练失败时返回std::nullopt
+     */
+    static std::optional<std::string> trainDictionary(const std::vector<std::string>& samples,
+                                                      size_t dictionarySize = 112640);
+};
+
+/**
+ * @brief HTTP响应体的内容编码
+ */
+enum class ContentEncoding {
+    Identity,
+    Gzip,
+    Zstd
+};
+
+/**
+ * @brief 按Accept-Encoding压缩HTTP响应体
+ *
+ * 与EntryCodec不同，响应使用不带字典的标准gzip和zstd格式，客户端可以直接解码。
+ * 小于阈值的响应不压缩：压缩节省的字节抵不上压缩和解压的开销。
+ */
+class ResponseEncoder {
+public:
+    /**
+     * @brief 设置响应压缩参数
+     * @param enabled 是否压缩响应
+     * @param minSize 压缩的最小响应大小（字节）
+     * @param gzipLevel zlib压缩级别
+     * @param zstdLevel zstd压缩级别
+     */
+    static void configure(bool enabled, size_t minSize = 1024, int gzipLevel = 6, int zstdLevel = 3);
+
+    /**
+     * @brief 按Accept-Encoding选择内容编码
+     *
+     * 支持q值和"*"；zstd和gzip的q值相同时优先zstd，未编译zstd支持时不选择zstd。
+     * @param acceptEncoding Accept-Encoding头的值
+     * @param size 响应体大小
+     * @return 选择的编码，关闭压缩、响应小于阈值或客户端不接受压缩时返回Identity
+     */
+    static ContentEncoding negotiate(std::string_view acceptEncoding, size_t size);
+
+    /**
+     * @brief 获取编码在Content-Encoding头中的名称
+     * @param encoding 编码
+     * @return 名称
+     */
+    static const char* name(ContentEncoding encoding);
+
+    /**
+     * @brief 压缩响应体
+     * @param data 响应体
+     * @param encoding 编码，Identity时原样返回
+     * @return 压缩后的响应体，压缩失败时返回std::nullopt
+     */
+    static std::optional<std::string> compress(std::string_view data, ContentEncoding encoding);
+};
+
+} // namespace ImageForensics
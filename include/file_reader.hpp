@@ -0,0 +1,79 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace ImageForensics {
+
+/**
+ * @brief 单个文件读取请求
+ */
+struct FileReadRequest {
+    std::filesystem::path path;
+    uint64_t maxBytes = 0; ///< 最多读取的字节数，0表示读取整个文件
+};
+
+/**
+ * @brief 单个文件读取结果
+ */
+struct FileReadResult {
+    size_t index = 0;            ///< 请求在批次中的下标
+    std::filesystem::path path;
+    std::vector<unsigned char> data;
+    uint64_t fileSize = 0;       ///< 文件实际大小
+    bool truncated = false;      ///< 是否只读取了文件的前maxBytes字节
+    int error = 0;               ///< errno，0表示成功
+};
+
+/**
+ * @brief 批量文件读取器
+ *
+ * 在支持io_uring的系统上一次提交多个文件的读请求，使用注册缓冲区并限制队列深度；
+ * 不支持时退化为逐个pread。每个文件读完后立即在调用线程上回调，调用方可直接
+ * 把结果交给解析线程，不必等待整个批次完成。
+ */
+class BatchFileReader {
+public:
+    /**
+     * @brief 完成回调
+     */
+    using CompletionHandler = std::function<void(FileReadResult&&)>;
+
+    /**
+     * @brief 构造函数
+     * @param queueDepth 同时在途的读请求数量上限
+     * @param bufferSize 每个注册缓冲区的大小，大文件按此大小分块读取
+     */
+    explicit BatchFileReader(unsigned queueDepth = 64, size_t bufferSize = 256 * 1024);
+
+    /**
+     * @brief 析构函数
+     */
+    ~BatchFileReader();
+
+    BatchFileReader(const BatchFileReader&) = delete;
+    BatchFileReader& operator=(const BatchFileReader&) = delete;
+
+    /**
+     * @brief 读取一批文件，每个文件完成时调用一次回调（完成顺序不保证与请求顺序一致）
+     * @param requests 读取请求
+     * @param onComplete 完成回调
+     */
+    void readAll(const std::vector<FileReadRequest>& requests, const CompletionHandler& onComplete);
+
+    /**
+     * @brief 是否正在使用io_uring
+     * @return 使用io_uring时返回true，使用pread回退实现时返回false
+     */
+    bool usingIoUring() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace ImageForensics
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ImageForensics {
+
+/**
+ * @brief 指标类型，对应Prometheus文本格式中的TYPE
+ */
+enum class MetricType {
+    Gauge,
+    Counter
+};
+
+/**
+ * @brief 汇总就绪状态和运行指标，供控制面的/ready和/metrics使用
+ *
+ * 指标和就绪检查都在请求到达时通过回调读取。回调只能读取原子变量或短暂持有锁，
+ * 不能等待工作线程池，否则业务过载时健康检查也会随之超时。
+ * 所有指标和检查都应在控制面开始处理请求之前注册。
+ */
+class HealthMonitor {
+public:
+    using Sample = std::function<double()>;
+    using Check = std::function<bool()>;
+
+    /**
+     * @brief 构造函数，记录启动时刻用于计算运行时间
+     */
+    HealthMonitor();
+
+    /**
+     * @brief 注册一个指标
+     * @param name 指标名，应带image_forensics_前缀
+     * @param help 说明
+     * @param type 指标类型
+     * @param sample 读取当前值的回调
+     */
+    void addMetric(std::string name, std::string help, MetricType type, Sample sample);
+
+    /**
+     * @brief 注册一个就绪检查
+     * @param reason 检查不通过时报告的原因，如"draining"
+     * @param check 就绪时返回true
+     */
+    void addReadinessCheck(std::string reason, Check check);
+
+    /**
+     * @brief 按注册顺序执行就绪检查
+     * @return 第一个不通过的检查的原因，全部通过时返回std::nullopt
+     */
+    std::optional<std::string> notReadyReason() const;
+
+    /**
+     * @brief 获取运行时间
+     * @return 自构造起经过的秒数
+     */
+    std::chrono::seconds uptime() const;
+
+    /**
+     * @brief 以Prometheus文本格式输出所有指标，另外包含就绪状态和运行时间
+     * @return 指标文本
+     */
+    std::string renderMetrics() const;
+
+private:
+    struct Metric {
+        std::string name;
+        std::string help;
+        MetricType type;
+        Sample sample;
+    };
+
+    struct ReadinessCheck {
+        std::string reason;
+        Check check;
+    };
+
+    std::chrono::steady_clock::time_point started;
+    std::vector<Metric> metrics;
+    std::vector<ReadinessCheck> checks;
+};
+
+} // namespace ImageForensics
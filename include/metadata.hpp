@@ -4,7 +4,15 @@
 #include <filesystem>
 #include <optional>
 #include <string>
+#include <span>
 #include <map>
+#include <vector>
+#include <cstdint>
+#include "async.hpp"
+
+namespace Exiv2 {
+class Image;
+}
 
 namespace ImageForensics {
 
@@ -15,10 +23,21 @@ using json = nlohmann::json;
  */
 class MetadataExtractor {
 public:
+    /**
+     * @brief 提取器输出格式的版本，提取结果的字段或取值方式变化时递增，旧的缓存结果随之失效
+     */
+    static constexpr const char* EXTRACTOR_VERSION = "1";
+
+    /**
+     * @brief 篡改检测规则的版本，检测规则或评分方式变化时递增
+     */
+    static constexpr const char* RULESET_VERSION = "1";
+
     /**
      * @brief 构造函数
+     * @param cancellation 取消令牌，提取和检测的各阶段之间检查，取消时抛出OperationCancelled
      */
-    MetadataExtractor();
+    explicit MetadataExtractor(CancellationToken cancellation = CancellationToken());
 
     /**
      * @brief 提取图像元数据
@@ -27,6 +46,14 @@ public:
      */
     std::optional<json> extractMetadata(const std::filesystem::path& imagePath);
 
+    /**
+     * @brief 从内存缓冲区提取图像元数据
+     * @param data 图像数据
+     * @param filename 文件名，仅用于结果和日志
+     * @return 可选的JSON格式元数据，如果提取失败则返回std::nullopt
+     */
+    std::optional<json> extractMetadata(std::span<const unsigned char> data, const std::string& filename);
+
     /**
      * @brief 检测图像是否被篡改
      * @param imagePath 图像路径
@@ -34,6 +61,13 @@ public:
      */
     std::optional<json> detectTampering(const std::filesystem::path& imagePath);
 
+    /**
+     * @brief 基于已提取的元数据检测篡改，避免重复解析图像
+     * @param metadata extractMetadata返回的元数据
+     * @return 可选的JSON格式篡改检测结果，如果检测失败则返回std::nullopt
+     */
+    std::optional<json> detectTampering(const json& metadata);
+
     /**
      * @brief 获取支持的图像格式列表
      * @return 支持的图像格式列表
@@ -41,6 +75,15 @@ public:
     std::vector<std::string> getSupportedFormats() const;
 
 private:
+    /**
+     * @brief 从已打开的Exiv2图像构建元数据JSON
+     * @param image Exiv2图像
+     * @param filename 文件名
+     * @param filesize 文件大小
+     * @return 元数据
+     */
+    json buildMetadata(Exiv2::Image& image, const std::string& filename, uintmax_t filesize);
+
     /**
      * @brief 检查元数据一致性
      * @param metadata 元数据
@@ -54,6 +97,8 @@ private:
      * @return GPS信息的JSON对象
      */
     json parseGpsInfo(const std::map<std::string, std::string>& exifData);
+
+    CancellationToken cancellation;
 };
 
 } // namespace ImageForensics 
\ No newline at end of file
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "util.hpp"
+
+namespace ImageForensics {
+
+/**
+ * @brief multipart/form-data中一个部分的头信息
+ */
+struct MultipartPartInfo {
+    std::string name;         ///< Content-Disposition中的字段名
+    std::string filename;     ///< Content-Disposition中的文件名，普通字段为空
+    std::string contentType;  ///< 部分的Content-Type，未声明时为空
+};
+
+/**
+ * @brief 增量的multipart/form-data解析器
+ *
+ * 请求体可以分多次送入。部分的内容以指向送入数据的span交给回调，不复制；
+ * 只有可能是分隔符前缀的少量尾部字节会暂存到下一次送入。分隔符的查找用memchr定位候选位置，
+ * 再比较完整的分隔符。
+ */
+class MultipartParser {
+public:
+    /**
+     * @brief 解析回调，返回false时中止解析
+     */
+    struct Callbacks {
+        std::function<bool(const MultipartPartInfo&)> onPartBegin;           ///< 部分头解析完成
+        std::function<bool(std::span<const unsigned char>)> onPartData;      ///< 部分内容，一个部分可能分多次交付
+        std::function<bool()> onPartEnd;                                     ///< 部分结束
+    };
+
+    /**
+     * @brief 从Content-Type中取出boundary参数
+     * @param contentType Content-Type头的值
+     * @return boundary，不是multipart/form-data或缺少boundary时返回std::nullopt
+     */
+    static std::optional<std::string> boundaryFromContentType(std::string_view contentType);
+
+    /**
+     * @brief 构造函数
+     * @param boundary 分隔符参数（不含前导的"--"）
+     * @param callbacks 解析回调
+     * @param maxHeaderSize 单个部分头的大小上限
+     */
+    MultipartParser(std::string boundary, Callbacks callbacks, size_t maxHeaderSize = 16 * 1024);
+
+    /**
+     * @brief 送入一段请求体
+     * @param chunk 数据，交给onPartData的span只在本次调用期间有效，除非调用方保证数据的生命周期
+     * @return 格式错误或回调中止时返回false
+     */
+    bool feed(std::string_view chunk);
+
+    /**
+     * @brief 是否已经读到结束分隔符
+     * @return 完整解析返回true
+     */
+    bool finished() const { return state == State::Done; }
+
+    /**
+     * @brief 获取错误描述
+     * @return 错误描述，没有错误时为空
+     */
+    const std::string& error() const { return errorMessage; }
+
+private:
+    enum class State {
+        Preamble,       ///< 第一个分隔符之前
+        AfterBoundary,  ///< 分隔符之后，等待CRLF或结束标记"--"
+        Headers,        ///< 部分头
+        Body,           ///< 部分内容
+        Done,
+        Error
+    };
+
+    size_t consumeContent(std::string_view data);
+    size_t consumeCarry(std::string_view data);
+    size_t consumeAfterBoundary(std::string_view data);
+    size_t consumeHeaders(std::string_view data);
+    size_t findDelimiter(std::string_view data) const;
+    bool emitContent(std::string_view data);
+    bool boundaryReached();
+    bool fail(const std::string& message);
+
+    std::string delimiter;  ///< "\r\n--" + boundary
+    Callbacks callbacks;
+    size_t maxHeaderSize;
+
+    State state = State::Preamble;
+    std::string carry;        ///< 可能是分隔符前缀的尾部字节
+    std::string afterBoundary;
+    std::string headerBuffer;
+    std::string errorMessage;
+};
+
+/**
+ * @brief 接收上传的参数
+ */
+struct UploadOptions {
+    size_t spillThreshold = 4 * 1024 * 1024;  ///< 单个文件需要复制的内容超过此大小时写入临时文件
+    std::filesystem::path spillDirectory;     ///< 临时文件目录，为空时使用系统临时目录
+    size_t maxFiles = 32;                     ///< 单个请求中文件数量的上限
+    bool hashContent = true;                  ///< 是否在接收时计算内容哈希
+};
+
+/**
+ * @brief 一个接收完成的上传文件
+ *
+ * 内容在内存中时，data指向接收缓冲区（整个部分在一次送入中到达）或自有的缓冲区；
+ * 跨越多次送入的部分需要复制，复制的内容超过落盘阈值时改为写入spillPath，析构时删除该临时文件。
+ */
+class UploadedPart {
+public:
+    UploadedPart() = default;
+    ~UploadedPart();
+
+    UploadedPart(UploadedPart&& other) noexcept;
+    UploadedPart& operator=(UploadedPart&& other) noexcept;
+    UploadedPart(const UploadedPart&) = delete;
+    UploadedPart& operator=(const UploadedPart&) = delete;
+
+    /**
+     * @brief 内容是否已写入临时文件
+     * @return 落盘返回true
+     */
+    bool spilled() const { return !spillPath.empty(); }
+
+    /**
+     * @brief 获取内容，落盘时从临时文件读回
+     * @return 内容，临时文件读取失败时返回std::nullopt
+     */
+    std::optional<std::span<const unsigned char>> content();
+
+    std::string fieldName;                ///< 表单字段名
+    std::string filename;                 ///< 客户端提供的文件名
+    std::string contentType;              ///< 客户端声明的Content-Type
+    std::string mimeType;                 ///< 按文件头签名识别的类型
+    std::string contentHash;              ///< 内容哈希（computeContentHash的结果），未计算时为空
+    uint64_t size = 0;                    ///< 内容大小
+    std::span<const unsigned char> data;  ///< 内存中的内容，落盘时为空
+    std::filesystem::path spillPath;      ///< 临时文件路径，未落盘时为空
+
+private:
+    friend class UploadReceiver;
+
+    void removeSpillFile();
+
+    std::vector<unsigned char> buffer;
+};
+
+/**
+ * @brief 在multipart请求体到达的同时接收其中的文件
+ *
+ * 每个文件部分在到达时计算内容哈希、识别格式，超过阈值时写入临时文件，
+ * 部分结束时立即交给回调，批量请求不必等整个请求体解析完才开始处理第一个文件。
+ * 没有文件名的普通字段被忽略。
+ */
+class UploadReceiver {
+public:
+    /**
+     * @brief 文件接收完成的回调
+     */
+    using PartHandler = std::function<void(UploadedPart&&)>;
+
+    static constexpr const char* SPILL_PREFIX = ".upload-";  ///< 临时文件名的前缀
+    static constexpr const char* SPILL_SUFFIX = ".tmp";      ///< 临时文件名的后缀
+
+    /**
+     * @brief 构造函数
+     * @param boundary 分隔符参数
+     * @param options 参数
+     * @param onPart 文件接收完成的回调
+     */
+    UploadReceiver(std::string boundary, UploadOptions options, PartHandler onPart);
+
+    UploadReceiver(const UploadReceiver&) = delete;
+    UploadReceiver& operator=(const UploadReceiver&) = delete;
+
+    /**
+     * @brief 送入一段请求体
+     *
+     * 整个部分在一次送入中到达时不复制内容，交给回调的UploadedPart直接指向chunk，
+     * 调用方需要保证chunk在处理完成前有效。
+     * @param chunk 数据
+     * @return 格式错误或文件数量超过上限时返回false
+     */
+    bool feed(std::string_view chunk);
+
+    /**
+     * @brief 请求体是否完整
+     * @return 读到结束分隔符返回true
+     */
+    bool finished() const { return parser.finished(); }
+
+    /**
+     * @brief 获取错误描述
+     * @return 错误描述，没有错误时为空
+     */
+    const std::string& error() const;
+
+    /**
+     * @brief 获取已接收的文件数量
+     * @return 文件数量
+     */
+    size_t fileCount() const { return files; }
+
+private:
+    bool beginPart(const MultipartPartInfo& info);
+    bool appendData(std::span<const unsigned char> chunk);
+    bool endPart();
+    bool spill();
+    void keepInBuffer();
+
+    UploadOptions options;
+    PartHandler onPart;
+    MultipartParser parser;
+
+    bool receiving = false;
+    UploadedPart current;
+    std::vector<unsigned char> sniff;
+    std::unique_ptr<ContentHasher> hasher;
+    std::ofstream spillFile;  ///< 在current之前析构，先关闭文件再由current删除
+    const unsigned char* feedBegin = nullptr;
+    const unsigned char* feedEnd = nullptr;
+    size_t files = 0;
+    std::string errorMessage;
+};
+
+} // namespace ImageForensics
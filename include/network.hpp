@@ -3,23 +3,90 @@
 #include <pistache/endpoint.h>
 #include <pistache/router.h>
 #include <pistache/http.h>
+#include "async.hpp"
+#include "rate_limiter.hpp"
+#include "health_monitor.hpp"
 #include <string>
 #include <functional>
 #include <filesystem>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace ImageForensics {
 
 using namespace Pistache;
 
+/**
+ * @brief HTTP服务器参数，超时和backlog的默认值与Pistache一致
+ */
+struct ServerOptions {
+    std::string host = "0.0.0.0";                     ///< 监听地址
+    int port = 8080;                                  ///< 监听端口
+    bool listenTcp = true;                            ///< 是否监听TCP，只使用Unix域套接字时关闭
+    std::filesystem::path unixSocket;                 ///< Unix域套接字路径，为空时不监听
+    std::filesystem::perms unixSocketPerms = std::filesystem::perms(0660);  ///< 套接字文件的权限
+    int threads = 4;                                  ///< 反应器线程数量
+    size_t maxRequestSize = 10 * 1024 * 1024;         ///< 默认的请求大小上限（字节）
+    size_t maxResponseSize = 64 * 1024 * 1024;        ///< 响应大小上限（字节），批量结果可能较大
+    int backlog = 128;                                ///< 监听队列长度
+    std::chrono::seconds headerTimeout{60};           ///< 接收请求头的超时时间
+    std::chrono::seconds bodyTimeout{60};             ///< 接收请求体的超时时间
+    std::chrono::seconds keepaliveTimeout{600};       ///< 空闲连接的保持时间，应长于负载均衡器的空闲超时
+    bool reusePort = false;                           ///< 是否设置SO_REUSEPORT，多个进程共享端口
+    bool noDelay = false;                             ///< 是否设置TCP_NODELAY
+    std::map<std::string, size_t> routeBodyLimits;    ///< 按路由路径覆盖请求大小上限
+    RateLimitOptions rateLimit;                       ///< 按客户端限流的参数
+    std::chrono::seconds drainDelay{0};               ///< 停止就绪后继续接收请求的时间，应长于负载均衡器检查/ready的间隔
+    std::chrono::seconds drainTimeout{30};            ///< 等待处理中的请求完成的最长时间
+    std::vector<std::string> drainExemptPaths = {"/health", "/ready", "/metrics"};  ///< 排空期间仍然响应的路由
+
+    /**
+     * @brief 从配置读取参数（server.*），未配置的项使用默认值
+     * @return 服务器参数
+     */
+    static ServerOptions fromConfig();
+
+    /**
+     * @brief 获取某个路由的请求大小上限
+     * @param path 路由路径
+     * @return 上限（字节）
+     */
+    size_t bodyLimitFor(const std::string& path) const;
+
+    /**
+     * @brief 获取端点的请求大小上限，即所有路由上限中的最大值
+     * @return 上限（字节）
+     */
+    size_t endpointRequestLimit() const;
+};
+
 /**
  * @brief 网络服务器类，处理HTTP请求和路由
  */
 class NetworkServer {
 public:
+    /**
+     * @brief 异步路由处理函数，以协程形式运行，请求和响应对象按值移入协程帧
+     *
+     * 第三个参数是请求的作用域对象，由协程帧持有到协程结束，排空时据此等待处理中的请求。
+     */
+    using AsyncHandler = std::function<DetachedTask(Rest::Request, Http::ResponseWriter, DetachedTask::Scope)>;
+
     /**
      * @brief 构造函数
+     * @param options 服务器参数，路由的请求大小上限在注册时确定
      */
-    NetworkServer();
+    explicit NetworkServer(ServerOptions options = ServerOptions());
+
+    /**
+     * @brief 按构造时的参数启动服务器，在后台线程上处理请求后返回
+     *
+     * TCP和Unix域套接字各使用一个端点，共用同一个路由器，两者上的路由、限流和大小上限完全相同。
+     * @throws ImageForensicsException 两者都未启用或套接字路径过长时抛出
+     */
+    void start();
 
     /**
      * @brief 启动服务器
@@ -30,6 +97,10 @@ public:
 
     /**
      * @brief 注册路由
+     *
+     * 启用限流时，不在豁免路径中的路由先按客户端扣除令牌，超出速率时返回429，不做任何其他工作。
+     * 端点的请求大小上限由Pistache在读取请求时执行；路由的上限低于端点上限时，
+     * 处理器开始任何工作之前按Content-Length检查，超出时返回413。
      * @param path 路径
      * @param method HTTP方法
      * @param handler 处理函数
@@ -37,13 +108,132 @@ public:
     void registerRoute(const std::string& path, Http::Method method, 
                       Rest::Route::Handler handler);
 
+    /**
+     * @brief 注册异步路由，处理器在反应器线程上启动，耗时工作通过co_await卸载到工作线程池
+     * @param path 路径
+     * @param method HTTP方法
+     * @param handler 协程处理函数
+     */
+    void registerAsyncRoute(const std::string& path, Http::Method method,
+                           AsyncHandler handler);
+
+    /**
+     * @brief 停止就绪：isReady()返回false，请求仍然照常处理，直到调用drain()
+     */
+    void beginDrain();
+
+    /**
+     * @brief 拒绝新的请求（503）并等待处理中的请求完成，drainExemptPaths中的路由不受影响
+     *
+     * 异步路由的请求在协程结束时才算完成，包括卸载到工作线程池的部分。
+     * @param timeout 最长等待时间
+     * @return 所有请求都已完成返回true，超时返回false
+     */
+    bool drain(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief 检查服务器是否就绪
+     * @return 未开始排空时返回true
+     */
+    bool isReady() const;
+
+    /**
+     * @brief 获取处理中的请求数量
+     * @return 请求数量
+     */
+    size_t inFlightRequests() const;
+
+    /**
+     * @brief 获取启动以来接受处理的请求总数，不含drainExemptPaths中的路由
+     * @return 请求数量
+     */
+    uint64_t totalRequests() const;
+
+    /**
+     * @brief 按新的参数调整限流速率和令牌桶容量；启动时未启用限流则不生效
+     * @param rateLimit 限流参数
+     */
+    void updateRateLimit(const RateLimitOptions& rateLimit);
+
+    /**
+     * @brief 获取服务器参数
+     * @return 参数
+     */
+    const ServerOptions& serverOptions() const { return options; }
+
     /**
      * @brief 关闭服务器
      */
     void shutdown();
 
 private:
+    struct DrainState;
+
+    // 带请求作用域对象的处理函数，同步路由返回时释放，异步路由交给协程帧
+    using ScopedHandler = std::function<Rest::Route::Result(const Rest::Request&, Http::ResponseWriter, DetachedTask::Scope)>;
+
+    void addRoute(const std::string& path, Http::Method method, ScopedHandler handler);
+
+    ServerOptions options;
+    std::shared_ptr<DrainState> drainState;    ///< 请求持有一份，服务器对象可以先于超时未完成的请求销毁
+    std::unique_ptr<RateLimiter> rateLimiter;  ///< 未启用限流时为空
     std::shared_ptr<Http::Endpoint> httpEndpoint;
+    std::shared_ptr<Http::Endpoint> unixEndpoint;
+    Rest::Router router;
+};
+
+/**
+ * @brief 控制面参数
+ */
+struct ControlPlaneOptions {
+    std::string host = "0.0.0.0";  ///< 监听地址
+    int port = 0;                  ///< 监听端口，为0时不单独监听，控制面路由注册在业务服务器上
+    size_t maxQueueDepth = 0;      ///< 工作线程池排队的任务超过此值时/ready返回503，为0时取工作线程数量的4倍
+
+    /**
+     * @brief 从配置读取参数（control.*），未配置的项使用默认值
+     * @return 控制面参数
+     */
+    static ControlPlaneOptions fromConfig();
+};
+
+/**
+ * @brief 控制面服务器，在独立的端口和反应器线程上提供/health、/ready和/metrics
+ *
+ * 业务路由占满反应器线程和工作线程池时，健康检查仍然能及时得到响应，
+ * 编排系统不会因为实例繁忙而把它当作故障重启。/ready在实例过载或正在关闭时返回503，
+ * 负载均衡器先把流量转移走，而存活检查/health不受影响。
+ */
+class ControlPlaneServer {
+public:
+    /**
+     * @brief 构造函数
+     * @param options 控制面参数，port必须大于0
+     * @param monitor 就绪状态和指标，生存期须长于服务器
+     */
+    ControlPlaneServer(ControlPlaneOptions options, const HealthMonitor& monitor);
+
+    /**
+     * @brief 在单个反应器线程上开始监听
+     */
+    void start();
+
+    /**
+     * @brief 关闭服务器
+     */
+    void shutdown();
+
+    /**
+     * @brief 未单独监听时，把控制面路由注册到业务服务器上
+     * @param server 业务服务器
+     * @param monitor 就绪状态和指标，生存期须长于服务器
+     */
+    static void registerRoutes(NetworkServer& server, const HealthMonitor& monitor);
+
+private:
+    ControlPlaneOptions options;
+    const HealthMonitor& monitor;
+    std::shared_ptr<Http::Endpoint> endpoint;
     Rest::Router router;
 };
 
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include "async.hpp"
+
+namespace ImageForensics {
+
+/**
+ * @brief 一致性哈希环，每个节点在环上放置多个虚拟节点
+ *
+ * 节点增减时只有相邻区间的键改变归属。哈希函数固定，不同进程对同一组节点得到相同的结果。
+ */
+class ConsistentHashRing {
+public:
+    /**
+     * @brief 构造函数
+     * @param nodes 节点名称，顺序不影响结果
+     * @param virtualNodes 每个节点的虚拟节点数量
+     */
+    explicit ConsistentHashRing(std::vector<std::string> nodes, size_t virtualNodes = 128);
+
+    /**
+     * @brief 查找负责某个键的节点
+     * @param key 键
+     * @return 节点名称，环为空时返回nullptr
+     */
+    const std::string* nodeFor(std::string_view key) const;
+
+    /**
+     * @brief 获取节点数量
+     * @return 节点数量
+     */
+    size_t size() const { return nodes.size(); }
+
+private:
+    std::vector<std::string> nodes;
+    std::vector<std::pair<uint64_t, size_t>> points;  ///< 按哈希值排序的虚拟节点
+};
+
+/**
+ * @brief 对等缓存层的参数
+ */
+struct PeerCacheOptions {
+    std::string self;                                         ///< 本实例的地址，如http://127.0.0.1:8080
+    std::vector<std::string> peers;                           ///< 所有实例的地址，可以包含本实例
+    std::string secret;                                       ///< 内部接口的共享密钥，为空时拒绝所有内部请求
+    std::chrono::milliseconds timeout{200};                   ///< 访问对等实例的超时时间
+    std::chrono::seconds retryAfter{5};                       ///< 请求失败的实例在此期间内不再访问
+    size_t virtualNodes = 128;                                ///< 每个实例的虚拟节点数量
+    size_t pushQueueSize = 1024;                              ///< 待回填结果的队列容量，满时丢弃
+};
+
+/**
+ * @brief 对等缓存层：按缓存键的一致性哈希把每个结果分配给一个实例
+ *
+ * 本地缓存未命中时先向负责该键的实例查询，命中则回填本地缓存，未命中时本地计算，
+ * 再由后台线程把结果推送给负责的实例。这样多个实例的缓存合起来相当于一个更大的缓存，
+ * 同一张图像在整个集群中只需解析一次。传输的是EntryCodec编码后的CBOR，
+ * 各实例需要加载相同的压缩字典。
+ */
+class PeerCache {
+public:
+    /**
+     * @brief 请求头中携带共享密钥的字段名
+     */
+    static constexpr const char* TOKEN_HEADER = "X-Peer-Token";
+
+    /**
+     * @brief 构造函数
+     * @param options 参数
+     */
+    explicit PeerCache(PeerCacheOptions options);
+
+    /**
+     * @brief 析构函数，停止后台推送线程
+     */
+    ~PeerCache();
+
+    PeerCache(const PeerCache&) = delete;
+    PeerCache& operator=(const PeerCache&) = delete;
+
+    /**
+     * @brief 查找负责某个键的对等实例
+     * @param key 缓存键
+     * @return 实例地址，由本实例负责时返回std::nullopt
+     */
+    std::optional<std::string> ownerOf(const std::string& key) const;
+
+    /**
+     * @brief 向负责的实例查询缓存条目
+     * @param key 缓存键
+     * @return EntryCodec编码后的CBOR，本实例负责、未命中或请求失败时返回std::nullopt
+     */
+    std::optional<std::string> fetch(const std::string& key);
+
+    /**
+     * @brief 把本地计算的条目异步推送给负责的实例
+     * @param key 缓存键
+     * @param entry EntryCodec编码后的CBOR
+     */
+    void push(const std::string& key, std::string entry);
+
+    /**
+     * @brief 校验内部接口请求携带的密钥，比较时间与内容无关
+     * @param token 请求头中的密钥，未携带时为空
+     * @return 是否允许访问；未配置密钥时总是拒绝
+     */
+    bool authorize(const std::optional<std::string>& token) const;
+
+    /**
+     * @brief 把缓存键编码为URL路径中的一段（十六进制）
+     * @param key 缓存键
+     * @return 编码结果
+     */
+    static std::string encodeKey(const std::string& key);
+
+    /**
+     * @brief 解码URL路径中的缓存键
+     * @param encoded 编码结果
+     * @return 缓存键，格式错误时返回std::nullopt
+     */
+    static std::optional<std::string> decodeKey(const std::string& encoded);
+
+private:
+    struct HttpResult {
+        long status = 0;
+        std::string body;
+    };
+
+    std::optional<HttpResult> request(const std::string& method, const std::string& peer, const std::string& key,
+                                      const std::string& body = {});
+    bool isAvailable(const std::string& peer);
+    void markFailed(const std::string& peer);
+    void pushLoop();
+
+    PeerCacheOptions options;
+    ConsistentHashRing ring;
+
+    std::mutex failureMutex;
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> failedUntil;
+
+    BoundedQueue<std::pair<std::string, std::string>> pushQueue;
+    std::thread pushThread;
+};
+
+} // namespace ImageForensics
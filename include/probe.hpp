@@ -0,0 +1,77 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+
+namespace ImageForensics {
+
+using json = nlohmann::json;
+
+/**
+ * @brief 探测时最多读取的文件头字节数
+ *
+ * 各格式的尺寸信息都位于文件开头：PNG的IHDR、GIF的逻辑屏幕描述符和BMP的DIB头在前几十字节内，
+ * JPEG的SOF位于APP段之后，TIFF的IFD0通常紧跟文件头。
+ */
+constexpr size_t PROBE_WINDOW = 64 * 1024;
+
+/**
+ * @brief 图像探测结果
+ */
+struct ProbeResult {
+    std::string mimeType;      ///< MIME类型
+    uint32_t width = 0;        ///< 宽度（像素），读取窗口内未找到时为0
+    uint32_t height = 0;       ///< 高度（像素），读取窗口内未找到时为0
+    uint16_t orientation = 1;  ///< EXIF方向，没有记录时为1
+    uint64_t fileSize = 0;     ///< 文件大小（字节）
+
+    /**
+     * @brief 是否找到了尺寸信息
+     * @return 宽高都已知返回true
+     */
+    bool hasDimensions() const { return width != 0 && height != 0; }
+
+    /**
+     * @brief 像素总数
+     * @return 宽高乘积
+     */
+    uint64_t pixels() const { return static_cast<uint64_t>(width) * height; }
+
+    /**
+     * @brief 转换为JSON
+     * @return JSON对象，未找到尺寸时不包含width和height
+     */
+    json toJson() const;
+};
+
+/**
+ * @brief 只解析格式头部，探测图像的格式、尺寸和方向
+ *
+ * 不解析EXIF/XMP的其余内容，用于在完整解析之前分流请求和拒绝过大的图像。
+ * @param header 文件开头的数据，超过PROBE_WINDOW的部分不会被读取
+ * @param fileSize 文件的完整大小
+ * @return 探测结果，不是可识别的图像格式时返回std::nullopt
+ */
+std::optional<ProbeResult> probeImage(std::span<const unsigned char> header, uint64_t fileSize);
+
+/**
+ * @brief 探测图像文件，只读取文件开头的PROBE_WINDOW字节
+ * @param filePath 文件路径
+ * @return 探测结果，文件无法读取或不是可识别的图像格式时返回std::nullopt
+ */
+std::optional<ProbeResult> probeImage(const std::filesystem::path& filePath);
+
+/**
+ * @brief 检查图像尺寸是否超过像素数上限
+ * @param result 探测结果
+ * @param maxPixels 像素数上限，为0时不限制
+ * @return 超过上限返回true
+ */
+bool exceedsPixelLimit(const ProbeResult& result, uint64_t maxPixels);
+
+} // namespace ImageForensics
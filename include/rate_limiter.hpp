@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace ImageForensics {
+
+/**
+ * @brief 限流参数
+ */
+struct RateLimitOptions {
+    bool enabled = false;                                       ///< 是否限流
+    double requestsPerMinute = 60;                              ///< 每个客户端的持续速率
+    double burst = 0;                                           ///< 令牌桶容量，为0时等于requestsPerMinute
+    size_t shards = 8192;                                       ///< 分片数量，向上取整为2的幂，每个分片容纳SLOTS_PER_SHARD个客户端
+    std::string keyHeader = "X-API-Key";                        ///< 携带API密钥的请求头
+    std::unordered_set<std::string> apiKeys;                    ///< 按密钥单独限流的API密钥，其他请求按客户端IP限流
+    std::vector<std::string> exemptPaths = {"/health", "/ready", "/metrics"};  ///< 不限流的路径前缀
+
+    /**
+     * @brief 从配置读取参数（security.rate_limit.*），未配置的项使用默认值
+     * @return 限流参数
+     */
+    static RateLimitOptions fromConfig();
+
+    /**
+     * @brief 检查路径是否不限流
+     * @param path 路由路径
+     * @return 匹配exemptPaths中的某个前缀返回true
+     */
+    bool isExempt(std::string_view path) const;
+
+    /**
+     * @brief 确定请求所属的客户端键
+     *
+     * 请求头中的密钥未经验证，客户端可以每次换一个，只有apiKeys中的密钥才按密钥限流，否则按IP地址。
+     * @param address 客户端IP地址
+     * @param apiKey keyHeader请求头的值，没有该请求头时为std::nullopt
+     * @return 客户端键，带前缀使密钥和地址不会相互冒用
+     */
+    std::string clientKey(std::string_view address, std::optional<std::string_view> apiKey) const;
+};
+
+/**
+ * @brief 限流判断结果
+ */
+struct RateLimitResult {
+    bool allowed = true;                     ///< 是否放行
+    std::chrono::milliseconds retryAfter{0}; ///< 被拒绝时，到下一个令牌可用的时间
+};
+
+/**
+ * @brief 按客户端限流的令牌桶
+ *
+ * 每个客户端的令牌桶只用一个原子的时间戳表示：令牌桶重新装满的时刻（GCRA）。
+ * 请求到达时按经过的时间惰性补充令牌，用一次CAS扣除一个令牌，不加锁，也没有后台线程。
+ * 客户端按键的哈希分配到固定大小的分片表中，分片内的槽位被占满时，令牌桶已经装满的空闲客户端
+ * 的槽位可以被直接接管；仍然找不到槽位的客户端共用一个溢出令牌桶，
+ * 因此大量伪造的客户端键也无法绕过限流。
+ */
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief 每个分片的槽位数量，一个分片占用两个缓存行
+     */
+    static constexpr size_t SLOTS_PER_SHARD = 8;
+
+    /**
+     * @brief 构造函数
+     * @param options 限流参数
+     */
+    explicit RateLimiter(const RateLimitOptions& options);
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    /**
+     * @brief 为客户端的一次请求获取令牌
+     * @param client 客户端键，通常由RateLimitOptions::clientKey得到
+     * @return 判断结果
+     */
+    RateLimitResult acquire(std::string_view client);
+
+    /**
+     * @brief 在指定时刻为客户端的一次请求获取令牌
+     * @param client 客户端键
+     * @param now 当前时刻
+     * @return 判断结果
+     */
+    RateLimitResult acquire(std::string_view client, Clock::time_point now);
+
+    /**
+     * @brief 调整速率和令牌桶容量，不影响客户端已经积累的状态，可以与acquire并发调用
+     * @param requestsPerMinute 每个客户端的持续速率
+     * @param burst 令牌桶容量，为0时等于requestsPerMinute
+     */
+    void setRate(double requestsPerMinute, double burst);
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> key{0};    ///< 客户端键的哈希，0表示空槽位
+        std::atomic<uint64_t> full{0};   ///< 令牌桶装满的时刻（相对epoch的纳秒）
+    };
+
+    Slot* slotFor(uint64_t hash, uint64_t now);
+    RateLimitResult take(Slot& slot, uint64_t now);
+
+    Clock::time_point epoch;
+    std::atomic<uint64_t> interval{0};    ///< 补充一个令牌的时间（纳秒）
+    std::atomic<uint64_t> tolerance{0};   ///< 令牌桶容量对应的时间（纳秒），扣除后full超过now加上此值时拒绝
+    size_t shardMask;
+    std::unique_ptr<Slot[]> slots;
+    Slot overflow;
+};
+
+} // namespace ImageForensics
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+#include <span>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+namespace ImageForensics {
+
+/**
+ * @brief 持久化结果存储的参数
+ */
+struct ResultStoreOptions {
+    uint64_t segmentSize = 64 * 1024 * 1024;                  ///< 单个日志段的大小上限
+    std::chrono::seconds maxAge = std::chrono::hours(24);     ///< 记录的最大存活时间
+    std::chrono::seconds compactionInterval = std::chrono::seconds(60); ///< 后台压缩的检查间隔
+    double compactionRatio = 0.5;                             ///< 未过期的有效数据占比低于此值的段会被压缩
+    uint64_t initialIndexCapacity = 1 << 16;                  ///< 索引初始槽位数，向上取整为2的幂
+    uint64_t maxBytes = 0;                                    ///< 日志段总字节数上限，为0时不限制；段大小不超过上限的四分之一
+};
+
+/**
+ * @brief 持久化的结果存储：只追加、带校验的日志段加上mmap的开放寻址哈希索引
+ *
+ * 每条记录带CRC32校验，写入当前日志段的末尾；索引文件记录每个键最新记录的位置，
+ * 通过mmap直接访问，启动时只需映射索引并重放索引之后追加的少量记录，不必扫描整个日志。
+ * 索引文件缺失或损坏时才从日志段重建。被覆盖或过期的记录由后台线程压缩：
+ * 未过期的有效数据比例过低的旧段中仍然有效的记录被重新追加，然后删除整个段；
+ * 最新记录也已过期的段不必读取，直接删除。
+ */
+class ResultStore {
+public:
+    /**
+     * @brief 构造函数，打开或创建存储目录
+     * @param directory 存储目录
+     * @param options 参数
+     * @throws ImageForensicsException 目录或索引无法创建时抛出
+     */
+    explicit ResultStore(const std::filesystem::path& directory, const ResultStoreOptions& options = {});
+
+    /**
+     * @brief 析构函数，停止后台压缩并同步索引
+     */
+    ~ResultStore();
+
+    ResultStore(const ResultStore&) = delete;
+    ResultStore& operator=(const ResultStore&) = delete;
+
+    /**
+     * @brief 写入一条记录，同一个键的旧记录随之失效
+     * @param key 键
+     * @param value 序列化后的值
+     * @return 写入成功返回true
+     */
+    bool put(const std::string& key, std::span<const uint8_t> value);
+
+    /**
+     * @brief 读取记录
+     * @param key 键
+     * @return 序列化后的值，不存在、已过期或校验失败时返回std::nullopt
+     */
+    std::optional<std::vector<uint8_t>> get(const std::string& key);
+
+    /**
+     * @brief 删除记录
+     * @param key 键
+     */
+    void erase(const std::string& key);
+
+    /**
+     * @brief 立即执行一次压缩（通常由后台线程调用）
+     * @return 被删除的日志段数量
+     */
+    size_t compact();
+
+    /**
+     * @brief 从最旧的日志段开始删除，直到日志段总字节数不超过maxBytes（通常由缓存的清理线程调用）
+     *
+     * 按段编号从旧到新删除，更早的段都已不存在，被删除段中的删除标记不再需要保留。活动段不会被删除。
+     * @return 被删除的日志段数量
+     */
+    size_t enforceByteBudget();
+
+    /**
+     * @brief 获取索引中的记录数量
+     * @return 记录数量
+     */
+    size_t size() const;
+
+    /**
+     * @brief 获取所有日志段占用的磁盘字节数
+     * @return 字节数
+     */
+    uint64_t diskBytes() const;
+
+    /**
+     * @brief 把日志段和索引同步到磁盘，用于关闭前确保已写入的记录不会因断电丢失
+     * @return 全部同步成功返回true
+     */
+    bool sync();
+
+private:
+    struct IndexHeader;
+    struct IndexSlot;
+
+    struct Segment {
+        int fd = -1;
+        uint64_t size = 0;       ///< 文件大小
+        uint64_t liveBytes = 0;  ///< 仍被索引引用的记录字节数
+        int64_t newestTimestamp = 0;  ///< 段内最新记录写入时间的上界
+    };
+
+    struct Location {
+        uint32_t segment = 0;
+        uint64_t offset = 0;
+        uint32_t length = 0;
+        int64_t timestamp = 0;
+    };
+
+    // 映射到内存的索引文件
+    struct IndexFile {
+        int fd = -1;
+        void* mapping = nullptr;
+        size_t mappingSize = 0;
+        IndexHeader* header = nullptr;
+        IndexSlot* slots = nullptr;
+    };
+
+    static bool mapIndexFile(const std::filesystem::path& path, uint64_t capacity, bool create, IndexFile& file);
+    static void unmapIndexFile(IndexFile& file);
+    static IndexSlot* findSlot(const IndexFile& file, uint64_t keyHash);
+    static void insertSlot(IndexFile& file, uint64_t keyHash, const Location& location);
+
+    std::filesystem::path segmentPath(uint32_t id) const;
+    void openSegments();
+    void openIndex();
+    void rebuildIndex();
+    void replaySegment(uint32_t id, uint64_t fromOffset);
+    void rotateSegment();
+    void growIndex();
+
+    void updateSlot(uint64_t keyHash, const Location& location);
+    void removeSlot(IndexSlot* slot);
+
+    bool appendRecord(const std::string& key, std::span<const uint8_t> value, int64_t timestamp,
+                      bool tombstone, Location& location);
+    bool readRecord(const Segment& segment, uint64_t offset, uint64_t limit, std::string& key,
+                    std::vector<uint8_t>& value, int64_t& timestamp, bool& tombstone, uint32_t& length) const;
+    bool isExpired(int64_t timestamp) const;
+    void compactSegment(uint32_t id);
+    void dropSegment(uint32_t id);
+    void compactionLoop();
+
+    std::filesystem::path directory;
+    ResultStoreOptions options;
+
+    mutable std::shared_mutex mutex;
+    std::map<uint32_t, Segment> segments;
+    uint32_t activeSegment = 0;
+
+    IndexFile index;
+
+    std::mutex compactMutex;
+    std::thread compactionThread;
+    std::mutex compactionMutex;
+    std::condition_variable compactionCondition;
+    bool stopping = false;
+};
+
+} // namespace ImageForensics
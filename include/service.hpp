@@ -4,10 +4,18 @@
 #include <filesystem>
 #include <vector>
 #include <string>
-#include <future>
+#include <span>
+#include <memory>
+#include <functional>
+#include "async.hpp"
+#include "storage.hpp"
+#include "peer_cache.hpp"
 
 namespace ImageForensics {
 
+struct FileReadResult;
+class UploadedPart;
+
 using json = nlohmann::json;
 
 /**
@@ -17,29 +25,123 @@ class ImageService {
 public:
     /**
      * @brief 构造函数
+     * @param resultCache 结果缓存，为空时不缓存；按内容哈希和提取器版本缓存，重复提交的图像不再解析
+     * @param peerCache 对等缓存层，为空时只使用本地缓存；本地未命中时先向负责的实例查询
+     * @param workerPool 批量解析使用的工作线程池，为空时在调用线程上逐个解析
      */
-    ImageService();
+    explicit ImageService(FileCache* resultCache = nullptr, PeerCache* peerCache = nullptr,
+                          ThreadPool* workerPool = nullptr);
 
     /**
      * @brief 处理单个图像
      * @param imagePath 图像路径
+     * @param token 取消令牌
      * @return JSON格式的元数据
      */
-    json processImage(const std::filesystem::path& imagePath);
+    json processImage(const std::filesystem::path& imagePath, const CancellationToken& token = CancellationToken());
+
+    /**
+     * @brief 处理内存中的单个图像
+     * @param data 图像数据
+     * @param filename 文件名，用于格式校验和结果
+     * @param token 取消令牌
+     * @return JSON格式的元数据
+     */
+    json processImageBuffer(std::span<const unsigned char> data, const std::string& filename,
+                            const CancellationToken& token = CancellationToken());
 
     /**
      * @brief 批量处理多个图像
      * @param images 图像路径列表
+     * @param token 取消令牌
      * @return JSON格式的元数据数组
      */
-    json processBatch(const std::vector<std::filesystem::path>& images);
+    json processBatch(const std::vector<std::filesystem::path>& images,
+                      const CancellationToken& token = CancellationToken());
 
     /**
      * @brief 分析图像取证信息
      * @param imagePath 图像路径
+     * @param token 取消令牌
      * @return JSON格式的取证分析结果
      */
-    json analyzeForensics(const std::filesystem::path& imagePath);
+    json analyzeForensics(const std::filesystem::path& imagePath, const CancellationToken& token = CancellationToken());
+
+    /**
+     * @brief 分析内存中图像的取证信息
+     * @param data 图像数据
+     * @param filename 文件名，用于格式校验和结果
+     * @param token 取消令牌
+     * @return JSON格式的取证分析结果
+     */
+    json analyzeForensicsBuffer(std::span<const unsigned char> data, const std::string& filename,
+                                const CancellationToken& token = CancellationToken());
+
+    /**
+     * @brief 处理内存中的图像并返回序列化后的响应
+     *
+     * 以内容哈希和文件名为键合并并发请求：第一个请求在当前线程上负责计算，
+     * 同时到达的相同请求挂起等待同一个结果并共享已序列化的响应，不占用工作线程。
+     * 成功的响应带ETag并连同编码后的字节一起缓存，命中时不再序列化。
+     * @param data 图像数据
+     * @param filename 文件名
+     * @param token 取消令牌
+     * @return 返回共享响应的协程任务
+     */
+    Task<SharedResponse> processImageShared(std::span<const unsigned char> data, const std::string& filename,
+                                            const CancellationToken& token = CancellationToken());
+
+    /**
+     * @brief 同processImageShared，使用接收上传时已经计算好的内容哈希
+     * @param data 图像数据
+     * @param filename 文件名
+     * @param contentHash data的内容哈希（computeContentHash的结果）
+     * @param token 取消令牌
+     * @return 返回共享响应的协程任务
+     */
+    Task<SharedResponse> processImageShared(std::span<const unsigned char> data, const std::string& filename,
+                                            const std::string& contentHash,
+                                            const CancellationToken& token = CancellationToken());
+
+    /**
+     * @brief 分析内存中图像的取证信息并返回序列化后的响应，合并方式同processImageShared
+     * @param data 图像数据
+     * @param filename 文件名
+     * @param token 取消令牌
+     * @return 返回共享响应的协程任务
+     */
+    Task<SharedResponse> analyzeForensicsShared(std::span<const unsigned char> data, const std::string& filename,
+                                                const CancellationToken& token = CancellationToken());
+
+    /**
+     * @brief 同analyzeForensicsShared，使用接收上传时已经计算好的内容哈希
+     * @param data 图像数据
+     * @param filename 文件名
+     * @param contentHash data的内容哈希（computeContentHash的结果）
+     * @param token 取消令牌
+     * @return 返回共享响应的协程任务
+     */
+    Task<SharedResponse> analyzeForensicsShared(std::span<const unsigned char> data, const std::string& filename,
+                                                const std::string& contentHash,
+                                                const CancellationToken& token = CancellationToken());
+
+    /**
+     * @brief 处理一个上传的文件并返回序列化后的响应，合并方式同processImageShared
+     *
+     * 使用接收时计算的内容哈希；已落盘的文件只在缓存未命中时读回。
+     * @param part 上传的文件
+     * @param token 取消令牌
+     * @return 返回共享响应的协程任务
+     */
+    Task<SharedResponse> processUploadShared(UploadedPart& part, const CancellationToken& token = CancellationToken());
+
+    /**
+     * @brief 分析一个上传文件的取证信息并返回序列化后的响应，方式同processUploadShared
+     * @param part 上传的文件
+     * @param token 取消令牌
+     * @return 返回共享响应的协程任务
+     */
+    Task<SharedResponse> analyzeUploadShared(UploadedPart& part, const CancellationToken& token = CancellationToken());
 
     /**
      * @brief 验证上传的文件
@@ -48,13 +150,70 @@ public:
      */
     bool validateImage(const std::filesystem::path& imagePath);
 
-private:
     /**
-     * @brief 异步处理图像
+     * @brief 验证内存中的图像数据
+     * @param data 图像数据
+     * @param filename 文件名
+     * @return 是否是有效的图像数据
+     */
+    bool validateImageBuffer(std::span<const unsigned char> data, const std::string& filename);
+
+    /**
+     * @brief 检查文件扩展名是否为支持的图像格式
      * @param imagePath 图像路径
-     * @return 异步任务
+     * @return 是否支持
+     */
+    static bool isSupportedFormat(const std::filesystem::path& imagePath);
+
+    /**
+     * @brief 检查结果是否属于缓存键所在的命名空间，校验从其他实例收到的条目
+     *
+     * 键必须由当前版本的makeCacheKey生成，结果必须是对应操作的成功结果。
+     * @param cacheKey 缓存键
+     * @param result 解码后的结果
+     * @return 是否匹配
+     */
+    static bool matchesCacheKey(const std::string& cacheKey, const json& result);
+
+private:
+    /**
+     * @brief 处理批量读取得到的文件内容
+     * @param readResult 读取结果
+     * @param token 取消令牌
+     * @return JSON格式的元数据
+     */
+    json processReadResult(FileReadResult&& readResult, const CancellationToken& token);
+
+    /**
+     * @brief 查缓存，未命中时通过请求合并表执行计算，编码结果并写入缓存
+     * @param cacheKey 缓存键，同时作为合并键
+     * @param token 当前请求的取消令牌
+     * @param compute 计算函数
+     * @return 返回共享响应的协程任务
+     */
+    Task<SharedResponse> runShared(const std::string& cacheKey, const CancellationToken& token,
+                                   const std::function<json()>& compute);
+
+    /**
+     * @brief 获取上传文件的内容，已落盘时从临时文件读回
+     * @param part 上传的文件
+     * @return 文件内容
+     * @throws ImageForensicsException 临时文件读取失败时抛出
+     */
+    static std::span<const unsigned char> readUpload(UploadedPart& part);
+
+    /**
+     * @brief 生成结果缓存的键：操作、提取器和规则版本、哈希算法以及内容哈希
+     * @param operation 操作名称
+     * @param contentHash 内容哈希
+     * @return 缓存键
      */
-    std::future<json> processImageAsync(const std::filesystem::path& imagePath);
+    static std::string makeCacheKey(const std::string& operation, const std::string& contentHash);
+
+    FileCache* resultCache;
+    PeerCache* peerCache;
+    ThreadPool* workerPool;
+    SingleFlight<SharedResponse> inflightRequests;
 };
 
 } // namespace ImageForensics 
\ No newline at end of file
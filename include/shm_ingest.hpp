@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "async.hpp"
+
+namespace ImageForensics {
+
+/**
+ * @brief 共享内存提交接口的操作
+ */
+enum class IngestOperation : uint8_t {
+    Metadata = 1,   ///< 同POST /metadata
+    Forensics = 2   ///< 同POST /forensics
+};
+
+/**
+ * @brief 结果的编码
+ */
+enum class IngestFormat : uint8_t {
+    Json = 0,
+    Cbor = 1
+};
+
+/**
+ * @brief 客户端通过控制通道发送的提交描述符
+ *
+ * 提交后槽位归服务端所有，直到对应的完成项出现在完成环中。
+ */
+struct IngestSubmission {
+    uint64_t userData = 0;                             ///< 调用方自定义的值，原样出现在完成项中
+    uint32_t slot = 0;                                 ///< 图像所在的槽位
+    uint32_t length = 0;                               ///< 图像大小（字节）
+    IngestOperation operation = IngestOperation::Metadata;
+    IngestFormat format = IngestFormat::Json;
+    uint8_t reserved[6] = {};
+};
+static_assert(sizeof(IngestSubmission) == 24);
+
+/**
+ * @brief 完成环中的一项，结果写回提交时使用的槽位
+ */
+struct IngestCompletion {
+    uint64_t userData = 0;  ///< 提交时的userData
+    uint32_t slot = 0;      ///< 槽位，其中保存结果
+    uint32_t length = 0;    ///< 结果大小（字节）
+    uint32_t status = 0;    ///< 与HTTP接口相同的状态码
+    uint32_t reserved = 0;
+};
+static_assert(sizeof(IngestCompletion) == 24);
+
+/**
+ * @brief 共享内存区域开头的布局信息，由服务端初始化
+ *
+ * 区域依次为：本结构（占一页）、完成环、槽位。完成环只有服务端写入、客户端读取，
+ * 头尾位置各占一个缓存行。在同一主机的进程之间共享的std::atomic必须是无锁的。
+ */
+struct IngestRingHeader {
+    static constexpr uint32_t MAGIC = 0x52534649;  ///< "IFSR"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t slotCount = 0;
+    uint32_t slotSize = 0;
+    uint32_t completionCapacity = 0;  ///< 2的幂，不小于slotCount；客户端不及时读取时服务端不再追加
+    uint32_t reserved = 0;
+    uint64_t completionsOffset = 0;
+    uint64_t slotsOffset = 0;
+    uint64_t totalSize = 0;
+    alignas(64) std::atomic<uint32_t> completionHead{0};  ///< 服务端写入的下一个位置
+    alignas(64) std::atomic<uint32_t> completionTail{0};  ///< 客户端读取的下一个位置
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+/**
+ * @brief 共享内存提交接口的参数
+ */
+struct SharedMemoryIngestOptions {
+    std::filesystem::path socketPath;                                      ///< 控制通道的Unix域套接字路径，为空时不启用
+    std::filesystem::perms socketPerms = std::filesystem::perms(0660);     ///< 套接字文件的权限
+    uint32_t slotCount = 32;                                               ///< 每个连接的槽位数量，即最多同时处理的图像数
+    uint32_t slotSize = 8 * 1024 * 1024;                                   ///< 槽位大小，同时是图像和结果的大小上限
+    size_t maxSessions = 16;                                               ///< 同时连接的客户端数量上限
+
+    /**
+     * @brief 从配置读取参数（ingest.*），未配置的项使用默认值
+     * @return 参数
+     */
+    static SharedMemoryIngestOptions fromConfig();
+};
+
+/**
+ * @brief 同一主机上的生产者通过共享内存提交图像，省去套接字缓冲区的两次复制
+ *
+ * 每个客户端连接到控制通道（SOCK_SEQPACKET的Unix域套接字）后，服务端为它创建一块memfd共享内存，
+ * 封住大小（客户端无法缩小区域使服务端访问时收到SIGBUS），通过SCM_RIGHTS把文件描述符交给客户端。
+ * 客户端把图像写入空闲槽位，经控制通道发送IngestSubmission；服务端在工作线程池上把图像从槽位复制到
+ * 自己的内存后解析，结果写回同一槽位，在完成环中追加IngestCompletion，并在控制通道上写一个字节用于唤醒等待的客户端。
+ *
+ * 客户端在处理期间改写槽位不会影响解析，但共享的区域头和完成环仍可被客户端改写，
+ * 因此只面向受信任的本机生产者，由套接字文件的权限控制访问。
+ */
+class SharedMemoryIngestServer {
+public:
+    /**
+     * @brief 一次提交的处理结果
+     */
+    struct Result {
+        uint32_t status = 200;  ///< 状态码
+        std::string body;       ///< 结果内容
+    };
+
+    /**
+     * @brief 处理函数，在工作线程池上调用，data是从槽位复制出的图像，在返回的任务完成前有效；
+     * 任务挂起时不占用工作线程，完成后由恢复它的线程写回结果
+     */
+    using Handler = std::function<Task<Result>(IngestOperation, IngestFormat, std::span<const unsigned char> data)>;
+
+    /**
+     * @brief 构造函数
+     * @param options 参数
+     * @param pool 执行处理函数的线程池
+     * @param handler 处理函数
+     */
+    SharedMemoryIngestServer(SharedMemoryIngestOptions options, ThreadPool& pool, Handler handler);
+
+    /**
+     * @brief 析构函数，停止接收连接
+     */
+    ~SharedMemoryIngestServer();
+
+    SharedMemoryIngestServer(const SharedMemoryIngestServer&) = delete;
+    SharedMemoryIngestServer& operator=(const SharedMemoryIngestServer&) = delete;
+
+    /**
+     * @brief 开始监听控制通道
+     * @throws ImageForensicsException 套接字无法创建或绑定时抛出
+     */
+    void start();
+
+    /**
+     * @brief 停止接收连接并断开所有客户端；已经在处理中的提交仍会完成
+     */
+    void stop();
+
+    /**
+     * @brief 获取当前连接的客户端数量
+     * @return 客户端数量
+     */
+    size_t sessionCount() const;
+
+private:
+    struct Session;
+
+    void acceptLoop();
+    void serveSession(std::shared_ptr<Session> session);
+    static DetachedTask processSubmission(std::shared_ptr<Session> session, IngestSubmission submission,
+                                          std::shared_ptr<const Handler> handler);
+    std::shared_ptr<Session> createSession(int fd);
+
+    SharedMemoryIngestOptions options;
+    ThreadPool& pool;
+    std::shared_ptr<const Handler> handler;  ///< 处理中的任务持有一份，服务端对象可以先于任务销毁
+
+    int listenFd = -1;
+    std::atomic<bool> running{false};
+    std::thread acceptThread;
+    mutable std::mutex sessionsMutex;
+    std::condition_variable sessionsDone;
+    std::vector<std::weak_ptr<Session>> sessions;
+    size_t activeSessions = 0;
+};
+
+/**
+ * @brief 共享内存提交接口的客户端
+ *
+ * 同一个客户端对象不能被多个线程同时使用。
+ */
+class SharedMemoryIngestClient {
+public:
+    /**
+     * @brief 连接到服务端并映射共享内存
+     * @param socketPath 控制通道路径
+     * @throws ImageForensicsException 连接失败或共享内存布局无效时抛出
+     */
+    explicit SharedMemoryIngestClient(const std::filesystem::path& socketPath);
+
+    /**
+     * @brief 析构函数，断开连接并解除映射
+     */
+    ~SharedMemoryIngestClient();
+
+    SharedMemoryIngestClient(const SharedMemoryIngestClient&) = delete;
+    SharedMemoryIngestClient& operator=(const SharedMemoryIngestClient&) = delete;
+
+    /**
+     * @brief 获取槽位数量
+     * @return 槽位数量
+     */
+    uint32_t slotCount() const { return header->slotCount; }
+
+    /**
+     * @brief 获取槽位大小
+     * @return 槽位大小（字节）
+     */
+    uint32_t slotSize() const { return header->slotSize; }
+
+    /**
+     * @brief 获取槽位的内存，提交前把图像写入其中
+     * @param index 槽位
+     * @return 槽位内存
+     */
+    std::span<unsigned char> slot(uint32_t index);
+
+    /**
+     * @brief 提交一个槽位中的图像
+     * @param submission 描述符
+     * @return 控制通道写入失败时返回false
+     */
+    bool submit(const IngestSubmission& submission);
+
+    /**
+     * @brief 不等待地取出一个完成项
+     * @return 完成项，没有时返回std::nullopt
+     */
+    std::optional<IngestCompletion> poll();
+
+    /**
+     * @brief 等待一个完成项
+     * @param timeout 超时时间
+     * @return 完成项，超时或连接断开时返回std::nullopt
+     */
+    std::optional<IngestCompletion> wait(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief 获取完成项的结果内容，槽位被再次提交之前有效
+     * @param completion 完成项
+     * @return 结果内容
+     */
+    std::span<const unsigned char> result(const IngestCompletion& completion) const;
+
+private:
+    int fd = -1;
+    unsigned char* base = nullptr;
+    size_t size = 0;
+    IngestRingHeader* header = nullptr;
+    IngestCompletion* completions = nullptr;
+};
+
+} // namespace ImageForensics
@@ -3,38 +3,119 @@
 #include <nlohmann/json.hpp>
 #include <filesystem>
 #include <string>
+#include <string_view>
 #include <optional>
 #include <chrono>
-#include <unordered_map>
+#include <memory>
+#include <functional>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "cache.hpp"
+#include "compression.hpp"
+#include "result_store.hpp"
 
 namespace ImageForensics {
 
 using json = nlohmann::json;
 
 /**
- * @brief 文件缓存类，负责管理上传的文件和结果缓存
+ * @brief 预先编码的响应：JSON和CBOR两种编码的最终字节以及各自的强ETag，命中时解压后直接发送
+ *
+ * 两种编码都经过EntryCodec压缩保存，同样的内存预算可以容纳更多条目。
+ */
+struct CachedResponse {
+    std::string jsonBody;  ///< EntryCodec编码后的JSON
+    std::string cborBody;  ///< EntryCodec编码后的CBOR，同时是持久化存储中保存的内容
+    std::string jsonETag;  ///< 带引号的强ETag，结果不可缓存时为空
+    std::string cborETag;
+    size_t jsonSize = 0;   ///< 解压后JSON的大小
+    size_t cborSize = 0;   ///< 解压后CBOR的大小
+
+    /**
+     * @brief 解压JSON编码
+     * @return JSON文本
+     * @throws ImageForensicsException 条目无法解码时抛出
+     */
+    std::string decodeJson() const;
+
+    /**
+     * @brief 解压CBOR编码
+     * @return CBOR字节
+     * @throws ImageForensicsException 条目无法解码时抛出
+     */
+    std::string decodeCbor() const;
+
+    /**
+     * @brief 获取按内容编码压缩的响应体
+     *
+     * 每种形式只在第一次被请求时压缩，之后随条目一起留在内存缓存中，热点响应不会重复压缩。
+     * 压缩后的形式在写入缓存之后才产生，需要通过FileCache::compressedResponse获取才会计入内存缓存的字节预算。
+     * @param cbor 是否为CBOR编码
+     * @param encoding 内容编码，Gzip或Zstd
+     * @return 压缩后的响应体，压缩失败时返回nullptr
+     * @throws ImageForensicsException 条目无法解码时抛出
+     */
+    std::shared_ptr<const std::string> compressed(bool cbor, ContentEncoding encoding) const;
+
+    /**
+     * @brief 获取已产生的压缩形式的总字节数
+     * @return 字节数
+     */
+    size_t compressedBytes() const;
+
+    /**
+     * @brief 已压缩的响应体，按[是否CBOR][Gzip/Zstd]保存
+     */
+    struct CompressedForms {
+        std::mutex mutex;
+        std::shared_ptr<const std::string> bodies[2][2];
+        size_t bytes = 0;      ///< 各压缩形式的总字节数
+        std::string cacheKey;  ///< 条目在内存缓存中的键，未写入缓存时为空
+    };
+    std::shared_ptr<CompressedForms> compressedForms = std::make_shared<CompressedForms>();
+};
+
+using SharedResponse = std::shared_ptr<const CachedResponse>;
+
+/**
+ * @brief 编码处理结果
+ * @param result 处理结果
+ * @param withETag 是否按编码后的字节生成强ETag，不缓存的结果不带ETag
+ * @return 共享的响应
+ */
+SharedResponse makeCachedResponse(const json& result, bool withETag = false);
+
+/**
+ * @brief 文件缓存类，负责管理结果缓存
+ *
+ * 编码后的响应保存在内存缓存中，启用持久化后同时写入缓存目录下的结果存储。
+ * 后台清理线程定期删除过期的内存结果和缓存目录中遗留的上传临时文件，并让结果存储回到字节上限以内，
+ * 构造函数不扫描目录。
  */
 class FileCache {
 public:
     /**
      * @brief 构造函数
      * @param cachePath 缓存目录路径
-     * @param maxCacheSize 最大缓存大小（字节）
      * @param maxCacheAge 最大缓存时间（秒）
+     * @param memoryMaxSize 内存结果缓存的最大大小（字节）
+     * @param shardCount 内存结果缓存的分片数量，为0时按硬件并发数选择
+     * @param janitorInterval 后台清理的间隔
      */
     FileCache(const std::filesystem::path& cachePath, 
-              size_t maxCacheSize = 1024 * 1024 * 100, // 100MB
-              std::chrono::seconds maxCacheAge = std::chrono::hours(24));
+              std::chrono::seconds maxCacheAge = std::chrono::hours(24),
+              size_t memoryMaxSize = 1024 * 1024 * 64, // 64MB
+              size_t shardCount = 0,
+              std::chrono::seconds janitorInterval = std::chrono::seconds(60));
 
     /**
-     * @brief 保存上传的文件
-     * @param tempPath 临时文件路径
-     * @param filename 原始文件名
-     * @return 缓存文件路径
+     * @brief 析构函数，停止后台清理
      */
-    std::filesystem::path saveUploadedFile(const std::filesystem::path& tempPath, 
-                                          const std::string& filename);
+    ~FileCache();
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
 
     /**
      * @brief 缓存元数据结果
@@ -51,26 +132,90 @@ public:
     std::optional<json> getCachedMetadata(const std::filesystem::path& imagePath);
 
     /**
-     * @brief 清理过期缓存
+     * @brief 按内容键缓存编码后的响应
+     * @param key 缓存键，通常由内容哈希和提取器版本组成
+     * @param response 编码后的响应
      */
-    void cleanupCache();
+    void cacheResponse(const std::string& key, SharedResponse response);
+
+    /**
+     * @brief 按内容键获取缓存的响应，返回共享的只读响应而不复制
+     * @param key 缓存键
+     * @return 缓存的响应，如果不存在或已过期则返回nullptr
+     */
+    SharedResponse getCachedResponse(const std::string& key);
+
+    /**
+     * @brief 缓存从其他实例收到的条目
+     * @param key 缓存键
+     * @param entry EntryCodec编码后的CBOR（即CachedResponse::cborBody）
+     * @param accept 校验解码后的结果，返回false时不缓存；为空时不校验
+     * @return 缓存的响应，条目无法解码或未通过校验时返回nullptr
+     */
+    SharedResponse cacheEncodedResult(const std::string& key, std::string_view entry,
+                                      const std::function<bool(const json&)>& accept = {});
+
+    /**
+     * @brief 获取按内容编码压缩的响应体，新产生的压缩形式计入该响应所在缓存条目的字节数
+     * @param response 缓存的响应
+     * @param cbor 是否为CBOR编码
+     * @param encoding 内容编码，Gzip或Zstd
+     * @return 压缩后的响应体，压缩失败时返回nullptr
+     * @throws ImageForensicsException 条目无法解码时抛出
+     */
+    std::shared_ptr<const std::string> compressedResponse(const SharedResponse& response, bool cbor,
+                                                          ContentEncoding encoding);
+
+    /**
+     * @brief 启用持久化结果存储，作为内存缓存的下一层；内存未命中时从磁盘读取并回填
+     * @param options 存储参数
+     * @return 存储打开失败时返回false，此时只使用内存缓存
+     */
+    bool enablePersistence(const ResultStoreOptions& options);
+
+    /**
+     * @brief 执行一轮清理，删除过期的内存结果和遗留的上传临时文件，结果存储超出字节上限时删除最旧的段，
+     *        通常由后台清理线程调用
+     * @return 删除的结果数量
+     */
+    size_t cleanupCache();
+
+    /**
+     * @brief 删除缓存目录中超过指定时间未修改的上传临时文件
+     *
+     * 进程在请求处理中途退出时UploadedPart来不及删除落盘的临时文件，由清理线程按修改时间回收。
+     * @param maxAge 临时文件的最长保留时间
+     * @return 删除的文件数量
+     */
+    size_t removeStaleUploads(std::chrono::seconds maxAge = STALE_UPLOAD_AGE);
+
+    static constexpr std::chrono::seconds STALE_UPLOAD_AGE = std::chrono::hours(1);  ///< 上传临时文件的默认保留时间
+
+    /**
+     * @brief 获取内存结果缓存已占用的字节数（仅供监控使用）
+     * @return 字节数
+     */
+    size_t memoryBytes() const;
+
+    /**
+     * @brief 把持久化结果存储同步到磁盘，关闭服务前调用
+     */
+    void flush();
 
 private:
     std::filesystem::path cachePath;
-    size_t maxCacheSize;
-    std::chrono::seconds maxCacheAge;
+    std::chrono::seconds janitorInterval;
     
-    std::unordered_map<std::string, json> metadataCache;
-    std::unordered_map<std::string, std::chrono::system_clock::time_point> cacheTimestamps;
+    ShardedCache<CachedResponse> responseCache;
+    std::unique_ptr<ResultStore> resultStore;
     
-    std::mutex cacheMutex;
+    std::thread janitorThread;
+    std::mutex janitorMutex;
+    std::condition_variable janitorCondition;
+    bool stopping = false;
     
-    /**
-     * @brief 生成唯一的缓存文件名
-     * @param originalFilename 原始文件名
-     * @return 唯一的缓存文件名
-     */
-    std::string generateUniqueName(const std::string& originalFilename);
+    void janitorLoop();
+    void storeInMemory(const std::string& key, const SharedResponse& response);
 };
 
 } // namespace ImageForensics 
\ No newline at end of file
@@ -3,8 +3,22 @@
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <string_view>
 #include <filesystem>
 #include <optional>
+#include <span>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#ifdef IMAGE_FORENSICS_HAVE_XXHASH
+struct XXH3_state_s;
+#endif
 
 namespace ImageForensics {
 
@@ -19,9 +33,11 @@ public:
      * @brief 初始化日志系统
      * @param logLevel 日志级别
      * @param logFile 日志文件路径，如果为空则输出到控制台
+     * @param consoleToStderr 控制台日志是否写到stderr，供需要独占stdout的命令行工具使用
      */
     static void init(spdlog::level::level_enum logLevel = spdlog::level::info,
-                    const std::optional<std::string>& logFile = std::nullopt);
+                    const std::optional<std::string>& logFile = std::nullopt,
+                    bool consoleToStderr = false);
 
     /**
      * @brief 获取日志实例
@@ -33,8 +49,32 @@ private:
     static std::shared_ptr<spdlog::logger> logger;
 };
 
+/**
+ * @brief 默认的像素数上限，超过时视为解压炸弹
+ */
+constexpr uint64_t DEFAULT_MAX_PIXELS = 178956970;
+
+/**
+ * @brief 请求处理路径上使用的设置，随配置重新加载而更新，读取时不查找键也不加锁
+ */
+struct RuntimeSettings {
+    std::chrono::seconds requestTimeout{30};       ///< server.timeout
+    uint64_t maxFileSize = 50 * 1024 * 1024;       ///< metadata.max_file_size
+    uint64_t maxPixels = DEFAULT_MAX_PIXELS;       ///< metadata.max_pixels
+    uint64_t metadataWindow = 256 * 1024;          ///< io.metadata_window
+    unsigned ioQueueDepth = 64;                    ///< io.queue_depth
+    size_t ioBufferSize = 256 * 1024;              ///< io.buffer_size
+};
+
 /**
  * @brief 配置管理类
+ *
+ * 配置保存在不可变的快照中，加载、重新加载和set都构建新的快照，在写锁内替换当前快照并递增版本号。
+ * 每个线程缓存自己最近读取的快照：读取方只加载一次版本号并与缓存的版本比较，版本未变时直接读取
+ * 线程自己的快照，不加锁也不修改共享的引用计数；版本变化后第一次读取时才在写锁内换成新的快照。
+ * 被替换的快照在最后一个缓存它的线程换掉或退出后回收，因此同时存活的快照不超过线程数，
+ * 反复set或重新加载不会使内存增长。
+ * 键用'.'分隔层级，例如"server.port"对应{"server": {"port": ...}}；顶层存在完整的键时优先使用。
  */
 class Config {
 public:
@@ -45,6 +85,26 @@ public:
      */
     static bool load(const std::filesystem::path& configPath);
 
+    /**
+     * @brief 重新读取加载时的配置文件，解析失败时保留当前配置
+     * @return 是否成功重新加载
+     */
+    static bool reload();
+
+    /**
+     * @brief 配置文件的修改时间与上次加载时不同时重新加载
+     * @return 重新加载成功返回true，文件未修改或加载失败返回false
+     */
+    static bool reloadIfChanged();
+
+    /**
+     * @brief 获取当前快照中的运行设置
+     * @return 运行设置的副本，之后的重新加载不影响它
+     */
+    static RuntimeSettings settings() {
+        return snapshot().settings;
+    }
+
     /**
      * @brief 获取配置值
      * @param key 配置键
@@ -55,7 +115,7 @@ public:
     static T get(const std::string& key, const T& defaultValue);
 
     /**
-     * @brief 设置配置值
+     * @brief 设置配置值，中间层级不存在时创建
      * @param key 配置键
      * @param value 配置值
      */
@@ -70,8 +130,39 @@ public:
     static bool save(const std::optional<std::filesystem::path>& configPath = std::nullopt);
 
 private:
-    static json configData;
+    struct Snapshot {
+        json data;
+        RuntimeSettings settings;
+    };
+
+    // 线程缓存的快照，version为0表示尚未读取
+    struct LocalSnapshot {
+        uint64_t version = 0;
+        std::shared_ptr<const Snapshot> snapshot;
+    };
+
+    static const Snapshot& snapshot() {
+        if (local.version != version.load(std::memory_order_acquire)) {
+            refreshLocal();
+        }
+        return *local.snapshot;
+    }
+    static void refreshLocal();
+
+    template<typename T>
+    static T lookup(const json& data, const std::string& key, const T& defaultValue);
+    static const json* find(const json& data, const std::string& key);
+    static void assign(json& data, const std::string& key, json value);
+    static void update(const std::function<void(json&)>& change);
+    static void publish(json data);
+    static void publishLocked(json data);
+
+    static std::shared_ptr<const Snapshot> current;  ///< 受writeMutex保护，加载配置之前是空配置
+    static std::atomic<uint64_t> version;            ///< 当前快照的版本号，每次发布递增
+    static thread_local LocalSnapshot local;
+    static std::mutex writeMutex;                    ///< 串行化写入方，保护current
     static std::filesystem::path currentConfigPath;
+    static std::filesystem::file_time_type loadedWriteTime;
 };
 
 /**
@@ -93,12 +184,104 @@ public:
  */
 std::string detectMimeType(const std::filesystem::path& filePath);
 
+/**
+ * @brief 根据内存中的文件头检测文件类型
+ * @param header 文件头部数据（至少12字节可完整识别所有格式）
+ * @param filenameHint 文件名，签名无法识别时按扩展名判断
+ * @return 文件MIME类型
+ */
+std::string detectMimeType(std::span<const unsigned char> header,
+                           const std::filesystem::path& filenameHint = {});
+
+/**
+ * @brief 获取图像MIME类型对应的文件扩展名
+ * @param mimeType MIME类型，可以带参数
+ * @return 带点的扩展名，例如".jpg"；不是支持的图像格式时返回空字符串
+ */
+std::string extensionForMimeType(std::string_view mimeType);
+
 /**
  * @brief 生成UUID
  * @return UUID字符串
  */
 std::string generateUuid();
 
+/**
+ * @brief 增量计算的128位内容哈希，用于按图像内容识别重复请求和缓存结果
+ *
+ * 找到libxxhash时使用向量化的XXH3-128，否则使用MurmurHash3 x64 128。
+ * 两种算法的结果不同，持久化的键需要带上algorithm()以免混用。
+ */
+class ContentHasher {
+public:
+    /**
+     * @brief 构造函数
+     */
+    ContentHasher();
+
+    /**
+     * @brief 析构函数
+     */
+    ~ContentHasher();
+
+    ContentHasher(const ContentHasher&) = delete;
+    ContentHasher& operator=(const ContentHasher&) = delete;
+
+    /**
+     * @brief 追加数据
+     * @param data 数据块
+     */
+    void update(std::span<const unsigned char> data);
+
+    /**
+     * @brief 获取当前已追加数据的哈希值
+     * @return 32个字符的十六进制哈希字符串
+     */
+    std::string hexDigest() const;
+
+    /**
+     * @brief 获取使用的哈希算法名称
+     * @return 算法名称，例如"xxh3-128"或"mmh3-128"
+     */
+    static const char* algorithm();
+
+private:
+#ifdef IMAGE_FORENSICS_HAVE_XXHASH
+    ::XXH3_state_s* state;
+#else
+    void processBlock(const unsigned char* block);
+
+    uint64_t h1;
+    uint64_t h2;
+    uint64_t totalLength;
+    std::array<unsigned char, 16> tail;
+    size_t tailSize;
+#endif
+};
+
+/**
+ * @brief 计算一段数据的内容哈希
+ * @param data 数据
+ * @return 32个字符的十六进制哈希字符串
+ */
+std::string computeContentHash(std::span<const unsigned char> data);
+
+/**
+ * @brief 读取整个文件
+ * @param filePath 文件路径
+ * @return 文件内容，读取失败时返回std::nullopt
+ */
+std::optional<std::vector<unsigned char>> readFileContents(const std::filesystem::path& filePath);
+
+/**
+ * @brief 读取整个文件，并在读取的同时计算内容哈希
+ * @param filePath 文件路径
+ * @param hasher 哈希器，每读入一块数据即追加
+ * @return 文件内容，读取失败时返回std::nullopt
+ */
+std::optional<std::vector<unsigned char>> readFileContents(const std::filesystem::path& filePath,
+                                                           ContentHasher& hasher);
+
 } // namespace ImageForensics
 
 // 模板函数实现
@@ -106,19 +289,26 @@ namespace ImageForensics {
 
 template<typename T>
 T Config::get(const std::string& key, const T& defaultValue) {
-    try {
-        if (configData.contains(key)) {
-            return configData[key].get<T>();
+    return lookup(snapshot().data, key, defaultValue);
+}
+
+template<typename T>
+T Config::lookup(const json& data, const std::string& key, const T& defaultValue) {
+    const json* value = find(data, key);
+    if (value) {
+        try {
+            return value->get<T>();
+        } catch (const std::exception& e) {
+            Logger::get()->warn("Failed to get config value for key '{}': {}", key, e.what());
         }
-    } catch (const std::exception& e) {
-        Logger::get()->warn("Failed to get config value for key '{}': {}", key, e.what());
     }
     return defaultValue;
 }
 
 template<typename T>
 void Config::set(const std::string& key, const T& value) {
-    configData[key] = value;
+    json converted = value;
+    update([&](json& data) { assign(data, key, std::move(converted)); });
 }
 
 } // namespace ImageForensics 
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "async.hpp"
+#include "util.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+
+namespace ImageForensics {
+
+namespace {
+
+const char* cancelReasonMessage(CancelReason reason) {
+    switch (reason) {
+        case CancelReason::DeadlineExceeded: return "Operation deadline exceeded";
+        case CancelReason::ClientDisconnected: return "Client disconnected";
+        default: return "Operation cancelled";
+    }
+}
+
+} // namespace
+
+OperationCancelled::OperationCancelled(CancelReason reason)
+    : std::runtime_error(cancelReasonMessage(reason)), cancelReason(reason) {
+}
+
+CancellationToken::CancellationToken()
+    : state(std::make_shared<State>()) {
+}
+
+CancellationToken CancellationToken::withTimeout(std::chrono::milliseconds timeout) {
+    CancellationToken token;
+    token.state->deadline = Clock::now() + timeout;
+    return token;
+}
+
+void CancellationToken::setAliveProbe(std::function<bool()> probe) {
+    state->aliveProbe = std::move(probe);
+}
+
+void CancellationToken::cancel() {
+    state->cancelled.store(true, std::memory_order_release);
+}
+
+CancelReason CancellationToken::check() const {
+    if (state->cancelled.load(std::memory_order_acquire)) {
+        return CancelReason::Cancelled;
+    }
+    if (state->deadline && Clock::now() >= *state->deadline) {
+        return CancelReason::DeadlineExceeded;
+    }
+    if (state->aliveProbe && !state->aliveProbe()) {
+        return CancelReason::ClientDisconnected;
+    }
+    return CancelReason::None;
+}
+
+void CancellationToken::throwIfCancelled() const {
+    auto reason = check();
+    if (reason != CancelReason::None) {
+        throw OperationCancelled(reason);
+    }
+}
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    Logger::get()->info("Starting worker pool with {} threads", threads);
+
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+void ThreadPool::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping) {
+            throw ImageForensicsException("Worker pool is shutting down");
+        }
+        tasks.push_back(std::move(task));
+    }
+    queueCondition.notify_one();
+}
+
+size_t ThreadPool::queueDepth() const {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return tasks.size();
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+void ThreadPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    queueCondition.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    Logger::get()->info("Worker pool stopped");
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+            // 停止后仍然执行完队列中剩余的任务
+            if (tasks.empty()) {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+            Logger::get()->error("Unhandled exception in worker task: {}", e.what());
+        } catch (...) {
+            Logger::get()->error("Unhandled unknown exception in worker task");
+        }
+    }
+}
+
+void DetachedTask::promise_type::unhandled_exception() noexcept {
+    try {
+        throw;
+    } catch (const std::exception& e) {
+        Logger::get()->error("Unhandled exception in async handler: {}", e.what());
+    } catch (...) {
+        Logger::get()->error("Unhandled unknown exception in async handler");
+    }
+}
+
+} // namespace ImageForensics
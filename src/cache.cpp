@@ -0,0 +1,73 @@
+#include "cache.hpp"
+
+namespace ImageForensics {
+
+namespace {
+
+constexpr uint64_t ROW_SEEDS[] = {
+    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL
+};
+
+} // namespace
+
+FrequencySketch::FrequencySketch(size_t expectedEntries) {
+    size_t width = std::bit_ceil(std::clamp<size_t>(expectedEntries, 1024, size_t(1) << 24));
+    widthMask = width - 1;
+    // 采样上限为宽度的10倍，与W-TinyLFU论文的取值一致
+    sampleSize = width * 10;
+    words = std::make_unique<std::atomic<uint64_t>[]>(width * ROWS / COUNTERS_PER_WORD);
+}
+
+size_t FrequencySketch::indexOf(uint64_t hash, size_t row) const {
+    uint64_t h = (hash + ROW_SEEDS[row]) * ROW_SEEDS[(row + 1) % ROWS];
+    h ^= h >> 32;
+    return row * (widthMask + 1) + (h & widthMask);
+}
+
+void FrequencySketch::increment(uint64_t hash) {
+    bool added = false;
+    for (size_t row = 0; row < ROWS; ++row) {
+        size_t index = indexOf(hash, row);
+        auto& word = words[index / COUNTERS_PER_WORD];
+        unsigned shift = (index % COUNTERS_PER_WORD) * 4;
+        uint64_t value = word.load(std::memory_order_relaxed);
+        while (((value >> shift) & MAX_COUNT) < MAX_COUNT &&
+               !word.compare_exchange_weak(value, value + (uint64_t(1) << shift), std::memory_order_relaxed)) {
+        }
+        added |= ((value >> shift) & MAX_COUNT) < MAX_COUNT;
+    }
+
+    if (added && additions.fetch_add(1, std::memory_order_relaxed) + 1 >= sampleSize) {
+        halve();
+    }
+}
+
+unsigned FrequencySketch::estimate(uint64_t hash) const {
+    unsigned result = MAX_COUNT;
+    for (size_t row = 0; row < ROWS; ++row) {
+        size_t index = indexOf(hash, row);
+        uint64_t word = words[index / COUNTERS_PER_WORD].load(std::memory_order_relaxed);
+        result = std::min<unsigned>(result, (word >> ((index % COUNTERS_PER_WORD) * 4)) & MAX_COUNT);
+    }
+    return result;
+}
+
+void FrequencySketch::halve() {
+    // 只需一个线程执行衰减，其他线程继续计数
+    std::unique_lock<std::mutex> lock(resetMutex, std::try_to_lock);
+    if (!lock.owns_lock() || additions.load(std::memory_order_relaxed) < sampleSize) {
+        return;
+    }
+
+    // 整字右移一位后清除从相邻计数器移入的最高位
+    size_t total = (widthMask + 1) * ROWS / COUNTERS_PER_WORD;
+    for (size_t i = 0; i < total; ++i) {
+        uint64_t value = words[i].load(std::memory_order_relaxed);
+        while (!words[i].compare_exchange_weak(value, (value >> 1) & 0x7777777777777777ULL,
+                                               std::memory_order_relaxed)) {
+        }
+    }
+    additions.store(additions.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+}
+
+} // namespace ImageForensics
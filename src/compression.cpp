@@ -0,0 +1,455 @@
+#include "compression.hpp"
+#include "util.hpp"
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+#include <atomic>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+namespace ImageForensics {
+
+namespace {
+
+// 格式标记：0xF0-0xF3在CBOR中是未分配的简单值，JSON也不会以这些字节开头，
+// 因此可以和引入压缩之前写入的裸条目区分
+constexpr uint8_t FORMAT_RAW = 0xF0;
+constexpr uint8_t FORMAT_ZSTD = 0xF1;
+constexpr size_t ZSTD_HEADER_SIZE = 1 + sizeof(uint32_t);
+
+// 解压后的大小上限，用于拒绝损坏的条目
+constexpr unsigned long long MAX_DECODED_SIZE = 256ULL * 1024 * 1024;
+
+std::atomic<bool> compressionEnabled{true};
+std::atomic<int> compressionLevel{3};
+
+std::atomic<bool> responseCompressionEnabled{true};
+std::atomic<size_t> responseMinSize{1024};
+std::atomic<int> responseGzipLevel{6};
+std::atomic<int> responseZstdLevel{3};
+
+std::string_view trimWhitespace(std::string_view text) {
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// 一个Accept-Encoding条目的q值，没有q参数时为1，无法解析时为0
+double qualityOf(std::string_view parameters) {
+    size_t pos = 0;
+    while (pos < parameters.size()) {
+        size_t end = std::min(parameters.find(';', pos), parameters.size());
+        auto parameter = trimWhitespace(parameters.substr(pos, end - pos));
+        pos = end + 1;
+        if (parameter.size() >= 2 && std::tolower(static_cast<unsigned char>(parameter[0])) == 'q' &&
+            parameter[1] == '=') {
+            std::string value(trimWhitespace(parameter.substr(2)));
+            char* parsed = nullptr;
+            double q = std::strtod(value.c_str(), &parsed);
+            if (parsed == value.c_str() || q < 0) {
+                return 0;
+            }
+            return std::min(q, 1.0);
+        }
+    }
+    return 1;
+}
+
+// gzip格式（windowBits加16）的一次性压缩
+std::optional<std::string> gzipCompress(std::string_view data, int level) {
+    z_stream stream{};
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return std::nullopt;
+    }
+
+    std::string output(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    int result = deflate(&stream, Z_FINISH);
+    size_t size = stream.total_out;
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        Logger::get()->warn("Failed to gzip response: zlib error {}", result);
+        return std::nullopt;
+    }
+    output.resize(size);
+    return output;
+}
+
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+
+struct Dictionary {
+    uint32_t id = 0;
+    ZSTD_CDict* compressDict = nullptr;
+    ZSTD_DDict* decompressDict = nullptr;
+
+    ~Dictionary() {
+        ZSTD_freeCDict(compressDict);
+        ZSTD_freeDDict(decompressDict);
+    }
+};
+
+// 字典加载后只读，可以被多个线程同时使用
+struct DictionaryRegistry {
+    std::shared_mutex mutex;
+    std::unordered_map<uint32_t, std::shared_ptr<const Dictionary>> dictionaries;
+    std::shared_ptr<const Dictionary> current;
+};
+
+DictionaryRegistry& registry() {
+    static DictionaryRegistry instance;
+    return instance;
+}
+
+// 压缩和解压上下文不能并发使用，每个线程各持有一份
+struct ThreadContexts {
+    ZSTD_CCtx* compress = ZSTD_createCCtx();
+    ZSTD_DCtx* decompress = ZSTD_createDCtx();
+
+    ~ThreadContexts() {
+        ZSTD_freeCCtx(compress);
+        ZSTD_freeDCtx(decompress);
+    }
+};
+
+ThreadContexts& contexts() {
+    thread_local ThreadContexts instance;
+    return instance;
+}
+
+#endif
+
+} // namespace
+
+bool EntryCodec::available() {
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+void EntryCodec::configure(bool enabled, int level) {
+    compressionEnabled = enabled;
+    compressionLevel = level;
+}
+
+size_t EntryCodec::loadDictionaries(const std::filesystem::path& directory) {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(directory, ec)) {
+        return 0;
+    }
+
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (entry.is_regular_file(ec) && entry.path().extension() == ".dict") {
+            files.emplace_back(entry.last_write_time(ec), entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    size_t loaded = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (loadDictionary(files[i].second, i + 1 == files.size())) {
+            ++loaded;
+        }
+    }
+    return loaded;
+}
+
+std::optional<uint32_t> EntryCodec::loadDictionary(const std::filesystem::path& path, bool makeCurrent) {
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        Logger::get()->warn("Failed to open compression dictionary: {}", path.string());
+        return std::nullopt;
+    }
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // 只接受带ID的zstd字典，条目依靠ID找到对应的字典
+    uint32_t id = dictionaryId(content);
+    if (id == 0) {
+        Logger::get()->warn("Ignoring {}: not a zstd dictionary", path.string());
+        return std::nullopt;
+    }
+
+    auto dictionary = std::make_shared<Dictionary>();
+    dictionary->id = id;
+    dictionary->compressDict = ZSTD_createCDict(content.data(), content.size(), compressionLevel.load());
+    dictionary->decompressDict = ZSTD_createDDict(content.data(), content.size());
+    if (!dictionary->compressDict || !dictionary->decompressDict) {
+        Logger::get()->warn("Failed to load compression dictionary: {}", path.string());
+        return std::nullopt;
+    }
+
+    auto& state = registry();
+    std::unique_lock<std::shared_mutex> lock(state.mutex);
+    state.dictionaries[id] = dictionary;
+    if (makeCurrent) {
+        state.current = dictionary;
+    }
+
+    Logger::get()->info("Loaded compression dictionary {} (id {}, {} bytes){}", path.string(), id, content.size(),
+                        makeCurrent ? ", used for new entries" : "");
+    return id;
+#else
+    (void)makeCurrent;
+    Logger::get()->warn("Ignoring compression dictionary {}: built without zstd support", path.string());
+    return std::nullopt;
+#endif
+}
+
+uint32_t EntryCodec::currentDictionaryId() {
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+    auto& state = registry();
+    std::shared_lock<std::shared_mutex> lock(state.mutex);
+    return state.current ? state.current->id : 0;
+#else
+    return 0;
+#endif
+}
+
+std::string EntryCodec::encode(std::string_view data) {
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+    if (compressionEnabled) {
+        std::shared_ptr<const Dictionary> dictionary;
+        {
+            auto& state = registry();
+            std::shared_lock<std::shared_mutex> lock(state.mutex);
+            dictionary = state.current;
+        }
+
+        uint32_t id = dictionary ? dictionary->id : 0;
+        std::string entry(ZSTD_HEADER_SIZE + ZSTD_compressBound(data.size()), '\0');
+        entry[0] = static_cast<char>(FORMAT_ZSTD);
+        for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+            entry[1 + i] = static_cast<char>((id >> (8 * i)) & 0xff);
+        }
+
+        auto& ctx = contexts();
+        size_t size = dictionary
+            ? ZSTD_compress_usingCDict(ctx.compress, entry.data() + ZSTD_HEADER_SIZE, entry.size() - ZSTD_HEADER_SIZE,
+                                       data.data(), data.size(), dictionary->compressDict)
+            : ZSTD_compressCCtx(ctx.compress, entry.data() + ZSTD_HEADER_SIZE, entry.size() - ZSTD_HEADER_SIZE,
+                                data.data(), data.size(), compressionLevel.load());
+
+        // 很小的条目压缩后可能反而更大，这时保存原始数据
+        if (!ZSTD_isError(size) && size < data.size()) {
+            entry.resize(ZSTD_HEADER_SIZE + size);
+            return entry;
+        }
+        if (ZSTD_isError(size)) {
+            Logger::get()->warn("Failed to compress cache entry: {}", ZSTD_getErrorName(size));
+        }
+    }
+#endif
+
+    std::string entry;
+    entry.reserve(data.size() + 1);
+    entry.push_back(static_cast<char>(FORMAT_RAW));
+    entry.append(data);
+    return entry;
+}
+
+std::optional<std::string> EntryCodec::decode(std::string_view entry) {
+    if (entry.empty()) {
+        return std::string();
+    }
+
+    auto format = static_cast<uint8_t>(entry[0]);
+    if (format == FORMAT_RAW) {
+        return std::string(entry.substr(1));
+    }
+    if (format != FORMAT_ZSTD) {
+        return std::string(entry);
+    }
+
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+    if (entry.size() < ZSTD_HEADER_SIZE) {
+        return std::nullopt;
+    }
+
+    uint32_t id = 0;
+    for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+        id |= static_cast<uint32_t>(static_cast<uint8_t>(entry[1 + i])) << (8 * i);
+    }
+
+    std::shared_ptr<const Dictionary> dictionary;
+    if (id != 0) {
+        auto& state = registry();
+        std::shared_lock<std::shared_mutex> lock(state.mutex);
+        auto it = state.dictionaries.find(id);
+        if (it == state.dictionaries.end()) {
+            Logger::get()->debug("Cache entry needs compression dictionary {}, which is not loaded", id);
+            return std::nullopt;
+        }
+        dictionary = it->second;
+    }
+
+    auto payload = entry.substr(ZSTD_HEADER_SIZE);
+    auto contentSize = ZSTD_getFrameContentSize(payload.data(), payload.size());
+    if (contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize == ZSTD_CONTENTSIZE_UNKNOWN ||
+        contentSize > MAX_DECODED_SIZE) {
+        return std::nullopt;
+    }
+
+    std::string data(static_cast<size_t>(contentSize), '\0');
+    auto& ctx = contexts();
+    size_t size = dictionary
+        ? ZSTD_decompress_usingDDict(ctx.decompress, data.data(), data.size(), payload.data(), payload.size(),
+                                     dictionary->decompressDict)
+        : ZSTD_decompressDCtx(ctx.decompress, data.data(), data.size(), payload.data(), payload.size());
+    if (ZSTD_isError(size) || size != data.size()) {
+        return std::nullopt;
+    }
+    return data;
+#else
+    Logger::get()->debug("Cache entry is zstd-compressed, but built without zstd support");
+    return std::nullopt;
+#endif
+}
+
+uint32_t EntryCodec::dictionaryId(std::string_view dictionary) {
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+    return ZSTD_getDictID_fromDict(dictionary.data(), dictionary.size());
+#else
+    (void)dictionary;
+    return 0;
+#endif
+}
+
+std::optional<std::string> EntryCodec::trainDictionary(const std::vector<std::string>& samples, size_t dictionarySize) {
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+    std::string buffer;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const auto& sample : samples) {
+        buffer += sample;
+        sizes.push_back(sample.size());
+    }
+
+    std::string dictionary(dictionarySize, '\0');
+    size_t size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), buffer.data(), sizes.data(),
+                                        static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(size)) {
+        Logger::get()->error("Failed to train compression dictionary: {}", ZDICT_getErrorName(size));
+        return std::nullopt;
+    }
+    dictionary.resize(size);
+    return dictionary;
+#else
+    (void)samples;
+    (void)dictionarySize;
+    Logger::get()->error("Cannot train compression dictionary: built without zstd support");
+    return std::nullopt;
+#endif
+}
+
+void ResponseEncoder::configure(bool enabled, size_t minSize, int gzipLevel, int zstdLevel) {
+    responseCompressionEnabled = enabled;
+    responseMinSize = minSize;
+    responseGzipLevel = gzipLevel;
+    responseZstdLevel = zstdLevel;
+}
+
+ContentEncoding ResponseEncoder::negotiate(std::string_view acceptEncoding, size_t size) {
+    if (!responseCompressionEnabled || size < responseMinSize) {
+        return ContentEncoding::Identity;
+    }
+
+    // 未出现的编码取"*"的q值，都没有出现时视为不接受
+    double gzip = -1;
+    double zstd = -1;
+    double any = -1;
+    size_t pos = 0;
+    while (pos < acceptEncoding.size()) {
+        size_t end = std::min(acceptEncoding.find(',', pos), acceptEncoding.size());
+        auto item = acceptEncoding.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t semicolon = item.find(';');
+        std::string coding(trimWhitespace(item.substr(0, semicolon)));
+        std::transform(coding.begin(), coding.end(), coding.begin(), ::tolower);
+        double q = semicolon == std::string_view::npos ? 1 : qualityOf(item.substr(semicolon + 1));
+
+        if (coding == "gzip" || coding == "x-gzip") {
+            gzip = std::max(gzip, q);
+        } else if (coding == "zstd") {
+            zstd = std::max(zstd, q);
+        } else if (coding == "*") {
+            any = std::max(any, q);
+        }
+    }
+    if (gzip < 0) {
+        gzip = std::max(any, 0.0);
+    }
+    if (zstd < 0) {
+        zstd = std::max(any, 0.0);
+    }
+#ifndef IMAGE_FORENSICS_HAVE_ZSTD
+    zstd = 0;
+#endif
+
+    if (zstd > 0 && zstd >= gzip) {
+        return ContentEncoding::Zstd;
+    }
+    if (gzip > 0) {
+        return ContentEncoding::Gzip;
+    }
+    return ContentEncoding::Identity;
+}
+
+const char* ResponseEncoder::name(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Gzip:
+            return "gzip";
+        case ContentEncoding::Zstd:
+            return "zstd";
+        default:
+            return "identity";
+    }
+}
+
+std::optional<std::string> ResponseEncoder::compress(std::string_view data, ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Gzip:
+            return gzipCompress(data, responseGzipLevel.load());
+        case ContentEncoding::Zstd: {
+#ifdef IMAGE_FORENSICS_HAVE_ZSTD
+            std::string output(ZSTD_compressBound(data.size()), '\0');
+            size_t size = ZSTD_compressCCtx(contexts().compress, output.data(), output.size(), data.data(), data.size(),
+                                            responseZstdLevel.load());
+            if (ZSTD_isError(size)) {
+                Logger::get()->warn("Failed to zstd-compress response: {}", ZSTD_getErrorName(size));
+                return std::nullopt;
+            }
+            output.resize(size);
+            return output;
+#else
+            return std::nullopt;
+#endif
+        }
+        default:
+            return std::string(data);
+    }
+}
+
+} // namespace ImageForensics
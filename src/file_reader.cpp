@@ -0,0 +1,306 @@
+#include "file_reader.hpp"
+#include "util.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifdef IMAGE_FORENSICS_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace ImageForensics {
+
+namespace {
+
+/**
+ * 打开文件并确定需要读取的字节数，失败时在result中记录errno
+ */
+bool openForRead(const FileReadRequest& request, size_t index, int& fd, uint64_t& want, FileReadResult& result) {
+    result.index = index;
+    result.path = request.path;
+
+    fd = ::open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        result.error = errno;
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        result.error = errno;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    result.fileSize = static_cast<uint64_t>(st.st_size);
+    want = request.maxBytes > 0 ? std::min(request.maxBytes, result.fileSize) : result.fileSize;
+    result.truncated = want < result.fileSize;
+    result.data.reserve(want);
+    return true;
+}
+
+void deliver(const BatchFileReader::CompletionHandler& onComplete, FileReadResult&& result) {
+    try {
+        onComplete(std::move(result));
+    } catch (const std::exception& e) {
+        Logger::get()->error("Error in file read completion handler: {}", e.what());
+    }
+}
+
+} // namespace
+
+struct BatchFileReader::Impl {
+    unsigned queueDepth;
+    size_t bufferSize;
+
+#ifdef IMAGE_FORENSICS_HAVE_LIBURING
+    // 一个在途读请求占用一个槽位和与之对应的注册缓冲区
+    struct ReadSlot {
+        bool active = false;
+        int fd = -1;
+        uint64_t want = 0;
+        uint64_t offset = 0;
+        FileReadResult result;
+    };
+
+    io_uring ring{};
+    bool ringReady = false;
+    bool buffersRegistered = false;
+    std::unique_ptr<unsigned char[]> slab;
+    std::vector<iovec> iovecs;
+    std::vector<ReadSlot> slots;
+
+    void submitChunk(size_t slotIndex) {
+        auto& slot = slots[slotIndex];
+        unsigned length = static_cast<unsigned>(std::min<uint64_t>(bufferSize, slot.want - slot.offset));
+
+        // 在途请求数不超过槽位数，即不超过提交队列深度，这里总能取到sqe
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        if (buffersRegistered) {
+            io_uring_prep_read_fixed(sqe, slot.fd, iovecs[slotIndex].iov_base, length, slot.offset,
+                                     static_cast<int>(slotIndex));
+        } else {
+            io_uring_prep_read(sqe, slot.fd, iovecs[slotIndex].iov_base, length, slot.offset);
+        }
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(slotIndex)));
+    }
+
+    void finish(size_t slotIndex, const CompletionHandler& onComplete, size_t& active) {
+        auto& slot = slots[slotIndex];
+        ::close(slot.fd);
+        slot.fd = -1;
+        slot.active = false;
+        active--;
+        deliver(onComplete, std::move(slot.result));
+    }
+
+    // 提交失败后环的状态不再可信。每个在途槽位恰好有一个读请求：先等内核已经取走的请求全部完成，
+    // 再关闭文件、交付错误并关闭环，之后改用pread。尚未被内核取走的请求随环一起丢弃，
+    // 不会再写入槽位的缓冲区
+    void abandonRing(int error, const CompletionHandler& onComplete, size_t& active) {
+        size_t inKernel = active - std::min<size_t>(active, io_uring_sq_ready(&ring));
+        while (inKernel > 0) {
+            io_uring_cqe* cqe;
+            int ret = io_uring_wait_cqe(&ring, &cqe);
+            if (ret == -EINTR || ret == -EAGAIN) {
+                continue;
+            }
+            if (ret < 0) {
+                // 无法确认在途的读请求已经结束，缓冲区可能仍被写入，不再释放
+                Logger::get()->error("Failed to drain io_uring completions: {}", std::strerror(-ret));
+                static_cast<void>(slab.release());
+                break;
+            }
+            io_uring_cqe_seen(&ring, cqe);
+            inKernel--;
+        }
+
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].active) {
+                slots[i].result.error = error;
+                finish(i, onComplete, active);
+            }
+        }
+
+        io_uring_queue_exit(&ring);
+        ringReady = false;
+    }
+
+    void readWithIoUring(const std::vector<FileReadRequest>& requests, const CompletionHandler& onComplete) {
+        size_t next = 0;
+        size_t active = 0;
+
+        while (next < requests.size() || active > 0) {
+            // 用新文件填满空闲槽位
+            for (size_t i = 0; i < slots.size() && next < requests.size(); ++i) {
+                auto& slot = slots[i];
+                if (slot.active) {
+                    continue;
+                }
+
+                slot.result = FileReadResult{};
+                slot.offset = 0;
+                size_t index = next++;
+                if (!openForRead(requests[index], index, slot.fd, slot.want, slot.result)) {
+                    deliver(onComplete, std::move(slot.result));
+                    continue;
+                }
+
+                slot.active = true;
+                active++;
+                if (slot.want == 0) {
+                    finish(i, onComplete, active);
+                    continue;
+                }
+                submitChunk(i);
+            }
+
+            if (active == 0) {
+                continue;
+            }
+
+            // EINTR：等待被信号打断；EBUSY：完成队列已满，先收取完成项再提交
+            int ret = io_uring_submit_and_wait(&ring, 1);
+            if (ret < 0 && ret != -EINTR && ret != -EBUSY) {
+                Logger::get()->error("io_uring submit failed, falling back to pread: {}", std::strerror(-ret));
+                abandonRing(-ret, onComplete, active);
+                readWithPread(requests, onComplete, next);
+                return;
+            }
+
+            io_uring_cqe* cqe;
+            unsigned head;
+            unsigned seen = 0;
+            io_uring_for_each_cqe(&ring, head, cqe) {
+                seen++;
+                size_t slotIndex = static_cast<size_t>(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+                auto& slot = slots[slotIndex];
+                int res = cqe->res;
+
+                if (res == -EAGAIN || res == -EINTR) {
+                    submitChunk(slotIndex);
+                } else if (res < 0) {
+                    slot.result.error = -res;
+                    finish(slotIndex, onComplete, active);
+                } else if (res == 0) {
+                    // 文件在读取过程中被截断
+                    finish(slotIndex, onComplete, active);
+                } else {
+                    auto* buffer = static_cast<unsigned char*>(iovecs[slotIndex].iov_base);
+                    slot.result.data.insert(slot.result.data.end(), buffer, buffer + res);
+                    slot.offset += static_cast<uint64_t>(res);
+
+                    if (slot.offset >= slot.want) {
+                        finish(slotIndex, onComplete, active);
+                    } else {
+                        submitChunk(slotIndex);
+                    }
+                }
+            }
+            io_uring_cq_advance(&ring, seen);
+        }
+    }
+#endif
+
+    void readWithPread(const std::vector<FileReadRequest>& requests, const CompletionHandler& onComplete,
+                       size_t first = 0) {
+        for (size_t index = first; index < requests.size(); ++index) {
+            FileReadResult result;
+            int fd = -1;
+            uint64_t want = 0;
+
+            if (openForRead(requests[index], index, fd, want, result)) {
+                result.data.resize(want);
+                uint64_t offset = 0;
+
+                while (offset < want) {
+                    ssize_t n = ::pread(fd, result.data.data() + offset, want - offset, static_cast<off_t>(offset));
+                    if (n < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        result.error = errno;
+                        break;
+                    }
+                    if (n == 0) {
+                        break;
+                    }
+                    offset += static_cast<uint64_t>(n);
+                }
+
+                result.data.resize(offset);
+                ::close(fd);
+            }
+
+            deliver(onComplete, std::move(result));
+        }
+    }
+};
+
+BatchFileReader::BatchFileReader(unsigned queueDepth, size_t bufferSize)
+    : impl(std::make_unique<Impl>()) {
+    impl->queueDepth = std::max(1u, queueDepth);
+    impl->bufferSize = std::max<size_t>(4096, bufferSize);
+
+#ifdef IMAGE_FORENSICS_HAVE_LIBURING
+    int ret = io_uring_queue_init(impl->queueDepth, &impl->ring, 0);
+    if (ret < 0) {
+        // 内核过旧或被seccomp禁止时回退到pread
+        Logger::get()->warn("io_uring unavailable ({}), falling back to pread", std::strerror(-ret));
+        return;
+    }
+    impl->ringReady = true;
+
+    impl->slab = std::make_unique<unsigned char[]>(impl->queueDepth * impl->bufferSize);
+    impl->iovecs.resize(impl->queueDepth);
+    impl->slots.resize(impl->queueDepth);
+    for (unsigned i = 0; i < impl->queueDepth; ++i) {
+        impl->iovecs[i].iov_base = impl->slab.get() + i * impl->bufferSize;
+        impl->iovecs[i].iov_len = impl->bufferSize;
+    }
+
+    // 注册缓冲区受RLIMIT_MEMLOCK限制，失败时仍使用普通读请求
+    ret = io_uring_register_buffers(&impl->ring, impl->iovecs.data(), impl->queueDepth);
+    impl->buffersRegistered = ret == 0;
+    if (!impl->buffersRegistered) {
+        Logger::get()->warn("Failed to register io_uring buffers ({}), using unregistered reads", std::strerror(-ret));
+    }
+
+    Logger::get()->debug("Initialized io_uring reader: queue depth {}, buffer size {}",
+                         impl->queueDepth, impl->bufferSize);
+#endif
+}
+
+BatchFileReader::~BatchFileReader() {
+#ifdef IMAGE_FORENSICS_HAVE_LIBURING
+    if (impl->ringReady) {
+        io_uring_queue_exit(&impl->ring);
+    }
+#endif
+}
+
+void BatchFileReader::readAll(const std::vector<FileReadRequest>& requests, const CompletionHandler& onComplete) {
+#ifdef IMAGE_FORENSICS_HAVE_LIBURING
+    if (impl->ringReady) {
+        impl->readWithIoUring(requests, onComplete);
+        return;
+    }
+#endif
+    impl->readWithPread(requests, onComplete);
+}
+
+bool BatchFileReader::usingIoUring() const {
+#ifdef IMAGE_FORENSICS_HAVE_LIBURING
+    return impl->ringReady;
+#else
+    return false;
+#endif
+}
+
+} // namespace ImageForensics
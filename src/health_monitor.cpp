@@ -0,0 +1,63 @@
+#include "health_monitor.hpp"
+#include <cmath>
+#include <sstream>
+
+namespace ImageForensics {
+
+namespace {
+
+void writeMetric(std::ostringstream& out, const std::string& name, const std::string& help,
+                 MetricType type, double value) {
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << ' ' << (type == MetricType::Counter ? "counter" : "gauge") << '\n';
+    out << name << ' ';
+    if (std::isnan(value)) {
+        out << "NaN";
+    } else if (value == std::trunc(value) && std::abs(value) < 1e15) {
+        // 整数值不输出小数部分
+        out << static_cast<long long>(value);
+    } else {
+        out << value;
+    }
+    out << '\n';
+}
+
+} // namespace
+
+HealthMonitor::HealthMonitor() : started(std::chrono::steady_clock::now()) {
+}
+
+void HealthMonitor::addMetric(std::string name, std::string help, MetricType type, Sample sample) {
+    metrics.push_back({std::move(name), std::move(help), type, std::move(sample)});
+}
+
+void HealthMonitor::addReadinessCheck(std::string reason, Check check) {
+    checks.push_back({std::move(reason), std::move(check)});
+}
+
+std::optional<std::string> HealthMonitor::notReadyReason() const {
+    for (const auto& readiness : checks) {
+        if (!readiness.check()) {
+            return readiness.reason;
+        }
+    }
+    return std::nullopt;
+}
+
+std::chrono::seconds HealthMonitor::uptime() const {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started);
+}
+
+std::string HealthMonitor::renderMetrics() const {
+    std::ostringstream out;
+    writeMetric(out, "image_forensics_ready", "Whether the instance accepts new traffic", MetricType::Gauge,
+                notReadyReason() ? 0 : 1);
+    writeMetric(out, "image_forensics_uptime_seconds", "Seconds since the service started", MetricType::Gauge,
+                static_cast<double>(uptime().count()));
+    for (const auto& metric : metrics) {
+        writeMetric(out, metric.name, metric.help, metric.type, metric.sample());
+    }
+    return out.str();
+}
+
+} // namespace ImageForensics
@@ -3,6 +3,13 @@
 #include "metadata.hpp"
 #include "storage.hpp"
 #include "util.hpp"
+#include "async.hpp"
+#include "compression.hpp"
+#include "peer_cache.hpp"
+#include "probe.hpp"
+#include "multipart.hpp"
+#include "shm_ingest.hpp"
+#include "health_monitor.hpp"
 #include <pistache/endpoint.h>
 #include <pistache/http.h>
 #include <pistache/router.h>
@@ -13,33 +20,302 @@
 #include <vector>
 #include <string>
 #include <csignal>
+#include <cstdlib>
 #include <fstream>
+#include <thread>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <optional>
 
 using namespace ImageForensics;
 using namespace Pistache;
 using json = nlohmann::json;
 
-// 全局服务器实例，用于信号处理
+// 全局服务器实例
 std::shared_ptr<NetworkServer> server;
 
-// 信号处理函数
-void signalHandler(int signal) {
-    std::cout << "Received signal " << signal << ", shutting down..." << std::endl;
+// 关闭和重新加载配置的信号：在创建任何线程之前屏蔽，由主线程通过sigwait同步接收，
+// 关闭流程和重新加载都不在信号处理函数中执行
+sigset_t handledSignals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    return signals;
+}
+
+// 应用可以在运行期间调整的设置，启动时和每次重新加载配置后调用；
+// 请求处理路径上的其他设置直接从Config::settings()读取
+void applyLiveSettings() {
+    // 缓存条目使用在本服务结果上训练的字典压缩，字典由image_forensics_dict生成
+    EntryCodec::configure(Config::get<bool>("cache.compression", true), Config::get<int>("cache.compression_level", 3));
+    
+    // 响应按Accept-Encoding使用zstd或gzip压缩，小响应不压缩
+    ResponseEncoder::configure(Config::get<bool>("server.compression", true),
+                               Config::get<size_t>("server.compression_min_size", 1024),
+                               Config::get<int>("server.gzip_level", 6),
+                               Config::get<int>("server.zstd_level", 3));
+    
     if (server) {
-        server->shutdown();
+        server->updateRateLimit(RateLimitOptions::fromConfig());
+    }
+}
+
+// 为一次请求创建取消令牌：超过server.timeout或客户端断开后放弃处理
+CancellationToken makeRequestToken(const Rest::Request& request) {
+    auto token = CancellationToken::withTimeout(Config::settings().requestTimeout);
+    
+    std::weak_ptr<Tcp::Peer> peer;
+    try {
+        peer = request.peer();
+    } catch (const std::exception&) {
+        // 连接已经关闭
+        token.cancel();
+        return token;
+    }
+    
+    token.setAliveProbe([peer]() { return !peer.expired(); });
+    return token;
+}
+
+// 处理被取消的请求：超时返回504，客户端已断开时不再发送响应
+void handleCancelled(const OperationCancelled& e, Http::ResponseWriter& response) {
+    if (e.reason() == CancelReason::ClientDisconnected) {
+        Logger::get()->info("Client disconnected, abandoning request");
+        return;
+    }
+    
+    Logger::get()->warn("Request cancelled: {}", e.what());
+    json error = {
+        {"status", "error"},
+        {"message", "Request timed out"}
+    };
+    response.send(Http::Code::Gateway_Timeout, error.dump(), MIME(Application, Json));
+}
+
+// 上传的请求体无法解析，返回400
+class InvalidUpload : public ImageForensicsException {
+public:
+    using ImageForensicsException::ImageForensicsException;
+};
+
+// 取出multipart/form-data请求的boundary，不是multipart请求时返回std::nullopt
+std::optional<std::string> multipartBoundary(const Rest::Request& request) {
+    auto contentType = request.headers().tryGet<Http::Header::ContentType>();
+    if (!contentType) {
+        return std::nullopt;
+    }
+    return MultipartParser::boundaryFromContentType(contentType->mime().toString());
+}
+
+// 接收请求中的上传文件。Pistache交给路由的是完整的请求体，整段送入解析器，
+// 文件内容直接引用请求体；每个文件接收完成时调用onPart
+void receiveUploads(const Rest::Request& request, const std::string& boundary, const UploadOptions& options,
+                    const UploadReceiver::PartHandler& onPart) {
+    UploadReceiver receiver(boundary, options, onPart);
+    if (!receiver.feed(request.body())) {
+        throw InvalidUpload(receiver.error());
+    }
+    if (!receiver.finished()) {
+        throw InvalidUpload("Incomplete multipart body");
+    }
+    if (receiver.fileCount() == 0) {
+        throw InvalidUpload("No file uploaded");
+    }
+}
+
+void sendInvalidUpload(const InvalidUpload& e, Http::ResponseWriter& response) {
+    Logger::get()->warn("Invalid upload: {}", e.what());
+    json error = {
+        {"status", "error"},
+        {"message", e.what()}
+    };
+    response.send(Http::Code::Bad_Request, error.dump(), MIME(Application, Json));
+}
+
+// 处理批量请求中的一个文件：在工作线程池上执行，单个文件失败时返回该文件的错误，
+// 不让整个请求失败。被取消的文件同样返回错误，由调用方统一检查令牌
+Task<json> processBatchItem(ImageService& imageService, ThreadPool& workerPool, UploadedPart part,
+                            CancellationToken token) {
+    json item;
+    try {
+        co_await resumeOn(workerPool);
+        SharedResponse result = co_await imageService.processUploadShared(part, token);
+        item = json::parse(result->decodeJson());
+    } catch (const OperationCancelled& e) {
+        item = {
+            {"status", "error"},
+            {"message", e.what()}
+        };
+    } catch (const std::exception& e) {
+        Logger::get()->error("Error processing {} in batch request: {}", part.filename, e.what());
+        item = {
+            {"status", "error"},
+            {"message", e.what()}
+        };
     }
-    exit(signal);
+    item["filename"] = part.filename;
+    co_return item;
+}
+
+// 原始请求体上传的文件名：优先使用查询参数filename，否则按Content-Type或文件头签名生成，
+// 文件名用于格式校验和结果。Content-Type不是image/*或application/octet-stream时返回std::nullopt
+std::optional<std::string> rawUploadFilename(const Rest::Request& request) {
+    auto contentType = request.headers().tryGet<Http::Header::ContentType>();
+    std::string mimeType = contentType ? contentType->mime().toString() : "application/octet-stream";
+    mimeType = mimeType.substr(0, mimeType.find(';'));
+    std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), ::tolower);
+    
+    bool isImage = mimeType.rfind("image/", 0) == 0;
+    if (!isImage && mimeType != "application/octet-stream") {
+        return std::nullopt;
+    }
+    if (request.body().empty()) {
+        return std::nullopt;
+    }
+    
+    if (auto filename = request.query().get("filename")) {
+        auto name = std::filesystem::path(*filename).filename().string();
+        if (!name.empty()) {
+            return name;
+        }
+    }
+    
+    // application/octet-stream或未知的图像类型按文件头签名判断
+    std::string extension = isImage ? extensionForMimeType(mimeType) : "";
+    if (extension.empty()) {
+        const auto& body = request.body();
+        auto header = std::span<const unsigned char>(reinterpret_cast<const unsigned char*>(body.data()),
+                                                     std::min<size_t>(body.size(), 12));
+        extension = extensionForMimeType(detectMimeType(header));
+    }
+    return "upload" + extension;
+}
+
+// 原始请求体上传的内容，直接引用请求体缓冲区，不复制
+std::span<const unsigned char> rawBody(const Rest::Request& request) {
+    const auto& body = request.body();
+    return {reinterpret_cast<const unsigned char*>(body.data()), body.size()};
+}
+
+void sendInvalidRawUpload(const Rest::Request& request, Http::ResponseWriter& response) {
+    bool empty = request.body().empty();
+    json error = {
+        {"status", "error"},
+        {"message", empty ? "Empty request body" : "Expected an image/* or application/octet-stream body"}
+    };
+    response.send(empty ? Http::Code::Bad_Request : Http::Code::Unsupported_Media_Type, error.dump(),
+                  MIME(Application, Json));
+}
+
+// 检查If-None-Match是否与ETag匹配，支持逗号分隔的列表、弱校验前缀W/和*
+bool matchesETag(const std::string& ifNoneMatch, const std::string& etag) {
+    std::stringstream stream(ifNoneMatch);
+    std::string candidate;
+    while (std::getline(stream, candidate, ',')) {
+        candidate.erase(0, candidate.find_first_not_of(" \t"));
+        candidate.erase(candidate.find_last_not_of(" \t") + 1);
+        if (candidate.rfind("W/", 0) == 0) {
+            candidate.erase(0, 2);
+        }
+        if (candidate == "*" || candidate == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Accept-Encoding的值。Pistache注册了该头时请求中只保留解析后的形式，这时读取它的序列化结果
+std::string acceptEncoding(const Rest::Request& request) {
+    if (auto raw = request.headers().tryGetRaw("Accept-Encoding")) {
+        return raw->value();
+    }
+    if (auto header = request.headers().tryGet("Accept-Encoding")) {
+        std::ostringstream value;
+        header->write(value);
+        return value.str();
+    }
+    return "";
+}
+
+// 压缩后的表示与原始字节不同，强ETag加上编码后缀
+std::string encodedETag(const std::string& etag, ContentEncoding encoding) {
+    if (etag.empty() || encoding == ContentEncoding::Identity) {
+        return etag;
+    }
+    return etag.substr(0, etag.size() - 1) + "-" + ResponseEncoder::name(encoding) + "\"";
+}
+
+// 发送不缓存的响应体，客户端接受压缩且超过阈值时压缩
+void sendBody(const Rest::Request& request, Http::ResponseWriter& response, Http::Code code, const std::string& body,
+              const Mime::MediaType& mime) {
+    response.headers().addRaw(Http::Header::Raw("Vary", "Accept-Encoding"));
+    
+    auto encoding = ResponseEncoder::negotiate(acceptEncoding(request), body.size());
+    if (encoding != ContentEncoding::Identity) {
+        if (auto compressed = ResponseEncoder::compress(body, encoding)) {
+            response.headers().addRaw(Http::Header::Raw("Content-Encoding", ResponseEncoder::name(encoding)));
+            response.send(code, *compressed, mime);
+            return;
+        }
+    }
+    
+    response.send(code, body, mime);
+}
+
+// 发送缓存的响应：按Accept选择JSON或CBOR编码，按Accept-Encoding压缩，带ETag，客户端已持有相同版本时返回304。
+// 压缩后的形式保存在缓存条目中，再次命中时直接发送，不需要解压条目
+void sendCachedResponse(const Rest::Request& request, Http::ResponseWriter& response, const SharedResponse& cached,
+                        FileCache& cache) {
+    bool wantsCbor = false;
+    if (auto accept = request.headers().tryGet<Http::Header::Accept>()) {
+        for (const auto& media : accept->media()) {
+            if (media.toString().find("application/cbor") != std::string::npos) {
+                wantsCbor = true;
+                break;
+            }
+        }
+    }
+    
+    auto encoding = ResponseEncoder::negotiate(acceptEncoding(request), wantsCbor ? cached->cborSize : cached->jsonSize);
+    auto compressed = cache.compressedResponse(cached, wantsCbor, encoding);
+    if (!compressed) {
+        encoding = ContentEncoding::Identity;
+    }
+    
+    std::string etag = encodedETag(wantsCbor ? cached->cborETag : cached->jsonETag, encoding);
+    auto mime = wantsCbor ? Mime::MediaType::fromString("application/cbor") : MIME(Application, Json);
+    
+    response.headers().addRaw(Http::Header::Raw("Vary", "Accept, Accept-Encoding"));
+    if (!etag.empty()) {
+        response.headers().addRaw(Http::Header::Raw("ETag", etag));
+        
+        auto ifNoneMatch = request.headers().tryGetRaw("If-None-Match");
+        if (ifNoneMatch && matchesETag(ifNoneMatch->value(), etag)) {
+            response.send(Http::Code::Not_Modified, "");
+            return;
+        }
+    }
+    
+    if (compressed) {
+        response.headers().addRaw(Http::Header::Raw("Content-Encoding", ResponseEncoder::name(encoding)));
+        response.send(Http::Code::Ok, *compressed, mime);
+        return;
+    }
+    response.send(Http::Code::Ok, wantsCbor ? cached->decodeCbor() : cached->decodeJson(), mime);
 }
 
 int main(int argc, char* argv[]) {
     try {
+        // 屏蔽关闭信号，之后创建的线程都继承该屏蔽字
+        sigset_t signals = handledSignals();
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        
         // 初始化日志
         Logger::init(spdlog::level::info);
         
-        // 注册信号处理
-        std::signal(SIGINT, signalHandler);
-        std::signal(SIGTERM, signalHandler);
-        
         // 加载配置
         std::filesystem::path configPath = "config.json";
         if (argc > 1) {
@@ -53,7 +329,6 @@ int main(int argc, char* argv[]) {
             Config::set("server.port", 8080);
             Config::set("server.threads", 4);
             Config::set("cache.path", "cache");
-            Config::set("cache.max_size", 1024 * 1024 * 100); // 100MB
             Config::set("cache.max_age", 86400); // 24小时
             
             // 保存默认配置
@@ -62,91 +337,160 @@ int main(int argc, char* argv[]) {
         
         // 创建缓存目录
         std::filesystem::path cachePath = Config::get<std::string>("cache.path", "cache");
-        size_t maxCacheSize = Config::get<size_t>("cache.max_size", 1024 * 1024 * 100);
         int maxCacheAge = Config::get<int>("cache.max_age", 86400);
+        size_t memoryCacheSize = Config::get<size_t>("cache.memory_max_size", 1024 * 1024 * 64);
+        size_t cacheShards = Config::get<size_t>("cache.shards", 0);
+        int janitorInterval = Config::get<int>("cache.janitor_interval", 60);
         
-        FileCache fileCache(cachePath, maxCacheSize, std::chrono::seconds(maxCacheAge));
+        // 过期的内存结果由后台线程定期清理
+        FileCache fileCache(cachePath, std::chrono::seconds(maxCacheAge), memoryCacheSize, cacheShards,
+                            std::chrono::seconds(janitorInterval));
         
-        // 创建服务实例
-        ImageService imageService;
+        applyLiveSettings();
+        EntryCodec::loadDictionaries(Config::get<std::string>("cache.dictionary_dir", "data/dictionaries"));
         
-        // 创建服务器
-        server = std::make_shared<NetworkServer>();
+        // 持久化结果存储，重启后无需重新解析已处理过的图像
+        if (Config::get<bool>("cache.persistent", true)) {
+            ResultStoreOptions storeOptions;
+            storeOptions.maxAge = std::chrono::seconds(maxCacheAge);
+            storeOptions.segmentSize = Config::get<uint64_t>("cache.segment_size", storeOptions.segmentSize);
+            storeOptions.compactionInterval = std::chrono::seconds(Config::get<int>("cache.compaction_interval", 60));
+            storeOptions.maxBytes = Config::get<uint64_t>("cache.max_size", 1024ULL * 1024 * 1024);
+            fileCache.enablePersistence(storeOptions);
+        }
         
-        // 注册路由
+        // 可选的对等缓存层：多个实例按一致性哈希分担缓存，本地未命中时先询问负责的实例
+        std::unique_ptr<PeerCache> peerCache;
+        auto peers = Config::get<std::vector<std::string>>("cache.peers", {});
+        auto peerSecret = Config::get<std::string>("cache.peer_secret", "");
+        if (!peers.empty() && peerSecret.empty()) {
+            // 没有密钥时任何客户端都能读写内部接口，不启用对等缓存
+            Logger::get()->error("cache.peers is set but cache.peer_secret is empty, peer cache disabled");
+        } else if (!peers.empty()) {
+            PeerCacheOptions peerOptions;
+            peerOptions.self = Config::get<std::string>("cache.peer_self",
+                "http://127.0.0.1:" + std::to_string(Config::get<int>("server.port", 8080)));
+            peerOptions.peers = std::move(peers);
+            peerOptions.secret = std::move(peerSecret);
+            peerOptions.timeout = std::chrono::milliseconds(Config::get<int>("cache.peer_timeout_ms", 200));
+            peerCache = std::make_unique<PeerCache>(std::move(peerOptions));
+        }
         
-        // 1. 健康检查
-        server->registerRoute("/health", Http::Method::Get, [](const Rest::Request&, Http::ResponseWriter response) -> Rest::Route::Result {
-            json result = {
-                {"status", "ok"},
-                {"version", "1.0.0"}
-            };
-            
-            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
-            return Rest::Route::Result::Ok;
-        });
+        // 上传的文件直接引用请求体；只有需要复制的内容超过阈值时才写入缓存目录下的临时文件
+        UploadOptions uploadOptions;
+        uploadOptions.spillThreshold = Config::get<size_t>("upload.spill_threshold", uploadOptions.spillThreshold);
+        uploadOptions.maxFiles = Config::get<size_t>("upload.max_files", uploadOptions.maxFiles);
+        uploadOptions.spillDirectory = cachePath;
         
-        // 2. 提取单个图像元数据
-        server->registerRoute("/metadata", Http::Method::Post, [&](const Rest::Request& request, Http::ResponseWriter response) -> Rest::Route::Result {
-            // 检查Content-Type是否为multipart/form-data
-            auto contentType = request.headers().get<Http::Header::ContentType>();
-            Logger::get()->info("Content-Type: {}", contentType ? contentType->mime().toString() : "null");
-            
-            if (!contentType || contentType->mime().toString().find("multipart/form-data") == std::string::npos) {
+        // 创建工作线程池，元数据解析和取证分析不在网络反应器线程上执行
+        size_t workerThreads = Config::get<size_t>("advanced.worker_threads", std::thread::hardware_concurrency());
+        ThreadPool workerPool(workerThreads);
+        
+        // 创建服务实例，处理结果按内容哈希缓存，批量解析共用工作线程池
+        ImageService imageService(&fileCache, peerCache.get(), &workerPool);
+        
+        // 同一主机上的生产者通过共享内存提交图像，图像从共享的槽位复制后解析，不经过套接字缓冲区
+        std::unique_ptr<SharedMemoryIngestServer> ingestServer;
+        auto ingestOptions = SharedMemoryIngestOptions::fromConfig();
+        if (!ingestOptions.socketPath.empty()) {
+            ingestServer = std::make_unique<SharedMemoryIngestServer>(std::move(ingestOptions), workerPool,
+                [&imageService](IngestOperation operation, IngestFormat format,
+                                std::span<const unsigned char> data) -> Task<SharedMemoryIngestServer::Result> {
+                    // 没有文件名，按文件头签名确定扩展名
+                    std::string filename = "upload" + extensionForMimeType(detectMimeType(data.first(std::min<size_t>(data.size(), 12))));
+                    auto token = CancellationToken::withTimeout(Config::settings().requestTimeout);
+                    try {
+                        // 与相同内容的请求合并时挂起等待，不占用工作线程
+                        SharedResponse result;
+                        if (operation == IngestOperation::Forensics) {
+                            result = co_await imageService.analyzeForensicsShared(data, filename, token);
+                        } else {
+                            result = co_await imageService.processImageShared(data, filename, token);
+                        }
+                        co_return SharedMemoryIngestServer::Result{200, format == IngestFormat::Cbor ? result->decodeCbor() : result->decodeJson()};
+                    } catch (const OperationCancelled&) {
+                        json error = {
+                            {"status", "error"},
+                            {"message", "Request timed out"}
+                        };
+                        co_return SharedMemoryIngestServer::Result{504, error.dump()};
+                    }
+                });
+        }
+        
+        // 创建服务器，监听地址、请求大小上限、超时和连接保持时间都来自配置
+        server = std::make_shared<NetworkServer>(ServerOptions::fromConfig());
+        
+        // 就绪状态和指标：开始关闭或工作线程池积压超过上限时不再就绪
+        auto controlOptions = ControlPlaneOptions::fromConfig();
+        size_t maxQueueDepth = controlOptions.maxQueueDepth > 0 ? controlOptions.maxQueueDepth : 4 * workerPool.size();
+        HealthMonitor health;
+        health.addReadinessCheck("draining", []() { return server->isReady(); });
+        health.addReadinessCheck("overloaded", [&workerPool, maxQueueDepth]() { return workerPool.queueDepth() <= maxQueueDepth; });
+        health.addMetric("image_forensics_requests_total", "Requests accepted for processing", MetricType::Counter,
+                         []() { return static_cast<double>(server->totalRequests()); });
+        health.addMetric("image_forensics_requests_in_flight", "Requests currently being processed", MetricType::Gauge,
+                         []() { return static_cast<double>(server->inFlightRequests()); });
+        health.addMetric("image_forensics_worker_threads", "Worker pool threads", MetricType::Gauge,
+                         [&workerPool]() { return static_cast<double>(workerPool.size()); });
+        health.addMetric("image_forensics_worker_queue_depth", "Tasks waiting for a worker thread", MetricType::Gauge,
+                         [&workerPool]() { return static_cast<double>(workerPool.queueDepth()); });
+        
+        // 控制面单独监听时使用自己的反应器线程，业务路由过载也不影响健康检查
+        std::unique_ptr<ControlPlaneServer> controlPlane;
+        if (controlOptions.port > 0) {
+            controlPlane = std::make_unique<ControlPlaneServer>(controlOptions, health);
+        } else {
+            ControlPlaneServer::registerRoutes(*server, health);
+        }
+        
+        // 注册路由；异步路由的最后一个参数是请求的作用域对象，处理器不使用它，由协程帧持有到处理结束
+        
+        // 1. 提取单个图像元数据
+        server->registerAsyncRoute("/metadata", Http::Method::Post, [&](Rest::Request request, Http::ResponseWriter response, DetachedTask::Scope) -> DetachedTask {
+            // 检查Content-Type是否为带boundary的multipart/form-data
+            auto boundary = multipartBoundary(request);
+            if (!boundary) {
                 json error = {
                     {"status", "error"},
                     {"message", "No file uploaded or invalid content type"}
                 };
                 response.send(Http::Code::Bad_Request, error.dump(), MIME(Application, Json));
-                return Rest::Route::Result::Ok;
+                co_return;
             }
             
             try {
-                Logger::get()->info("Processing metadata request");
+                Logger::get()->info("Processing metadata request ({} bytes)", request.body().size());
                 
-                // 打印请求体大小
-                Logger::get()->info("Request body size: {}", request.body().size());
+                auto token = makeRequestToken(request);
                 
-                // 打印请求头
-                for (const auto& header : request.headers().rawList()) {
-                    Logger::get()->info("Header: {} = {}", header.first, header.second.value());
-                }
-                
-                // 处理文件上传
-                // 注意：由于我们无法正确解析multipart/form-data，我们直接使用test3.jpg文件进行测试
-                std::string tempFilePath = "/tmp/uploaded_image.jpg";
-                
-                try {
-                    // 直接复制test3.jpg文件到临时文件
-                    std::filesystem::copy_file("test3.jpg", tempFilePath, std::filesystem::copy_options::overwrite_existing);
-                    Logger::get()->info("Copied test3.jpg to {}", tempFilePath);
+                // 解析请求体和元数据都在工作线程池上执行，反应器线程只负责收发数据
+                UploadedPart upload = co_await offload(workerPool, [&]() -> UploadedPart {
+                    // 在队列中等待期间可能已经超时或断开
+                    token.throwIfCancelled();
                     
-                    // 打印临时文件大小
-                    Logger::get()->info("Temporary file size: {} bytes", std::filesystem::file_size(tempFilePath));
-                } catch (const std::exception& e) {
-                    Logger::get()->error("Error copying test file: {}", e.what());
-                    json error = {
-                        {"status", "error"},
-                        {"message", "Failed to copy test file: " + std::string(e.what())}
-                    };
-                    response.send(Http::Code::Internal_Server_Error, error.dump(), MIME(Application, Json));
-                    return Rest::Route::Result::Ok;
-                }
-                
-                // 处理图像元数据
-                Logger::get()->info("Calling imageService.processImage()");
-                json result = imageService.processImage(tempFilePath);
-                Logger::get()->info("processImage result: {}", result.dump());
+                    // 只处理第一个文件；接收时已经计算了内容哈希
+                    std::optional<UploadedPart> upload;
+                    receiveUploads(request, *boundary, uploadOptions, [&](UploadedPart&& part) {
+                        if (!upload) {
+                            upload = std::move(part);
+                        }
+                    });
+                    
+                    Logger::get()->info("Received {} ({} bytes, {})", upload->filename, upload->size, upload->mimeType);
+                    return std::move(*upload);
+                });
                 
-                // 缓存结果
-                if (result["status"] == "success") {
-                    fileCache.cacheMetadata(tempFilePath, result["metadata"]);
-                }
+                // 处理图像元数据：先按内容哈希查缓存，内容相同的并发上传挂起等待同一次计算
+                SharedResponse result = co_await imageService.processUploadShared(upload, token);
                 
-                // 返回结果
-                Logger::get()->info("Sending response: {}", result.dump());
-                response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
-                return Rest::Route::Result::Ok;
+                // 协程在工作线程上恢复；send会把写操作交回连接所属的反应器
+                Logger::get()->info("Sending metadata response");
+                sendCachedResponse(request, response, result, fileCache);
+            } catch (const OperationCancelled& e) {
+                handleCancelled(e, response);
+            } catch (const InvalidUpload& e) {
+                sendInvalidUpload(e, response);
             } catch (const std::exception& e) {
                 Logger::get()->error("Error processing metadata request: {}", e.what());
                 
@@ -155,39 +499,60 @@ int main(int argc, char* argv[]) {
                     {"message", e.what()}
                 };
                 response.send(Http::Code::Internal_Server_Error, error.dump(), MIME(Application, Json));
-                return Rest::Route::Result::Ok;
             }
         });
         
-        // 3. 批量提取元数据
-        server->registerRoute("/metadata/batch", Http::Method::Post, [&](const Rest::Request& request, Http::ResponseWriter response) -> Rest::Route::Result {
-            // 检查Content-Type是否为multipart/form-data
-            auto contentType = request.headers().get<Http::Header::ContentType>();
-            if (!contentType || contentType->mime().toString().find("multipart/form-data") == std::string::npos) {
+        // 2. 批量提取元数据
+        server->registerAsyncRoute("/metadata/batch", Http::Method::Post, [&](Rest::Request request, Http::ResponseWriter response, DetachedTask::Scope) -> DetachedTask {
+            // 检查Content-Type是否为带boundary的multipart/form-data
+            auto boundary = multipartBoundary(request);
+            if (!boundary) {
                 json error = {
                     {"status", "error"},
                     {"message", "No files uploaded or invalid content type"}
                 };
                 response.send(Http::Code::Bad_Request, error.dump(), MIME(Application, Json));
-                return Rest::Route::Result::Ok;
+                co_return;
             }
             
             try {
-                // 处理文件上传
-                // 注意：这里需要根据实际的Pistache版本修改文件上传处理逻辑
-                // 以下是一个简化的示例
-                std::vector<std::filesystem::path> imagePaths;
-                imagePaths.push_back("/tmp/uploaded_image1.jpg");
-                imagePaths.push_back("/tmp/uploaded_image2.jpg");
+                auto token = makeRequestToken(request);
+                co_await resumeOn(workerPool);
+                token.throwIfCancelled();
+                
+                // 每个文件接收完成后立即交给工作线程池处理，不等请求体中后面的文件
+                std::vector<Task<json>> items;
+                std::exception_ptr receiveError;
+                try {
+                    receiveUploads(request, *boundary, uploadOptions, [&](UploadedPart&& part) {
+                        items.push_back(processBatchItem(imageService, workerPool, std::move(part), token));
+                    });
+                } catch (...) {
+                    receiveError = std::current_exception();
+                }
                 
-                // 在实际应用中，您需要从请求中提取多个文件内容并保存到临时文件
-                // 这里简化处理，假设文件已经保存到imagePaths
+                // 已经开始的文件引用请求体，请求体格式错误时也要等它们结束
+                json results = json::array();
+                for (auto& item : items) {
+                    json value = co_await item;
+                    results.push_back(std::move(value));
+                }
+                if (receiveError) {
+                    std::rethrow_exception(receiveError);
+                }
+                token.throwIfCancelled();
                 
-                // 批量处理图像元数据
-                json result = imageService.processBatch(imagePaths);
+                json result = {
+                    {"status", "success"},
+                    {"results", results}
+                };
+                std::string body = result.dump();
                 
-                response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
-                return Rest::Route::Result::Ok;
+                sendBody(request, response, Http::Code::Ok, body, MIME(Application, Json));
+            } catch (const OperationCancelled& e) {
+                handleCancelled(e, response);
+            } catch (const InvalidUpload& e) {
+                sendInvalidUpload(e, response);
             } catch (const std::exception& e) {
                 Logger::get()->error("Error processing batch request: {}", e.what());
                 
@@ -196,15 +561,58 @@ int main(int argc, char* argv[]) {
                     {"message", e.what()}
                 };
                 response.send(Http::Code::Internal_Server_Error, error.dump(), MIME(Application, Json));
-                return Rest::Route::Result::Ok;
             }
         });
         
-        // 4. 取证分析
-        server->registerRoute("/forensics", Http::Method::Post, [&](const Rest::Request& request, Http::ResponseWriter response) -> Rest::Route::Result {
-            // 检查Content-Type是否为multipart/form-data
-            auto contentType = request.headers().get<Http::Header::ContentType>();
-            if (!contentType || contentType->mime().toString().find("multipart/form-data") == std::string::npos) {
+        // 3. 取证分析
+        server->registerAsyncRoute("/forensics", Http::Method::Post, [&](Rest::Request request, Http::ResponseWriter response, DetachedTask::Scope) -> DetachedTask {
+            // 检查Content-Type是否为带boundary的multipart/form-data
+            auto boundary = multipartBoundary(request);
+            if (!boundary) {
+                json error = {
+                    {"status", "error"},
+                    {"message", "No file uploaded or invalid content type"}
+                };
+                response.send(Http::Code::Bad_Request, error.dump(), MIME(Application, Json));
+                co_return;
+            }
+            
+            try {
+                // 处理图像取证分析
+                auto token = makeRequestToken(request);
+                UploadedPart upload = co_await offload(workerPool, [&]() -> UploadedPart {
+                    token.throwIfCancelled();
+                    
+                    std::optional<UploadedPart> upload;
+                    receiveUploads(request, *boundary, uploadOptions, [&](UploadedPart&& part) {
+                        if (!upload) {
+                            upload = std::move(part);
+                        }
+                    });
+                    return std::move(*upload);
+                });
+                SharedResponse result = co_await imageService.analyzeUploadShared(upload, token);
+                
+                sendCachedResponse(request, response, result, fileCache);
+            } catch (const OperationCancelled& e) {
+                handleCancelled(e, response);
+            } catch (const InvalidUpload& e) {
+                sendInvalidUpload(e, response);
+            } catch (const std::exception& e) {
+                Logger::get()->error("Error processing forensics request: {}", e.what());
+                
+                json error = {
+                    {"status", "error"},
+                    {"message", e.what()}
+                };
+                response.send(Http::Code::Internal_Server_Error, error.dump(), MIME(Application, Json));
+            }
+        });
+        
+        // 4. 探测图像格式、尺寸和方向，只读取文件开头的格式头，在反应器线程上直接完成
+        server->registerRoute("/probe", Http::Method::Post, [&](const Rest::Request& request, Http::ResponseWriter response) -> Rest::Route::Result {
+            auto boundary = multipartBoundary(request);
+            if (!boundary) {
                 json error = {
                     {"status", "error"},
                     {"message", "No file uploaded or invalid content type"}
@@ -213,20 +621,96 @@ int main(int argc, char* argv[]) {
                 return Rest::Route::Result::Ok;
             }
             
+            // 探测不需要内容哈希，也不落盘
+            UploadOptions probeOptions = uploadOptions;
+            probeOptions.hashContent = false;
+            probeOptions.spillThreshold = std::numeric_limits<size_t>::max();
+            
+            std::optional<ProbeResult> probe;
             try {
-                // 处理文件上传
-                // 注意：这里需要根据实际的Pistache版本修改文件上传处理逻辑
-                // 以下是一个简化的示例
-                std::string tempFilePath = "/tmp/uploaded_image.jpg";
+                receiveUploads(request, *boundary, probeOptions, [&, first = true](UploadedPart&& part) mutable {
+                    if (first) {
+                        probe = probeImage(part.data, part.size);
+                        first = false;
+                    }
+                });
+            } catch (const InvalidUpload& e) {
+                sendInvalidUpload(e, response);
+                return Rest::Route::Result::Ok;
+            }
+            
+            if (!probe) {
+                json error = {
+                    {"status", "error"},
+                    {"message", "Unrecognized image format"}
+                };
+                response.send(Http::Code::Unsupported_Media_Type, error.dump(), MIME(Application, Json));
+                return Rest::Route::Result::Ok;
+            }
+            
+            if (exceedsPixelLimit(*probe, Config::settings().maxPixels)) {
+                json error = {
+                    {"status", "error"},
+                    {"message", "Image dimensions exceed the pixel limit"},
+                    {"probe", probe->toJson()}
+                };
+                response.send(Http::Code::Unprocessable_Entity, error.dump(), MIME(Application, Json));
+                return Rest::Route::Result::Ok;
+            }
+            
+            json result = {
+                {"status", "success"},
+                {"probe", probe->toJson()}
+            };
+            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
+            return Rest::Route::Result::Ok;
+        });
+        
+        // 5. 原始请求体上传：请求体就是图像本身，不经过表单编码，直接交给内存中的解析流程
+        server->registerAsyncRoute("/metadata", Http::Method::Put, [&](Rest::Request request, Http::ResponseWriter response, DetachedTask::Scope) -> DetachedTask {
+            auto filename = rawUploadFilename(request);
+            if (!filename) {
+                sendInvalidRawUpload(request, response);
+                co_return;
+            }
+            
+            try {
+                auto token = makeRequestToken(request);
+                // 内容哈希和解析都在工作线程池上执行
+                co_await resumeOn(workerPool);
+                token.throwIfCancelled();
+                SharedResponse result = co_await imageService.processImageShared(rawBody(request), *filename, token);
                 
-                // 在实际应用中，您需要从请求中提取文件内容并保存到临时文件
-                // 这里简化处理，假设文件已经保存到tempFilePath
+                sendCachedResponse(request, response, result, fileCache);
+            } catch (const OperationCancelled& e) {
+                handleCancelled(e, response);
+            } catch (const std::exception& e) {
+                Logger::get()->error("Error processing metadata request: {}", e.what());
                 
-                // 处理图像取证分析
-                json result = imageService.analyzeForensics(tempFilePath);
+                json error = {
+                    {"status", "error"},
+                    {"message", e.what()}
+                };
+                response.send(Http::Code::Internal_Server_Error, error.dump(), MIME(Application, Json));
+            }
+        });
+        
+        server->registerAsyncRoute("/forensics", Http::Method::Put, [&](Rest::Request request, Http::ResponseWriter response, DetachedTask::Scope) -> DetachedTask {
+            auto filename = rawUploadFilename(request);
+            if (!filename) {
+                sendInvalidRawUpload(request, response);
+                co_return;
+            }
+            
+            try {
+                auto token = makeRequestToken(request);
+                co_await resumeOn(workerPool);
+                token.throwIfCancelled();
+                SharedResponse result = co_await imageService.analyzeForensicsShared(rawBody(request), *filename, token);
                 
-                response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
-                return Rest::Route::Result::Ok;
+                sendCachedResponse(request, response, result, fileCache);
+            } catch (const OperationCancelled& e) {
+                handleCancelled(e, response);
             } catch (const std::exception& e) {
                 Logger::get()->error("Error processing forensics request: {}", e.what());
                 
@@ -235,23 +719,127 @@ int main(int argc, char* argv[]) {
                     {"message", e.what()}
                 };
                 response.send(Http::Code::Internal_Server_Error, error.dump(), MIME(Application, Json));
-                return Rest::Route::Result::Ok;
             }
         });
         
-        // 启动服务器
-        int port = Config::get<int>("server.port", 8080);
-        int threads = Config::get<int>("server.threads", 4);
+        // 6. 对等实例之间交换缓存条目的内部接口，只查本地缓存，不会再转发；只在配置了共享密钥时注册
+        if (peerCache) {
+            auto authorizePeer = [&](const Rest::Request& request, Http::ResponseWriter& response) {
+                auto token = request.headers().tryGetRaw(PeerCache::TOKEN_HEADER);
+                if (!peerCache->authorize(token ? std::optional<std::string>(token->value()) : std::nullopt)) {
+                    response.send(Http::Code::Forbidden, "");
+                    return false;
+                }
+                return true;
+            };
+            
+            server->registerRoute("/internal/cache/:key", Http::Method::Get, [&](const Rest::Request& request, Http::ResponseWriter response) -> Rest::Route::Result {
+                if (!authorizePeer(request, response)) {
+                    return Rest::Route::Result::Ok;
+                }
+                
+                auto key = PeerCache::decodeKey(request.param(":key").as<std::string>());
+                auto cached = key ? fileCache.getCachedResponse(*key) : nullptr;
+                if (!cached) {
+                    response.send(Http::Code::Not_Found, "");
+                    return Rest::Route::Result::Ok;
+                }
+                
+                response.send(Http::Code::Ok, cached->cborBody, MIME(Application, OctetStream));
+                return Rest::Route::Result::Ok;
+            });
+            
+            server->registerRoute("/internal/cache/:key", Http::Method::Put, [&](const Rest::Request& request, Http::ResponseWriter response) -> Rest::Route::Result {
+                if (!authorizePeer(request, response)) {
+                    return Rest::Route::Result::Ok;
+                }
+                
+                // 只接受能够解码、且属于键所在命名空间的成功结果
+                auto key = PeerCache::decodeKey(request.param(":key").as<std::string>());
+                auto accept = [&key](const json& result) { return ImageService::matchesCacheKey(*key, result); };
+                if (!key || !fileCache.cacheEncodedResult(*key, request.body(), accept)) {
+                    response.send(Http::Code::Bad_Request, "");
+                    return Rest::Route::Result::Ok;
+                }
+                
+                response.send(Http::Code::No_Content, "");
+                return Rest::Route::Result::Ok;
+            });
+        }
         
-        Logger::get()->info("Starting server on port {} with {} threads", port, threads);
-        server->start(port, threads);
+        // 启动服务器
+        Logger::get()->info("Starting server");
+        if (controlPlane) {
+            controlPlane->start();
+        }
+        server->start();
+        if (ingestServer) {
+            ingestServer->start();
+        }
         
         // 等待服务器关闭
         Logger::get()->info("Server running. Press Ctrl+C to stop.");
         
-        // 主线程等待
-        pause();
+        // 主线程等待信号：SIGHUP重新加载配置，SIGINT和SIGTERM开始关闭；
+        // advanced.config_reload_interval大于0时，还按该间隔检查配置文件是否被修改
+        auto reloadInterval = Config::get<int>("advanced.config_reload_interval", 0);
+        int received = 0;
+        while (true) {
+            if (reloadInterval > 0) {
+                timespec timeout{reloadInterval, 0};
+                received = sigtimedwait(&signals, nullptr, &timeout);
+                if (received < 0) {
+                    if (Config::reloadIfChanged()) {
+                        applyLiveSettings();
+                    }
+                    continue;
+                }
+            } else if (sigwait(&signals, &received) != 0) {
+                continue;
+            }
+            
+            if (received != SIGHUP) {
+                break;
+            }
+            Logger::get()->info("Received SIGHUP, reloading config");
+            if (Config::reload()) {
+                applyLiveSettings();
+            }
+        }
+        Logger::get()->info("Received signal {}, draining", received);
+        
+        // 排空期间再次收到关闭信号时立即退出，SIGHUP被忽略
+        std::thread([signals]() {
+            int again = 0;
+            while (sigwait(&signals, &again) != 0 || again == SIGHUP) {
+            }
+            Logger::get()->warn("Received signal {} while draining, exiting immediately", again);
+            std::_Exit(128 + again);
+        }).detach();
+        
+        // 先停止就绪，在负载均衡器发现之前仍然照常处理请求
+        const auto& serverOptions = server->serverOptions();
+        server->beginDrain();
+        std::this_thread::sleep_for(serverOptions.drainDelay);
+        
+        // 拒绝新的请求和提交，等待处理中的请求完成
+        if (ingestServer) {
+            ingestServer->stop();
+        }
+        server->drain(serverOptions.drainTimeout);
+        server->shutdown();
+        
+        // 执行完队列中剩余的任务（包括超时未完成的请求），再把缓存写入磁盘
+        workerPool.shutdown();
+        fileCache.flush();
+        
+        // 控制面最后关闭，排空期间存活检查始终成功
+        if (controlPlane) {
+            controlPlane->shutdown();
+        }
+        server.reset();
         
+        Logger::get()->info("Shutdown complete");
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
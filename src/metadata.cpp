@@ -9,7 +9,11 @@
 
 namespace ImageForensics {
 
-MetadataExtractor::MetadataExtractor() {
+// 遍历元数据条目时每处理多少条检查一次取消令牌
+constexpr size_t CANCELLATION_CHECK_INTERVAL = 64;
+
+MetadataExtractor::MetadataExtractor(CancellationToken cancellation)
+    : cancellation(std::move(cancellation)) {
     // 初始化Exiv2
     Exiv2::XmpParser::initialize();
     Logger::get()->info("Initialized metadata extractor");
@@ -18,6 +22,7 @@ MetadataExtractor::MetadataExtractor() {
 std::optional<json> MetadataExtractor::extractMetadata(const std::filesystem::path& imagePath) {
     try {
         Logger::get()->info("Extracting metadata from: {}", imagePath.string());
+        cancellation.throwIfCancelled();
         
         // 打开图像文件
         auto image = Exiv2::ImageFactory::open(imagePath.string());
@@ -26,108 +31,155 @@ std::optional<json> MetadataExtractor::extractMetadata(const std::filesystem::pa
             return std::nullopt;
         }
         
-        // 读取元数据
-        image->readMetadata();
-        
-        // 获取Exif数据
-        Exiv2::ExifData& exifData = image->exifData();
-        if (exifData.empty()) {
-            Logger::get()->warn("No Exif data found in: {}", imagePath.string());
-        }
-        
-        // 获取IPTC数据
-        Exiv2::IptcData& iptcData = image->iptcData();
-        
-        // 获取XMP数据
-        Exiv2::XmpData& xmpData = image->xmpData();
-        
-        // 创建JSON对象
-        json metadata;
-        
-        // 提取基本信息
-        metadata["filename"] = imagePath.filename().string();
-        metadata["filesize"] = std::filesystem::file_size(imagePath);
-        
-        // 提取Exif数据
-        json exif;
-        
-        // 相机信息
-        if (exifData.findKey(Exiv2::ExifKey("Exif.Image.Make")) != exifData.end()) {
-            exif["make"] = exifData["Exif.Image.Make"].toString();
-        }
-        
-        if (exifData.findKey(Exiv2::ExifKey("Exif.Image.Model")) != exifData.end()) {
-            exif["model"] = exifData["Exif.Image.Model"].toString();
-        }
-        
-        // 时间信息
-        if (exifData.findKey(Exiv2::ExifKey("Exif.Photo.DateTimeOriginal")) != exifData.end()) {
-            exif["datetime_original"] = exifData["Exif.Photo.DateTimeOriginal"].toString();
-        }
-        
-        if (exifData.findKey(Exiv2::ExifKey("Exif.Image.DateTime")) != exifData.end()) {
-            exif["datetime_modified"] = exifData["Exif.Image.DateTime"].toString();
-        }
-        
-        // 图像信息
-        if (exifData.findKey(Exiv2::ExifKey("Exif.Photo.PixelXDimension")) != exifData.end() &&
-            exifData.findKey(Exiv2::ExifKey("Exif.Photo.PixelYDimension")) != exifData.end()) {
-            exif["width"] = exifData["Exif.Photo.PixelXDimension"].toUint32();
-            exif["height"] = exifData["Exif.Photo.PixelYDimension"].toUint32();
-        }
+        return buildMetadata(*image, imagePath.filename().string(), std::filesystem::file_size(imagePath));
+    } catch (const OperationCancelled&) {
+        throw;
+    } catch (const Exiv2::Error& e) {
+        Logger::get()->error("Exiv2 error: {}", e.what());
+        return std::nullopt;
+    } catch (const std::exception& e) {
+        Logger::get()->error("Error extracting metadata: {}", e.what());
+        return std::nullopt;
+    }
+}
+
+std::optional<json> MetadataExtractor::extractMetadata(std::span<const unsigned char> data,
+                                                     const std::string& filename) {
+    try {
+        Logger::get()->info("Extracting metadata from buffer: {} ({} bytes)", filename, data.size());
+        cancellation.throwIfCancelled();
         
-        // GPS信息
-        std::map<std::string, std::string> gpsExifData;
-        for (const auto& item : exifData) {
-            if (item.key().find("Exif.GPSInfo") != std::string::npos) {
-                gpsExifData[item.key()] = item.toString();
-            }
+        // 直接从内存打开图像，不经过文件系统
+        auto image = Exiv2::ImageFactory::open(data.data(), data.size());
+        if (!image) {
+            Logger::get()->error("Failed to open image buffer: {}", filename);
+            return std::nullopt;
         }
         
-        if (!gpsExifData.empty()) {
-            exif["gps"] = parseGpsInfo(gpsExifData);
+        return buildMetadata(*image, filename, data.size());
+    } catch (const OperationCancelled&) {
+        throw;
+    } catch (const Exiv2::Error& e) {
+        Logger::get()->error("Exiv2 error: {}", e.what());
+        return std::nullopt;
+    } catch (const std::exception& e) {
+        Logger::get()->error("Error extracting metadata: {}", e.what());
+        return std::nullopt;
+    }
+}
+
+json MetadataExtractor::buildMetadata(Exiv2::Image& image, const std::string& filename, uintmax_t filesize) {
+    // 读取元数据
+    image.readMetadata();
+    
+    // Exiv2解析本身无法中断，解析完成后立即检查一次
+    cancellation.throwIfCancelled();
+    
+    // 获取Exif数据
+    Exiv2::ExifData& exifData = image.exifData();
+    if (exifData.empty()) {
+        Logger::get()->warn("No Exif data found in: {}", filename);
+    }
+    
+    // 获取IPTC数据
+    Exiv2::IptcData& iptcData = image.iptcData();
+    
+    // 获取XMP数据
+    Exiv2::XmpData& xmpData = image.xmpData();
+    
+    // 创建JSON对象
+    json metadata;
+    
+    // 提取基本信息
+    metadata["filename"] = filename;
+    metadata["filesize"] = filesize;
+    
+    // 提取Exif数据
+    json exif;
+    
+    // 相机信息
+    if (exifData.findKey(Exiv2::ExifKey("Exif.Image.Make")) != exifData.end()) {
+        exif["make"] = exifData["Exif.Image.Make"].toString();
+    }
+    
+    if (exifData.findKey(Exiv2::ExifKey("Exif.Image.Model")) != exifData.end()) {
+        exif["model"] = exifData["Exif.Image.Model"].toString();
+    }
+    
+    // 时间信息
+    if (exifData.findKey(Exiv2::ExifKey("Exif.Photo.DateTimeOriginal")) != exifData.end()) {
+        exif["datetime_original"] = exifData["Exif.Photo.DateTimeOriginal"].toString();
+    }
+    
+    if (exifData.findKey(Exiv2::ExifKey("Exif.Image.DateTime")) != exifData.end()) {
+        exif["datetime_modified"] = exifData["Exif.Image.DateTime"].toString();
+    }
+    
+    // 图像信息
+    if (exifData.findKey(Exiv2::ExifKey("Exif.Photo.PixelXDimension")) != exifData.end() &&
+        exifData.findKey(Exiv2::ExifKey("Exif.Photo.PixelYDimension")) != exifData.end()) {
+        exif["width"] = exifData["Exif.Photo.PixelXDimension"].toUint32();
+        exif["height"] = exifData["Exif.Photo.PixelYDimension"].toUint32();
+    }
+    
+    // GPS信息
+    std::map<std::string, std::string> gpsExifData;
+    size_t processed = 0;
+    for (const auto& item : exifData) {
+        if (++processed % CANCELLATION_CHECK_INTERVAL == 0) {
+            cancellation.throwIfCancelled();
         }
-        
-        // 软件信息
-        if (exifData.findKey(Exiv2::ExifKey("Exif.Image.Software")) != exifData.end()) {
-            exif["software"] = exifData["Exif.Image.Software"].toString();
+        if (item.key().find("Exif.GPSInfo") != std::string::npos) {
+            gpsExifData[item.key()] = item.toString();
         }
-        
-        // 添加所有Exif数据
-        json allExif;
-        for (const auto& item : exifData) {
-            allExif[item.key()] = item.toString();
+    }
+    
+    if (!gpsExifData.empty()) {
+        exif["gps"] = parseGpsInfo(gpsExifData);
+    }
+    
+    // 软件信息
+    if (exifData.findKey(Exiv2::ExifKey("Exif.Image.Software")) != exifData.end()) {
+        exif["software"] = exifData["Exif.Image.Software"].toString();
+    }
+    
+    // 添加所有Exif数据
+    json allExif;
+    for (const auto& item : exifData) {
+        if (++processed % CANCELLATION_CHECK_INTERVAL == 0) {
+            cancellation.throwIfCancelled();
         }
-        exif["all"] = allExif;
-        
-        metadata["exif"] = exif;
-        
-        // 提取IPTC数据
-        json iptc;
-        if (!iptcData.empty()) {
-            for (const auto& item : iptcData) {
-                iptc[item.key()] = item.toString();
+        allExif[item.key()] = item.toString();
+    }
+    exif["all"] = allExif;
+    
+    metadata["exif"] = exif;
+    
+    // 提取IPTC数据
+    json iptc;
+    if (!iptcData.empty()) {
+        for (const auto& item : iptcData) {
+            if (++processed % CANCELLATION_CHECK_INTERVAL == 0) {
+                cancellation.throwIfCancelled();
             }
-            metadata["iptc"] = iptc;
+            iptc[item.key()] = item.toString();
         }
-        
-        // 提取XMP数据
-        json xmp;
-        if (!xmpData.empty()) {
-            for (const auto& item : xmpData) {
-                xmp[item.key()] = item.toString();
+        metadata["iptc"] = iptc;
+    }
+    
+    // 提取XMP数据
+    json xmp;
+    if (!xmpData.empty()) {
+        for (const auto& item : xmpData) {
+            if (++processed % CANCELLATION_CHECK_INTERVAL == 0) {
+                cancellation.throwIfCancelled();
             }
-            metadata["xmp"] = xmp;
+            xmp[item.key()] = item.toString();
         }
-        
-        return metadata;
-    } catch (const Exiv2::Error& e) {
-        Logger::get()->error("Exiv2 error: {}", e.what());
-        return std::nullopt;
-    } catch (const std::exception& e) {
-        Logger::get()->error("Error extracting metadata: {}", e.what());
-        return std::nullopt;
+        metadata["xmp"] = xmp;
     }
+    
+    return metadata;
 }
 
 std::optional<json> MetadataExtractor::detectTampering(const std::filesystem::path& imagePath) {
@@ -142,10 +194,27 @@ std::optional<json> MetadataExtractor::detectTampering(const std::filesystem::pa
         
         json metadata = metadataOpt.value();
         
+        // 提取和分析之间检查一次取消
+        cancellation.throwIfCancelled();
+        
         // 检查元数据一致性
         json forensics = checkMetadataConsistency(metadata);
         
         return forensics;
+    } catch (const OperationCancelled&) {
+        throw;
+    } catch (const std::exception& e) {
+        Logger::get()->error("Error detecting tampering: {}", e.what());
+        return std::nullopt;
+    }
+}
+
+std::optional<json> MetadataExtractor::detectTampering(const json& metadata) {
+    try {
+        cancellation.throwIfCancelled();
+        return checkMetadataConsistency(metadata);
+    } catch (const OperationCancelled&) {
+        throw;
     } catch (const std::exception& e) {
         Logger::get()->error("Error detecting tampering: {}", e.what());
         return std::nullopt;
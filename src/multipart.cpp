@@ -0,0 +1,516 @@
+#include "multipart.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <utility>
+
+namespace ImageForensics {
+
+namespace {
+
+// RFC 2046：boundary为1到70个字符
+constexpr size_t MAX_BOUNDARY_LENGTH = 70;
+
+// 识别签名需要的文件头字节数
+constexpr size_t SNIFF_SIZE = 12;
+
+std::string toLower(std::string_view text) {
+    std::string result(text);
+    std::transform(result.begin(), result.end(), result.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return result;
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// 解析"value; key=value; key="quoted value""形式的头参数，键转为小写
+std::vector<std::pair<std::string, std::string>> parseHeaderParameters(std::string_view value) {
+    std::vector<std::pair<std::string, std::string>> params;
+
+    size_t pos = value.find(';');
+    while (pos != std::string_view::npos && pos < value.size()) {
+        ++pos;
+        size_t equals = value.find('=', pos);
+        if (equals == std::string_view::npos) {
+            break;
+        }
+        std::string key = toLower(trim(value.substr(pos, equals - pos)));
+
+        pos = equals + 1;
+        while (pos < value.size() && (value[pos] == ' ' || value[pos] == '\t')) {
+            ++pos;
+        }
+
+        std::string paramValue;
+        if (pos < value.size() && value[pos] == '"') {
+            for (++pos; pos < value.size() && value[pos] != '"'; ++pos) {
+                if (value[pos] == '\\' && pos + 1 < value.size()) {
+                    ++pos;
+                }
+                paramValue.push_back(value[pos]);
+            }
+            pos = value.find(';', pos);
+        } else {
+            size_t end = value.find(';', pos);
+            paramValue = std::string(trim(value.substr(pos, end == std::string_view::npos ? end : end - pos)));
+            pos = end;
+        }
+
+        params.emplace_back(std::move(key), std::move(paramValue));
+    }
+
+    return params;
+}
+
+std::optional<std::string> findParameter(const std::vector<std::pair<std::string, std::string>>& params,
+                                         const std::string& key) {
+    for (const auto& [name, value] : params) {
+        if (name == key) {
+            return value;
+        }
+    }
+    return std::nullopt;
+}
+
+MultipartPartInfo parsePartHeaders(std::string_view headers) {
+    MultipartPartInfo info;
+
+    while (!headers.empty()) {
+        size_t end = headers.find("\r\n");
+        std::string_view line = headers.substr(0, end);
+        headers.remove_prefix(end == std::string_view::npos ? headers.size() : end + 2);
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        std::string name = toLower(trim(line.substr(0, colon)));
+        std::string_view value = trim(line.substr(colon + 1));
+
+        if (name == "content-disposition") {
+            auto params = parseHeaderParameters(value);
+            info.name = findParameter(params, "name").value_or("");
+            info.filename = findParameter(params, "filename").value_or("");
+        } else if (name == "content-type") {
+            info.contentType = std::string(value);
+        }
+    }
+
+    return info;
+}
+
+} // namespace
+
+std::optional<std::string> MultipartParser::boundaryFromContentType(std::string_view contentType) {
+    if (toLower(trim(contentType.substr(0, contentType.find(';')))) != "multipart/form-data") {
+        return std::nullopt;
+    }
+
+    auto boundary = findParameter(parseHeaderParameters(contentType), "boundary");
+    if (!boundary || boundary->empty() || boundary->size() > MAX_BOUNDARY_LENGTH) {
+        return std::nullopt;
+    }
+    return boundary;
+}
+
+MultipartParser::MultipartParser(std::string boundary, Callbacks callbacks, size_t maxHeaderSize)
+    : delimiter("\r\n--" + boundary),
+      callbacks(std::move(callbacks)),
+      maxHeaderSize(maxHeaderSize),
+      carry("\r\n") {
+    // 第一个分隔符可以出现在请求体的开头，前面没有CRLF；预先放入一个CRLF，所有分隔符按同一种方式查找
+}
+
+bool MultipartParser::feed(std::string_view chunk) {
+    size_t pos = 0;
+    while (pos < chunk.size() && state != State::Done && state != State::Error) {
+        auto rest = chunk.substr(pos);
+        switch (state) {
+            case State::Preamble:
+            case State::Body:
+                pos += carry.empty() ? consumeContent(rest) : consumeCarry(rest);
+                break;
+            case State::AfterBoundary:
+                pos += consumeAfterBoundary(rest);
+                break;
+            case State::Headers:
+                pos += consumeHeaders(rest);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // 结束分隔符之后的尾声部分被忽略
+    return state != State::Error;
+}
+
+size_t MultipartParser::findDelimiter(std::string_view data) const {
+    // memchr按字长（glibc中为向量指令）扫描候选的'\r'，只在候选位置比较完整的分隔符
+    const char* begin = data.data();
+    const char* end = begin + data.size();
+    const char* p = begin;
+    while (static_cast<size_t>(end - p) >= delimiter.size()) {
+        p = static_cast<const char*>(std::memchr(p, '\r', static_cast<size_t>(end - p) - delimiter.size() + 1));
+        if (!p) {
+            break;
+        }
+        if (std::memcmp(p, delimiter.data(), delimiter.size()) == 0) {
+            return static_cast<size_t>(p - begin);
+        }
+        ++p;
+    }
+    return std::string_view::npos;
+}
+
+size_t MultipartParser::consumeContent(std::string_view data) {
+    size_t found = findDelimiter(data);
+    if (found != std::string_view::npos) {
+        if (!emitContent(data.substr(0, found))) {
+            return data.size();
+        }
+        boundaryReached();
+        return found + delimiter.size();
+    }
+
+    // 结尾处可能是被分开的分隔符，保留到下一次送入
+    size_t keepFrom = data.size();
+    size_t tailStart = data.size() >= delimiter.size() ? data.size() - delimiter.size() + 1 : 0;
+    for (size_t i = tailStart; i < data.size(); ++i) {
+        if (data[i] == '\r' && delimiter.compare(0, data.size() - i, data.substr(i)) == 0) {
+            keepFrom = i;
+            break;
+        }
+    }
+
+    if (emitContent(data.substr(0, keepFrom))) {
+        carry.assign(data.substr(keepFrom));
+    }
+    return data.size();
+}
+
+size_t MultipartParser::consumeCarry(std::string_view data) {
+    // 只需判断分隔符是否从暂存的字节中开始，拼接的长度不超过两个分隔符
+    std::string joined = carry;
+    joined.append(data.substr(0, std::min(data.size(), delimiter.size())));
+
+    size_t found = findDelimiter(joined);
+    if (found != std::string::npos && found < carry.size()) {
+        size_t consumed = found + delimiter.size() - carry.size();
+        std::string content = carry.substr(0, found);
+        carry.clear();
+        if (emitContent(content)) {
+            boundaryReached();
+        }
+        return consumed;
+    }
+
+    // 数据不足以判断，继续暂存
+    if (joined.size() < carry.size() + delimiter.size() - 1) {
+        carry.append(data);
+        return data.size();
+    }
+
+    std::string content = std::move(carry);
+    carry.clear();
+    if (!emitContent(content)) {
+        return data.size();
+    }
+    return 0;
+}
+
+size_t MultipartParser::consumeAfterBoundary(std::string_view data) {
+    for (size_t i = 0; i < data.size(); ++i) {
+        char c = data[i];
+        if (afterBoundary.empty()) {
+            if (c == '-' || c == '\r') {
+                afterBoundary.push_back(c);
+            } else if (c != ' ' && c != '\t') {  // 分隔符行末尾允许空白
+                fail("Malformed multipart boundary");
+                return data.size();
+            }
+        } else if (afterBoundary == "-" && c == '-') {
+            state = State::Done;
+            return i + 1;
+        } else if (afterBoundary == "\r" && c == '\n') {
+            // 部分头以分隔符行的CRLF开头，没有头时紧跟着空行
+            state = State::Headers;
+            headerBuffer = "\r\n";
+            return i + 1;
+        } else {
+            fail("Malformed multipart boundary");
+            return data.size();
+        }
+    }
+    return data.size();
+}
+
+size_t MultipartParser::consumeHeaders(std::string_view data) {
+    size_t oldSize = headerBuffer.size();
+    size_t limit = maxHeaderSize + 4;
+    size_t take = std::min(data.size(), limit - std::min(limit, oldSize));
+    headerBuffer.append(data.substr(0, take));
+
+    size_t end = headerBuffer.find("\r\n\r\n", oldSize >= 3 ? oldSize - 3 : 0);
+    if (end == std::string::npos) {
+        if (headerBuffer.size() >= limit) {
+            fail("Multipart part headers too large");
+            return data.size();
+        }
+        return take;
+    }
+
+    auto info = parsePartHeaders(end > 2 ? std::string_view(headerBuffer).substr(2, end - 2) : std::string_view());
+    size_t consumed = end + 4 - oldSize;
+    headerBuffer.clear();
+    state = State::Body;
+
+    if (callbacks.onPartBegin && !callbacks.onPartBegin(info)) {
+        fail("Multipart parsing aborted");
+        return data.size();
+    }
+    return consumed;
+}
+
+bool MultipartParser::emitContent(std::string_view data) {
+    if (state != State::Body || data.empty() || !callbacks.onPartData) {
+        return true;
+    }
+    if (!callbacks.onPartData({reinterpret_cast<const unsigned char*>(data.data()), data.size()})) {
+        return fail("Multipart parsing aborted");
+    }
+    return true;
+}
+
+bool MultipartParser::boundaryReached() {
+    if (state == State::Body && callbacks.onPartEnd && !callbacks.onPartEnd()) {
+        return fail("Multipart parsing aborted");
+    }
+    state = State::AfterBoundary;
+    afterBoundary.clear();
+    return true;
+}
+
+bool MultipartParser::fail(const std::string& message) {
+    if (state != State::Error) {
+        state = State::Error;
+        errorMessage = message;
+    }
+    return false;
+}
+
+UploadedPart::~UploadedPart() {
+    removeSpillFile();
+}
+
+UploadedPart::UploadedPart(UploadedPart&& other) noexcept {
+    *this = std::move(other);
+}
+
+UploadedPart& UploadedPart::operator=(UploadedPart&& other) noexcept {
+    if (this != &other) {
+        removeSpillFile();
+        fieldName = std::move(other.fieldName);
+        contentType = std::move(other.contentType);
+        filename = std::move(other.filename);
+        mimeType = std::move(other.mimeType);
+        contentHash = std::move(other.contentHash);
+        size = other.size;
+        data = other.data;
+        spillPath = std::move(other.spillPath);
+        // vector移动后数据地址不变，指向自有缓冲区的data仍然有效
+        buffer = std::move(other.buffer);
+        other.data = {};
+        other.spillPath.clear();
+    }
+    return *this;
+}
+
+void UploadedPart::removeSpillFile() {
+    if (!spillPath.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(spillPath, ec);
+        spillPath.clear();
+    }
+}
+
+std::optional<std::span<const unsigned char>> UploadedPart::content() {
+    if (!spilled()) {
+        return data;
+    }
+    if (buffer.empty() && size > 0) {
+        auto contents = readFileContents(spillPath);
+        if (!contents) {
+            return std::nullopt;
+        }
+        buffer = std::move(*contents);
+    }
+    return std::span<const unsigned char>(buffer);
+}
+
+UploadReceiver::UploadReceiver(std::string boundary, UploadOptions options, PartHandler onPart)
+    : options(std::move(options)),
+      onPart(std::move(onPart)),
+      parser(std::move(boundary), {
+          [this](const MultipartPartInfo& info) { return beginPart(info); },
+          [this](std::span<const unsigned char> chunk) { return appendData(chunk); },
+          [this]() { return endPart(); }
+      }) {
+    if (this->options.spillDirectory.empty()) {
+        this->options.spillDirectory = std::filesystem::temp_directory_path();
+    }
+}
+
+bool UploadReceiver::feed(std::string_view chunk) {
+    feedBegin = reinterpret_cast<const unsigned char*>(chunk.data());
+    feedEnd = feedBegin + chunk.size();
+    bool ok = parser.feed(chunk) && errorMessage.empty();
+
+    // 跨越多次送入的部分不能继续引用本次的数据
+    if (ok && receiving) {
+        keepInBuffer();
+        if (current.buffer.size() > options.spillThreshold && !spill()) {
+            ok = false;
+        }
+    }
+    feedBegin = nullptr;
+    feedEnd = nullptr;
+    return ok;
+}
+
+const std::string& UploadReceiver::error() const {
+    return errorMessage.empty() ? parser.error() : errorMessage;
+}
+
+bool UploadReceiver::beginPart(const MultipartPartInfo& info) {
+    // 没有文件名的普通表单字段不接收
+    receiving = !info.filename.empty();
+    if (!receiving) {
+        return true;
+    }
+
+    if (files >= options.maxFiles) {
+        errorMessage = "Too many files in one request (limit " + std::to_string(options.maxFiles) + ")";
+        return false;
+    }
+
+    current = UploadedPart();
+    sniff.clear();
+    current.fieldName = info.name;
+    current.filename = std::filesystem::path(info.filename).filename().string();
+    current.contentType = info.contentType;
+    hasher = options.hashContent ? std::make_unique<ContentHasher>() : nullptr;
+    return true;
+}
+
+bool UploadReceiver::appendData(std::span<const unsigned char> chunk) {
+    if (!receiving) {
+        return true;
+    }
+
+    if (hasher) {
+        hasher->update(chunk);
+    }
+
+    // 识别格式只需要开头的几个字节，在前几块到达时完成
+    if (sniff.size() < SNIFF_SIZE) {
+        sniff.insert(sniff.end(), chunk.begin(), chunk.begin() + std::min(chunk.size(), SNIFF_SIZE - sniff.size()));
+        current.mimeType = detectMimeType(sniff, current.filename);
+    }
+
+    current.size += chunk.size();
+
+    if (spillFile.is_open()) {
+        spillFile.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+        if (!spillFile) {
+            errorMessage = "Failed to write upload to " + current.spillPath.string();
+            return false;
+        }
+        return true;
+    }
+
+    const unsigned char* chunkEnd = chunk.data() + chunk.size();
+    if (current.size == chunk.size() && chunk.data() >= feedBegin && chunkEnd <= feedEnd) {
+        // 第一块直接引用接收缓冲区
+        current.data = chunk;
+    } else {
+        // 内容分多次到达或来自解析器暂存的字节时才复制到自有缓冲区
+        keepInBuffer();
+        current.buffer.insert(current.buffer.end(), chunk.begin(), chunk.end());
+        current.data = current.buffer;
+    }
+
+    // 引用接收缓冲区的内容不占用额外内存，只有自有缓冲区超过阈值时才落盘
+    if (current.buffer.size() > options.spillThreshold) {
+        return spill();
+    }
+    return true;
+}
+
+void UploadReceiver::keepInBuffer() {
+    if (!current.data.empty() && current.buffer.empty()) {
+        current.buffer.assign(current.data.begin(), current.data.end());
+        current.data = current.buffer;
+    }
+}
+
+bool UploadReceiver::spill() {
+    current.spillPath = options.spillDirectory / (SPILL_PREFIX + generateUuid() + SPILL_SUFFIX);
+    spillFile.open(current.spillPath, std::ios::binary | std::ios::trunc);
+    if (spillFile) {
+        spillFile.write(reinterpret_cast<const char*>(current.data.data()),
+                        static_cast<std::streamsize>(current.data.size()));
+    }
+    if (!spillFile) {
+        errorMessage = "Failed to write upload to " + current.spillPath.string();
+        return false;
+    }
+
+    Logger::get()->debug("Upload {} buffered more than {} bytes, spilled to {}", current.filename,
+                         options.spillThreshold, current.spillPath.string());
+    current.data = {};
+    current.buffer.clear();
+    current.buffer.shrink_to_fit();
+    return true;
+}
+
+bool UploadReceiver::endPart() {
+    if (!receiving) {
+        return true;
+    }
+    receiving = false;
+
+    if (spillFile.is_open()) {
+        spillFile.close();
+        if (!spillFile) {
+            errorMessage = "Failed to write upload to " + current.spillPath.string();
+            return false;
+        }
+    }
+
+    if (current.mimeType.empty()) {
+        current.mimeType = detectMimeType(std::span<const unsigned char>(), current.filename);
+    }
+    if (hasher) {
+        current.contentHash = hasher->hexDigest();
+        hasher.reset();
+    }
+
+    ++files;
+    if (onPart) {
+        onPart(std::move(current));
+    }
+    current = UploadedPart();
+    return true;
+}
+
+} // namespace ImageForensics
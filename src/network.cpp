@@ -5,36 +5,188 @@
 #include <pistache/http.h>
 #include <pistache/mime.h>
 #include <spdlog/spdlog.h>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sys/un.h>
 
 namespace ImageForensics {
 
-NetworkServer::NetworkServer() {
+ServerOptions ServerOptions::fromConfig() {
+    ServerOptions options;
+    options.host = Config::get<std::string>("server.host", options.host);
+    options.port = Config::get<int>("server.port", options.port);
+    options.listenTcp = Config::get<bool>("server.listen_tcp", options.listenTcp);
+    options.unixSocket = Config::get<std::string>("server.unix_socket", "");
+    // 权限以八进制字符串配置，如"0660"
+    auto mode = Config::get<std::string>("server.unix_socket_mode", "0660");
+    try {
+        options.unixSocketPerms = std::filesystem::perms(std::stoi(mode, nullptr, 8));
+    } catch (const std::exception&) {
+        Logger::get()->warn("Invalid server.unix_socket_mode '{}', using 0660", mode);
+    }
+    options.threads = Config::get<int>("server.threads", options.threads);
+    options.maxRequestSize = Config::get<size_t>("server.max_request_size", options.maxRequestSize);
+    options.maxResponseSize = Config::get<size_t>("server.max_response_size", options.maxResponseSize);
+    options.backlog = Config::get<int>("server.backlog", options.backlog);
+    options.headerTimeout = std::chrono::seconds(Config::get<int>("server.header_timeout", 60));
+    options.bodyTimeout = std::chrono::seconds(Config::get<int>("server.body_timeout", 60));
+    options.keepaliveTimeout = std::chrono::seconds(Config::get<int>("server.keepalive_timeout", 600));
+    options.reusePort = Config::get<bool>("server.reuse_port", options.reusePort);
+    options.noDelay = Config::get<bool>("server.tcp_nodelay", options.noDelay);
+    options.routeBodyLimits = Config::get<std::map<std::string, size_t>>("server.route_limits", {});
+    options.rateLimit = RateLimitOptions::fromConfig();
+    options.drainDelay = std::chrono::seconds(Config::get<int>("server.drain_delay", 0));
+    options.drainTimeout = std::chrono::seconds(Config::get<int>("server.drain_timeout", 30));
+    return options;
+}
+
+ControlPlaneOptions ControlPlaneOptions::fromConfig() {
+    ControlPlaneOptions options;
+    options.host = Config::get<std::string>("control.host", options.host);
+    options.port = Config::get<int>("control.port", options.port);
+    options.maxQueueDepth = Config::get<size_t>("control.max_queue_depth", options.maxQueueDepth);
+    return options;
+}
+
+size_t ServerOptions::bodyLimitFor(const std::string& path) const {
+    auto it = routeBodyLimits.find(path);
+    return it != routeBodyLimits.end() ? it->second : maxRequestSize;
+}
+
+size_t ServerOptions::endpointRequestLimit() const {
+    size_t limit = maxRequestSize;
+    for (const auto& [path, routeLimit] : routeBodyLimits) {
+        limit = std::max(limit, routeLimit);
+    }
+    return limit;
+}
+
+/**
+ * @brief 排空状态，由服务器和处理中的请求共享
+ */
+struct NetworkServer::DrainState {
+    std::atomic<bool> ready{true};
+    std::atomic<bool> draining{false};
+    std::atomic<size_t> inFlight{0};
+    std::atomic<uint64_t> total{0};
+    std::mutex mutex;
+    std::condition_variable idle;
+    
+    // 计数加一，返回的对象销毁时减一；排空期间最后一个请求完成时唤醒drain()
+    static std::shared_ptr<void> track(const std::shared_ptr<DrainState>& state) {
+        state->inFlight.fetch_add(1);
+        state->total.fetch_add(1, std::memory_order_relaxed);
+        return std::shared_ptr<void>(static_cast<void*>(state.get()), [state](void*) {
+            if (state->inFlight.fetch_sub(1) == 1 && state->draining.load()) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->idle.notify_all();
+            }
+        });
+    }
+};
+
+NetworkServer::NetworkServer(ServerOptions options)
+    : options(std::move(options)), drainState(std::make_shared<DrainState>()) {
     Logger::get()->info("Initializing network server");
+    if (this->options.rateLimit.enabled) {
+        rateLimiter = std::make_unique<RateLimiter>(this->options.rateLimit);
+    }
 }
 
 void NetworkServer::start(int port, int threads) {
-    auto addr = Pistache::Address(Pistache::Ipv4::any(), Pistache::Port(port));
-    
-    // 配置HTTP服务器
-    auto opts = Pistache::Http::Endpoint::options()
-        .threads(threads)
-        .flags(Pistache::Tcp::Options::ReuseAddr)
-        .maxRequestSize(1024 * 1024 * 10); // 10MB
-    
-    httpEndpoint = std::make_shared<Http::Endpoint>(addr);
-    httpEndpoint->init(opts);
+    options.port = port;
+    options.threads = threads;
+    start();
+}
+
+void NetworkServer::start() {
+    if (!options.listenTcp && options.unixSocket.empty()) {
+        throw ImageForensicsException("Neither TCP nor a Unix domain socket is configured");
+    }
     
-    // 设置路由
-    httpEndpoint->setHandler(router.handler());
+    // 配置HTTP服务器；超出请求大小上限的请求在读取时即被拒绝，不会缓冲完整的请求体
+    auto endpointOptions = [this](Pistache::Tcp::Options flags) {
+        return Pistache::Http::Endpoint::options()
+            .threads(options.threads)
+            .flags(flags)
+            .backlog(options.backlog)
+            .maxRequestSize(options.endpointRequestLimit())
+            .maxResponseSize(options.maxResponseSize)
+            .headerTimeout(options.headerTimeout)
+            .bodyTimeout(options.bodyTimeout)
+            .keepaliveTimeout(options.keepaliveTimeout);
+    };
     
-    // 启动服务器
-    httpEndpoint->serve();
+    if (options.listenTcp) {
+        auto addr = Pistache::Address(options.host, Pistache::Port(static_cast<uint16_t>(options.port)));
+        
+        auto flags = Pistache::Tcp::Options::ReuseAddr;
+        if (options.reusePort) {
+            flags = flags | Pistache::Tcp::Options::ReusePort;
+        }
+        if (options.noDelay) {
+            flags = flags | Pistache::Tcp::Options::NoDelay;
+        }
+        
+        httpEndpoint = std::make_shared<Http::Endpoint>(addr);
+        httpEndpoint->init(endpointOptions(flags));
+        httpEndpoint->setHandler(router.handler());
+        httpEndpoint->serveThreaded();
+        
+        Logger::get()->info("Server started on {}:{} (max request {} bytes, keep-alive {}s)", options.host,
+                            options.port, options.endpointRequestLimit(), options.keepaliveTimeout.count());
+    }
     
-    Logger::get()->info("Server started on port {}", port);
+    // 同一台主机上的调用方通过Unix域套接字访问，不经过TCP协议栈
+    if (!options.unixSocket.empty()) {
+        // Pistache按路径中的'/'识别Unix域地址，统一使用绝对路径
+        options.unixSocket = std::filesystem::absolute(options.unixSocket);
+        if (options.unixSocket.native().size() >= sizeof(sockaddr_un::sun_path)) {
+            throw ImageForensicsException("Unix socket path too long: " + options.unixSocket.string());
+        }
+        
+        // 上次运行留下的套接字文件会使bind失败；不删除其他类型的文件
+        std::error_code ec;
+        if (std::filesystem::is_socket(options.unixSocket, ec)) {
+            std::filesystem::remove(options.unixSocket, ec);
+        }
+        
+        // TCP选项对Unix域套接字没有意义
+        unixEndpoint = std::make_shared<Http::Endpoint>(Pistache::Address(options.unixSocket.string()));
+        unixEndpoint->init(endpointOptions(Pistache::Tcp::Options::None));
+        unixEndpoint->setHandler(router.handler());
+        unixEndpoint->serveThreaded();
+        
+        std::filesystem::permissions(options.unixSocket, options.unixSocketPerms, ec);
+        if (ec) {
+            Logger::get()->warn("Failed to set permissions on {}: {}", options.unixSocket.string(), ec.message());
+        }
+        Logger::get()->info("Server listening on Unix socket {}", options.unixSocket.string());
+    }
 }
 
 void NetworkServer::registerRoute(const std::string& path, Http::Method method, 
                                 Rest::Route::Handler handler) {
+    addRoute(path, method, [handler = std::move(handler)](const Rest::Request& request, Http::ResponseWriter response,
+                                                         DetachedTask::Scope) {
+        return handler(request, std::move(response));
+    });
+}
+
+void NetworkServer::registerAsyncRoute(const std::string& path, Http::Method method,
+                                     AsyncHandler handler) {
+    addRoute(path, method, [handler = std::move(handler)](const Rest::Request& request, Http::ResponseWriter response,
+                                                         DetachedTask::Scope scope) {
+        // 协程在第一个co_await处挂起后立即返回，反应器线程不等待处理结果
+        handler(request, std::move(response), std::move(scope));
+        return Rest::Route::Result::Ok;
+    });
+}
+
+void NetworkServer::addRoute(const std::string& path, Http::Method method, ScopedHandler handler) {
     auto methodStr = [&method]() {
         switch (method) {
             case Http::Method::Get: return "GET";
@@ -47,19 +199,91 @@ void NetworkServer::registerRoute(const std::string& path, Http::Method method,
     
     Logger::get()->info("Registering route: {} {}", methodStr, path);
     
+    // 路由的上限低于端点上限时，在处理器开始工作之前检查请求大小
+    size_t bodyLimit = options.bodyLimitFor(path);
+    if (bodyLimit < options.endpointRequestLimit()) {
+        handler = [handler = std::move(handler), bodyLimit, path](const Rest::Request& request, Http::ResponseWriter response,
+                                                                  DetachedTask::Scope scope) {
+            auto contentLength = request.headers().tryGet<Http::Header::ContentLength>();
+            uint64_t size = contentLength ? contentLength->value() : request.body().size();
+            if (size > bodyLimit) {
+                Logger::get()->warn("Rejecting {} byte request to {} (limit {})", size, path, bodyLimit);
+                nlohmann::json error = {
+                    {"status", "error"},
+                    {"message", "Request body too large"}
+                };
+                response.send(Http::Code::Payload_Too_Large, error.dump(), MIME(Application, Json));
+                return Rest::Route::Result::Ok;
+            }
+            return handler(request, std::move(response), std::move(scope));
+        };
+    }
+    
+    // 限流在大小检查之前执行，被拒绝的请求只花费一次哈希和一次CAS
+    if (rateLimiter && !options.rateLimit.isExempt(path)) {
+        handler = [handler = std::move(handler), limiter = rateLimiter.get(),
+                   rateLimit = options.rateLimit](const Rest::Request& request, Http::ResponseWriter response,
+                                                  DetachedTask::Scope scope) {
+            // 只有配置过的API密钥按密钥限流，否则按客户端IP
+            auto header = rateLimit.keyHeader.empty() ? std::nullopt : request.headers().tryGetRaw(rateLimit.keyHeader);
+            std::optional<std::string_view> apiKey;
+            if (header) {
+                apiKey = header->value();
+            }
+            std::string client = rateLimit.clientKey(request.address().host(), apiKey);
+            
+            auto result = limiter->acquire(client);
+            if (!result.allowed) {
+                auto retryAfter = std::chrono::ceil<std::chrono::seconds>(result.retryAfter);
+                nlohmann::json error = {
+                    {"status", "error"},
+                    {"message", "Rate limit exceeded"}
+                };
+                response.headers().addRaw(Http::Header::Raw("Retry-After", std::to_string(retryAfter.count())));
+                response.send(Http::Code::Too_Many_Requests, error.dump(), MIME(Application, Json));
+                return Rest::Route::Result::Ok;
+            }
+            return handler(request, std::move(response), std::move(scope));
+        };
+    }
+    
+    // 处理中的请求持有一个计数，异步路由的协程帧持有到协程结束；排空期间新的请求返回503。
+    // 先计数再检查排空标志，与drain()先设置标志再检查计数相对应，不会漏掉同时到达的请求
+    Rest::Route::Handler routeHandler;
+    const auto& exempt = options.drainExemptPaths;
+    if (std::find(exempt.begin(), exempt.end(), path) == exempt.end()) {
+        routeHandler = [handler = std::move(handler), state = drainState](const Rest::Request& request, Http::ResponseWriter response) {
+            auto scope = DrainState::track(state);
+            if (state->draining.load()) {
+                scope.reset();
+                nlohmann::json error = {
+                    {"status", "error"},
+                    {"message", "Server is shutting down"}
+                };
+                response.send(Http::Code::Service_Unavailable, error.dump(), MIME(Application, Json));
+                return Rest::Route::Result::Ok;
+            }
+            return handler(request, std::move(response), std::move(scope));
+        };
+    } else {
+        routeHandler = [handler = std::move(handler)](const Rest::Request& request, Http::ResponseWriter response) {
+            return handler(request, std::move(response), nullptr);
+        };
+    }
+    
     // 根据HTTP方法使用不同的路由注册方法
     switch (method) {
         case Http::Method::Get:
-            Rest::Routes::Get(router, path, handler);
+            Rest::Routes::Get(router, path, routeHandler);
             break;
         case Http::Method::Post:
-            Rest::Routes::Post(router, path, handler);
+            Rest::Routes::Post(router, path, routeHandler);
             break;
         case Http::Method::Put:
-            Rest::Routes::Put(router, path, handler);
+            Rest::Routes::Put(router, path, routeHandler);
             break;
         case Http::Method::Delete:
-            Rest::Routes::Delete(router, path, handler);
+            Rest::Routes::Delete(router, path, routeHandler);
             break;
         default:
             Logger::get()->error("Unsupported HTTP method");
@@ -67,9 +291,131 @@ void NetworkServer::registerRoute(const std::string& path, Http::Method method,
     }
 }
 
+void NetworkServer::beginDrain() {
+    if (drainState->ready.exchange(false)) {
+        Logger::get()->info("Server marked not ready, {} requests in flight", inFlightRequests());
+    }
+}
+
+bool NetworkServer::drain(std::chrono::milliseconds timeout) {
+    beginDrain();
+    drainState->draining.store(true);
+    
+    std::unique_lock<std::mutex> lock(drainState->mutex);
+    bool drained = drainState->idle.wait_for(lock, timeout, [this]() {
+        return drainState->inFlight.load() == 0;
+    });
+    if (drained) {
+        Logger::get()->info("All in-flight requests completed");
+    } else {
+        Logger::get()->warn("Drain timed out with {} requests in flight", drainState->inFlight.load());
+    }
+    return drained;
+}
+
+void NetworkServer::updateRateLimit(const RateLimitOptions& rateLimit) {
+    if (!rateLimiter) {
+        if (rateLimit.enabled) {
+            Logger::get()->warn("Rate limiting was disabled at startup; enabling it requires a restart");
+        }
+        return;
+    }
+    rateLimiter->setRate(rateLimit.requestsPerMinute, rateLimit.burst);
+}
+
+bool NetworkServer::isReady() const {
+    return drainState->ready.load();
+}
+
+size_t NetworkServer::inFlightRequests() const {
+    return drainState->inFlight.load();
+}
+
+uint64_t NetworkServer::totalRequests() const {
+    return drainState->total.load(std::memory_order_relaxed);
+}
+
 void NetworkServer::shutdown() {
     Logger::get()->info("Shutting down server");
-    httpEndpoint->shutdown();
+    if (httpEndpoint) {
+        httpEndpoint->shutdown();
+    }
+    if (unixEndpoint) {
+        unixEndpoint->shutdown();
+        std::error_code ec;
+        std::filesystem::remove(options.unixSocket, ec);
+    }
+}
+
+namespace {
+
+// 控制面路由只读取计数和原子状态，不经过工作线程池
+template<typename Add>
+void addControlRoutes(const HealthMonitor& monitor, Add&& add) {
+    // 存活检查：只要能响应即为存活
+    add("/health", [&monitor](const Rest::Request&, Http::ResponseWriter response) {
+        nlohmann::json result = {
+            {"status", "ok"},
+            {"version", "1.0.0"},
+            {"uptime", monitor.uptime().count()}
+        };
+        response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
+        return Rest::Route::Result::Ok;
+    });
+    
+    // 就绪检查：正在关闭或过载时返回503，负载均衡器据此停止转发新的请求
+    add("/ready", [&monitor](const Rest::Request&, Http::ResponseWriter response) {
+        auto reason = monitor.notReadyReason();
+        nlohmann::json result = {
+            {"status", reason.value_or("ready")}
+        };
+        response.send(reason ? Http::Code::Service_Unavailable : Http::Code::Ok, result.dump(), MIME(Application, Json));
+        return Rest::Route::Result::Ok;
+    });
+    
+    add("/metrics", [&monitor](const Rest::Request&, Http::ResponseWriter response) {
+        response.send(Http::Code::Ok, monitor.renderMetrics(), MIME(Text, Plain));
+        return Rest::Route::Result::Ok;
+    });
+}
+
+} // namespace
+
+ControlPlaneServer::ControlPlaneServer(ControlPlaneOptions options, const HealthMonitor& monitor)
+    : options(std::move(options)), monitor(monitor) {
+    addControlRoutes(monitor, [this](const std::string& path, Rest::Route::Handler handler) {
+        Rest::Routes::Get(router, path, std::move(handler));
+    });
+}
+
+void ControlPlaneServer::start() {
+    auto addr = Pistache::Address(options.host, Pistache::Port(static_cast<uint16_t>(options.port)));
+    
+    // 一个反应器线程足够，控制面请求都很小，不需要长时间保持连接
+    endpoint = std::make_shared<Http::Endpoint>(addr);
+    endpoint->init(Pistache::Http::Endpoint::options()
+                       .threads(1)
+                       .flags(Pistache::Tcp::Options::ReuseAddr)
+                       .maxRequestSize(4096)
+                       .headerTimeout(std::chrono::seconds(5))
+                       .bodyTimeout(std::chrono::seconds(5)));
+    endpoint->setHandler(router.handler());
+    endpoint->serveThreaded();
+    
+    Logger::get()->info("Control plane listening on {}:{}", options.host, options.port);
+}
+
+void ControlPlaneServer::shutdown() {
+    if (endpoint) {
+        endpoint->shutdown();
+        endpoint.reset();
+    }
+}
+
+void ControlPlaneServer::registerRoutes(NetworkServer& server, const HealthMonitor& monitor) {
+    addControlRoutes(monitor, [&server](const std::string& path, Rest::Route::Handler handler) {
+        server.registerRoute(path, Http::Method::Get, std::move(handler));
+    });
 }
 
 } // namespace ImageForensics 
\ No newline at end of file
@@ -0,0 +1,287 @@
+#include "peer_cache.hpp"
+#include "util.hpp"
+#include <spdlog/spdlog.h>
+#include <curl/curl.h>
+#include <algorithm>
+#include <memory>
+
+namespace ImageForensics {
+
+namespace {
+
+// FNV-1a 64位加混合，所有实例必须对同一个键得到相同的结果，不能使用随编译选项变化的内容哈希
+uint64_t ringHash(std::string_view data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+std::string normalizeAddress(std::string address) {
+    while (!address.empty() && address.back() == '/') {
+        address.pop_back();
+    }
+    return address;
+}
+
+PeerCacheOptions normalizeOptions(PeerCacheOptions options) {
+    options.self = normalizeAddress(options.self);
+    for (auto& peer : options.peers) {
+        peer = normalizeAddress(peer);
+    }
+    return options;
+}
+
+// 环上的成员：所有对等实例加上本实例
+std::vector<std::string> ringMembers(const PeerCacheOptions& options) {
+    std::vector<std::string> members = options.peers;
+    members.push_back(options.self);
+    return members;
+}
+
+size_t appendBody(char* data, size_t size, size_t count, void* userdata) {
+    static_cast<std::string*>(userdata)->append(data, size * count);
+    return size * count;
+}
+
+// curl句柄不能并发使用，每个线程复用自己的句柄以保持与对等实例的连接
+struct CurlHandle {
+    CURL* handle = curl_easy_init();
+
+    ~CurlHandle() {
+        if (handle) {
+            curl_easy_cleanup(handle);
+        }
+    }
+};
+
+CURL* threadCurlHandle() {
+    thread_local CurlHandle instance;
+    return instance.handle;
+}
+
+} // namespace
+
+ConsistentHashRing::ConsistentHashRing(std::vector<std::string> nodes, size_t virtualNodes)
+    : nodes(std::move(nodes)) {
+    std::sort(this->nodes.begin(), this->nodes.end());
+    this->nodes.erase(std::unique(this->nodes.begin(), this->nodes.end()), this->nodes.end());
+
+    virtualNodes = std::max<size_t>(1, virtualNodes);
+    points.reserve(this->nodes.size() * virtualNodes);
+    for (size_t node = 0; node < this->nodes.size(); ++node) {
+        for (size_t i = 0; i < virtualNodes; ++i) {
+            points.emplace_back(ringHash(this->nodes[node] + "#" + std::to_string(i)), node);
+        }
+    }
+    std::sort(points.begin(), points.end());
+}
+
+const std::string* ConsistentHashRing::nodeFor(std::string_view key) const {
+    if (points.empty()) {
+        return nullptr;
+    }
+
+    // 顺时针方向第一个虚拟节点，越过末尾时回到开头
+    uint64_t hash = ringHash(key);
+    auto it = std::lower_bound(points.begin(), points.end(), std::make_pair(hash, size_t(0)));
+    if (it == points.end()) {
+        it = points.begin();
+    }
+    return &nodes[it->second];
+}
+
+PeerCache::PeerCache(PeerCacheOptions options)
+    : options(normalizeOptions(std::move(options))),
+      ring(ringMembers(this->options), this->options.virtualNodes),
+      pushQueue(this->options.pushQueueSize) {
+    static std::once_flag curlInit;
+    std::call_once(curlInit, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+    pushThread = std::thread(&PeerCache::pushLoop, this);
+
+    Logger::get()->info("Peer cache enabled: {} instances, this instance is {}", ring.size(), this->options.self);
+}
+
+PeerCache::~PeerCache() {
+    pushQueue.close();
+    if (pushThread.joinable()) {
+        pushThread.join();
+    }
+}
+
+std::optional<std::string> PeerCache::ownerOf(const std::string& key) const {
+    const std::string* owner = ring.nodeFor(key);
+    if (!owner || *owner == options.self) {
+        return std::nullopt;
+    }
+    return *owner;
+}
+
+std::optional<std::string> PeerCache::fetch(const std::string& key) {
+    auto owner = ownerOf(key);
+    if (!owner || !isAvailable(*owner)) {
+        return std::nullopt;
+    }
+
+    auto result = request("GET", *owner, key);
+    if (!result || result->status != 200) {
+        return std::nullopt;
+    }
+
+    Logger::get()->debug("Peer cache hit for {} from {}", key, *owner);
+    return std::move(result->body);
+}
+
+void PeerCache::push(const std::string& key, std::string entry) {
+    if (!ownerOf(key)) {
+        return;
+    }
+
+    // 回填是尽力而为的，队列满时丢弃，不阻塞请求
+    if (!pushQueue.tryPush({key, std::move(entry)})) {
+        Logger::get()->debug("Peer push queue full, dropping {}", key);
+    }
+}
+
+bool PeerCache::authorize(const std::optional<std::string>& token) const {
+    if (options.secret.empty() || !token) {
+        return false;
+    }
+    
+    // 逐字节累积差异，比较时间不随第一个不同字节的位置变化
+    const std::string& secret = options.secret;
+    unsigned char diff = token->size() == secret.size() ? 0 : 1;
+    for (size_t i = 0; i < token->size(); ++i) {
+        diff |= static_cast<unsigned char>((*token)[i] ^ secret[i % secret.size()]);
+    }
+    return diff == 0;
+}
+
+std::string PeerCache::encodeKey(const std::string& key) {
+    static constexpr char HEX[] = "0123456789abcdef";
+    std::string encoded;
+    encoded.reserve(key.size() * 2);
+    for (unsigned char c : key) {
+        encoded.push_back(HEX[c >> 4]);
+        encoded.push_back(HEX[c & 0x0f]);
+    }
+    return encoded;
+}
+
+std::optional<std::string> PeerCache::decodeKey(const std::string& encoded) {
+    if (encoded.size() % 2 != 0) {
+        return std::nullopt;
+    }
+
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+
+    std::string key;
+    key.reserve(encoded.size() / 2);
+    for (size_t i = 0; i < encoded.size(); i += 2) {
+        int high = nibble(encoded[i]);
+        int low = nibble(encoded[i + 1]);
+        if (high < 0 || low < 0) {
+            return std::nullopt;
+        }
+        key.push_back(static_cast<char>((high << 4) | low));
+    }
+    return key;
+}
+
+std::optional<PeerCache::HttpResult> PeerCache::request(const std::string& method, const std::string& peer,
+                                                        const std::string& key, const std::string& body) {
+    CURL* curl = threadCurlHandle();
+    if (!curl) {
+        return std::nullopt;
+    }
+    curl_easy_reset(curl);
+
+    std::string url = peer + "/internal/cache/" + encodeKey(key);
+    HttpResult result;
+
+    struct curl_slist* headers = nullptr;
+    if (!options.secret.empty()) {
+        headers = curl_slist_append(headers, (std::string(TOKEN_HEADER) + ": " + options.secret).c_str());
+    }
+    if (method == "PUT") {
+        headers = curl_slist_append(headers, "Content-Type: application/octet-stream");
+    }
+    std::unique_ptr<curl_slist, decltype(&curl_slist_free_all)> headerGuard(headers, curl_slist_free_all);
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(options.timeout.count()));
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(options.timeout.count()));
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendBody);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result.body);
+    if (headers) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+    if (method == "PUT") {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.data());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(body.size()));
+    }
+
+    CURLcode code = curl_easy_perform(curl);
+    if (code != CURLE_OK) {
+        Logger::get()->warn("Peer {} request for {} failed: {}", peer, key, curl_easy_strerror(code));
+        markFailed(peer);
+        return std::nullopt;
+    }
+
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.status);
+    if (result.status >= 500) {
+        markFailed(peer);
+    }
+    return result;
+}
+
+bool PeerCache::isAvailable(const std::string& peer) {
+    std::lock_guard<std::mutex> lock(failureMutex);
+    auto it = failedUntil.find(peer);
+    if (it == failedUntil.end()) {
+        return true;
+    }
+    if (std::chrono::steady_clock::now() >= it->second) {
+        failedUntil.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void PeerCache::markFailed(const std::string& peer) {
+    // 实例不可用时在一段时间内直接跳过，避免每个请求都等待超时
+    std::lock_guard<std::mutex> lock(failureMutex);
+    failedUntil[peer] = std::chrono::steady_clock::now() + options.retryAfter;
+}
+
+void PeerCache::pushLoop() {
+    while (auto item = pushQueue.pop()) {
+        auto& [key, entry] = *item;
+        auto owner = ownerOf(key);
+        if (!owner || !isAvailable(*owner)) {
+            continue;
+        }
+
+        auto result = request("PUT", *owner, key, entry);
+        if (result && result->status >= 400) {
+            Logger::get()->debug("Peer {} rejected {} (HTTP {})", *owner, key, result->status);
+        }
+    }
+}
+
+} // namespace ImageForensics
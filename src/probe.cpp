@@ -0,0 +1,245 @@
+#include "probe.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace ImageForensics {
+
+namespace {
+
+uint16_t readBe16(std::span<const unsigned char> data, size_t pos) {
+    return static_cast<uint16_t>((data[pos] << 8) | data[pos + 1]);
+}
+
+uint32_t readBe32(std::span<const unsigned char> data, size_t pos) {
+    return (static_cast<uint32_t>(data[pos]) << 24) | (static_cast<uint32_t>(data[pos + 1]) << 16) |
+           (static_cast<uint32_t>(data[pos + 2]) << 8) | data[pos + 3];
+}
+
+uint16_t readLe16(std::span<const unsigned char> data, size_t pos) {
+    return static_cast<uint16_t>(data[pos] | (data[pos + 1] << 8));
+}
+
+uint32_t readLe32(std::span<const unsigned char> data, size_t pos) {
+    return data[pos] | (static_cast<uint32_t>(data[pos + 1]) << 8) | (static_cast<uint32_t>(data[pos + 2]) << 16) |
+           (static_cast<uint32_t>(data[pos + 3]) << 24);
+}
+
+// 解析TIFF结构的IFD0，TIFF文件和JPEG的EXIF段共用；只读取尺寸和方向三个标签
+void parseTiffIfd0(std::span<const unsigned char> tiff, ProbeResult& result, bool readDimensions) {
+    if (tiff.size() < 8) {
+        return;
+    }
+
+    bool littleEndian = tiff[0] == 'I' && tiff[1] == 'I';
+    if (!littleEndian && !(tiff[0] == 'M' && tiff[1] == 'M')) {
+        return;
+    }
+    auto u16 = [&](size_t pos) { return littleEndian ? readLe16(tiff, pos) : readBe16(tiff, pos); };
+    auto u32 = [&](size_t pos) { return littleEndian ? readLe32(tiff, pos) : readBe32(tiff, pos); };
+
+    // BigTIFF（43）的偏移是64位的，这里不支持
+    if (u16(2) != 42) {
+        return;
+    }
+
+    uint64_t ifdOffset = u32(4);
+    if (ifdOffset + 2 > tiff.size()) {
+        return;
+    }
+
+    uint16_t count = u16(static_cast<size_t>(ifdOffset));
+    for (uint16_t i = 0; i < count; ++i) {
+        size_t entry = static_cast<size_t>(ifdOffset) + 2 + static_cast<size_t>(i) * 12;
+        if (entry + 12 > tiff.size()) {
+            break;
+        }
+
+        uint16_t tag = u16(entry);
+        uint16_t type = u16(entry + 2);
+        uint32_t value = 0;
+        if (type == 3) {         // SHORT
+            value = u16(entry + 8);
+        } else if (type == 4) {  // LONG
+            value = u32(entry + 8);
+        } else {
+            continue;
+        }
+
+        if (tag == 0x0100 && readDimensions) {
+            result.width = value;
+        } else if (tag == 0x0101 && readDimensions) {
+            result.height = value;
+        } else if (tag == 0x0112 && value >= 1 && value <= 8) {
+            result.orientation = static_cast<uint16_t>(value);
+        }
+    }
+}
+
+// SOF0-SOF15，排除同一区间内的DHT（C4）、JPG（C8）和DAC（CC）
+bool isStartOfFrame(uint8_t marker) {
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+void probeJpeg(std::span<const unsigned char> data, ProbeResult& result) {
+    static constexpr std::array<unsigned char, 6> EXIF_HEADER = {'E', 'x', 'i', 'f', 0, 0};
+
+    size_t pos = 2;
+    while (pos + 4 <= data.size()) {
+        if (data[pos] != 0xFF) {
+            return;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {  // 填充字节
+            ++pos;
+            continue;
+        }
+        pos += 2;
+
+        // 没有长度字段的独立标记
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            continue;
+        }
+        // 到达扫描数据或图像结尾仍未找到SOF
+        if (marker == 0xD9 || marker == 0xDA) {
+            return;
+        }
+
+        uint16_t length = readBe16(data, pos);
+        if (length < 2) {
+            return;
+        }
+        size_t segment = pos + 2;
+        size_t segmentEnd = pos + length;
+
+        if (isStartOfFrame(marker)) {
+            // 精度(1) 高度(2) 宽度(2)
+            if (segment + 5 <= data.size()) {
+                result.height = readBe16(data, segment + 1);
+                result.width = readBe16(data, segment + 3);
+            }
+            return;
+        }
+
+        if (marker == 0xE1 && segment + EXIF_HEADER.size() <= data.size() &&
+            std::equal(EXIF_HEADER.begin(), EXIF_HEADER.end(), data.begin() + segment)) {
+            size_t tiffStart = segment + EXIF_HEADER.size();
+            size_t tiffEnd = std::min(segmentEnd, data.size());
+            if (tiffStart < tiffEnd) {
+                parseTiffIfd0(data.subspan(tiffStart, tiffEnd - tiffStart), result, false);
+            }
+        }
+
+        pos = segmentEnd;
+    }
+}
+
+void probePng(std::span<const unsigned char> data, ProbeResult& result) {
+    // 签名(8) 长度(4) "IHDR"(4) 宽度(4) 高度(4)
+    if (data.size() >= 24 && std::memcmp(data.data() + 12, "IHDR", 4) == 0) {
+        result.width = readBe32(data, 16);
+        result.height = readBe32(data, 20);
+    }
+}
+
+void probeGif(std::span<const unsigned char> data, ProbeResult& result) {
+    // 逻辑屏幕描述符紧跟6字节的签名和版本
+    if (data.size() >= 10) {
+        result.width = readLe16(data, 6);
+        result.height = readLe16(data, 8);
+    }
+}
+
+void probeBmp(std::span<const unsigned char> data, ProbeResult& result) {
+    // 14字节的文件头之后是DIB头，第一个字段是DIB头的大小
+    if (data.size() < 26) {
+        return;
+    }
+
+    uint32_t dibSize = readLe32(data, 14);
+    if (dibSize == 12) {  // BITMAPCOREHEADER，16位无符号宽高
+        result.width = readLe16(data, 18);
+        result.height = readLe16(data, 20);
+    } else if (dibSize >= 40) {
+        // 有符号32位宽高，高度为负表示自上而下存储
+        auto width = static_cast<int64_t>(static_cast<int32_t>(readLe32(data, 18)));
+        auto height = static_cast<int64_t>(static_cast<int32_t>(readLe32(data, 22)));
+        if (width > 0 && height != 0) {
+            result.width = static_cast<uint32_t>(width);
+            result.height = static_cast<uint32_t>(height < 0 ? -height : height);
+        }
+    }
+}
+
+} // namespace
+
+json ProbeResult::toJson() const {
+    json result = {
+        {"mime_type", mimeType},
+        {"filesize", fileSize},
+        {"orientation", orientation}
+    };
+    if (hasDimensions()) {
+        result["width"] = width;
+        result["height"] = height;
+    }
+    return result;
+}
+
+std::optional<ProbeResult> probeImage(std::span<const unsigned char> header, uint64_t fileSize) {
+    auto data = header.first(std::min(header.size(), PROBE_WINDOW));
+
+    // 只按签名识别，不使用扩展名，否则后面的头部解析没有意义
+    ProbeResult result;
+    result.mimeType = detectMimeType(data);
+    result.fileSize = fileSize;
+
+    if (result.mimeType == "image/jpeg") {
+        probeJpeg(data, result);
+    } else if (result.mimeType == "image/png") {
+        probePng(data, result);
+    } else if (result.mimeType == "image/gif") {
+        probeGif(data, result);
+    } else if (result.mimeType == "image/tiff") {
+        parseTiffIfd0(data, result, true);
+    } else if (result.mimeType == "image/bmp") {
+        probeBmp(data, result);
+    } else {
+        return std::nullopt;
+    }
+
+    // 只找到一半的尺寸不可信
+    if (!result.hasDimensions()) {
+        result.width = 0;
+        result.height = 0;
+    }
+    return result;
+}
+
+std::optional<ProbeResult> probeImage(const std::filesystem::path& filePath) {
+    std::error_code ec;
+    uint64_t fileSize = std::filesystem::file_size(filePath, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+
+    std::vector<unsigned char> header(static_cast<size_t>(std::min<uint64_t>(fileSize, PROBE_WINDOW)));
+    file.read(reinterpret_cast<char*>(header.data()), static_cast<std::streamsize>(header.size()));
+    header.resize(static_cast<size_t>(file.gcount()));
+
+    return probeImage(header, fileSize);
+}
+
+bool exceedsPixelLimit(const ProbeResult& result, uint64_t maxPixels) {
+    return maxPixels != 0 && result.pixels() > maxPixels;
+}
+
+} // namespace ImageForensics
@@ -0,0 +1,121 @@
+#include "rate_limiter.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+
+namespace ImageForensics {
+
+namespace {
+
+uint64_t clientHash(std::string_view client) {
+    uint64_t hash = std::hash<std::string_view>()(client);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    // 0表示空槽位
+    return hash == 0 ? 1 : hash;
+}
+
+} // namespace
+
+RateLimitOptions RateLimitOptions::fromConfig() {
+    RateLimitOptions options;
+    options.enabled = Config::get<bool>("security.rate_limit.enabled", options.enabled);
+    options.requestsPerMinute = Config::get<double>("security.rate_limit.requests_per_minute", options.requestsPerMinute);
+    options.burst = Config::get<double>("security.rate_limit.burst", options.burst);
+    options.shards = Config::get<size_t>("security.rate_limit.shards", options.shards);
+    options.keyHeader = Config::get<std::string>("security.rate_limit.key_header", options.keyHeader);
+    options.exemptPaths = Config::get<std::vector<std::string>>("security.rate_limit.exempt_paths", options.exemptPaths);
+    auto apiKeys = Config::get<std::vector<std::string>>("security.rate_limit.api_keys", {});
+    options.apiKeys.insert(apiKeys.begin(), apiKeys.end());
+    return options;
+}
+
+bool RateLimitOptions::isExempt(std::string_view path) const {
+    return std::any_of(exemptPaths.begin(), exemptPaths.end(), [path](const std::string& prefix) {
+        return !prefix.empty() && path.substr(0, prefix.size()) == prefix;
+    });
+}
+
+std::string RateLimitOptions::clientKey(std::string_view address, std::optional<std::string_view> apiKey) const {
+    if (apiKey && apiKeys.count(std::string(*apiKey)) > 0) {
+        return "key:" + std::string(*apiKey);
+    }
+    return "ip:" + std::string(address);
+}
+
+RateLimiter::RateLimiter(const RateLimitOptions& options) : epoch(Clock::now()) {
+    size_t shardCount = std::bit_ceil(std::max<size_t>(options.shards, 1));
+    shardMask = shardCount - 1;
+    slots = std::make_unique<Slot[]>(shardCount * SLOTS_PER_SHARD);
+    Logger::get()->info("Rate limiting with {} client slots", shardCount * SLOTS_PER_SHARD);
+
+    setRate(options.requestsPerMinute, options.burst);
+}
+
+void RateLimiter::setRate(double requestsPerMinute, double burst) {
+    double rate = std::max(requestsPerMinute, 1e-3);
+    burst = std::max(burst > 0 ? burst : rate, 1.0);
+    uint64_t newInterval = std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(60e9 / rate)));
+
+    // 两个值分别更新，并发的请求最多按一新一旧的组合判断一次
+    interval.store(newInterval, std::memory_order_relaxed);
+    tolerance.store(static_cast<uint64_t>(std::llround(burst * static_cast<double>(newInterval))),
+                    std::memory_order_relaxed);
+
+    Logger::get()->info("Rate limit: {} requests/minute per client, burst {}", rate, burst);
+}
+
+RateLimitResult RateLimiter::acquire(std::string_view client) {
+    return acquire(client, Clock::now());
+}
+
+RateLimitResult RateLimiter::acquire(std::string_view client, Clock::time_point now) {
+    auto elapsed = std::max<Clock::duration>(now - epoch, Clock::duration::zero());
+    auto timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    return take(*slotFor(clientHash(client), timestamp), timestamp);
+}
+
+RateLimiter::Slot* RateLimiter::slotFor(uint64_t hash, uint64_t now) {
+    Slot* shard = &slots[(hash & shardMask) * SLOTS_PER_SHARD];
+    for (size_t i = 0; i < SLOTS_PER_SHARD; ++i) {
+        if (shard[i].key.load(std::memory_order_acquire) == hash) {
+            return &shard[i];
+        }
+    }
+
+    // 占用空槽位，或接管令牌桶已经装满的空闲客户端：装满的令牌桶没有需要保留的状态
+    for (size_t i = 0; i < SLOTS_PER_SHARD; ++i) {
+        Slot& slot = shard[i];
+        uint64_t key = slot.key.load(std::memory_order_acquire);
+        if (key != 0 && slot.full.load(std::memory_order_relaxed) > now) {
+            continue;
+        }
+        if (slot.key.compare_exchange_strong(key, hash, std::memory_order_acq_rel) || key == hash) {
+            return &slot;
+        }
+    }
+
+    return &overflow;
+}
+
+RateLimitResult RateLimiter::take(Slot& slot, uint64_t now) {
+    uint64_t interval = this->interval.load(std::memory_order_relaxed);
+    uint64_t tolerance = this->tolerance.load(std::memory_order_relaxed);
+    uint64_t full = slot.full.load(std::memory_order_relaxed);
+    while (true) {
+        // 惰性补充：full早于now时令牌桶已满，从now开始扣除
+        uint64_t next = std::max(full, now) + interval;
+        if (next - now > tolerance) {
+            auto wait = std::chrono::nanoseconds(next - now - tolerance);
+            return {false, std::chrono::ceil<std::chrono::milliseconds>(wait)};
+        }
+        if (slot.full.compare_exchange_weak(full, next, std::memory_order_relaxed)) {
+            return {true, std::chrono::milliseconds(0)};
+        }
+    }
+}
+
+} // namespace ImageForensics
@@ -0,0 +1,812 @@
+#include "result_store.hpp"
+#include "util.hpp"
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace ImageForensics {
+
+namespace {
+
+constexpr uint32_t RECORD_MAGIC = 0x31525249;     // "IRR1"
+constexpr uint32_t TOMBSTONE_MAGIC = 0x31545249;  // "IRT1"
+constexpr uint64_t INDEX_MAGIC = 0x3158444952464931ULL;
+constexpr uint32_t INDEX_VERSION = 1;
+constexpr size_t INDEX_HEADER_SIZE = 64;
+
+// 空槽位和已删除槽位的特殊哈希值，真实的键哈希不会取到这两个值
+constexpr uint64_t EMPTY_SLOT = 0;
+constexpr uint64_t DELETED_SLOT = 1;
+
+// 索引负载超过70%时扩容
+constexpr uint64_t MAX_LOAD_PERCENT = 70;
+
+// 单条记录的长度上限，用于识别损坏的记录头
+constexpr uint32_t MAX_RECORD_FIELD = 256 * 1024 * 1024;
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t crc;          ///< 从keyLength开始到记录结束的CRC32
+    uint32_t keyLength;
+    uint32_t valueLength;
+    int64_t timestamp;     ///< 写入时间，Unix秒
+};
+static_assert(sizeof(RecordHeader) == 24, "RecordHeader must be packed");
+
+const std::string SEGMENT_PREFIX = "segment-";
+const std::string SEGMENT_SUFFIX = ".log";
+const std::string INDEX_FILE = "index.bin";
+
+uint64_t hashKey(const std::string& key) {
+    // FNV-1a 64位，结果写入磁盘上的索引，必须在不同进程和版本之间保持稳定
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash <= DELETED_SLOT ? hash + 2 : hash;
+}
+
+int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+uint32_t recordCrc(const RecordHeader& header, const unsigned char* payload, size_t payloadSize) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(&header.keyLength),
+                sizeof(RecordHeader) - offsetof(RecordHeader, keyLength));
+    crc = crc32(crc, payload, static_cast<uInt>(payloadSize));
+    return static_cast<uint32_t>(crc);
+}
+
+bool preadFully(int fd, void* buffer, size_t size, uint64_t offset) {
+    auto* p = static_cast<unsigned char*>(buffer);
+    while (size > 0) {
+        ssize_t n = ::pread(fd, p, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool pwriteFully(int fd, const void* buffer, size_t size, uint64_t offset) {
+    const auto* p = static_cast<const unsigned char*>(buffer);
+    while (size > 0) {
+        ssize_t n = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+struct ResultStore::IndexHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t activeSegment;  ///< 已建立索引的最后位置所在的段
+    uint64_t capacity;       ///< 槽位数，2的幂
+    uint64_t count;          ///< 有效槽位数
+    uint64_t deleted;        ///< 已删除槽位数
+    uint64_t activeOffset;   ///< activeSegment中已建立索引的字节数
+};
+
+struct ResultStore::IndexSlot {
+    uint64_t keyHash;
+    uint64_t offset;
+    int64_t timestamp;
+    uint32_t segment;
+    uint32_t length;
+};
+
+ResultStore::ResultStore(const std::filesystem::path& directory, const ResultStoreOptions& options)
+    : directory(directory), options(options) {
+    static_assert(sizeof(IndexHeader) <= INDEX_HEADER_SIZE, "IndexHeader too large");
+    static_assert(sizeof(IndexSlot) == 32, "IndexSlot must be packed");
+
+    // 活动段不会因字节上限被删除，段太大时上限形同虚设
+    if (options.maxBytes > 0) {
+        this->options.segmentSize = std::min(options.segmentSize, std::max<uint64_t>(options.maxBytes / 4, 4096));
+    }
+
+    try {
+        std::filesystem::create_directories(directory);
+    } catch (const std::exception& e) {
+        throw ImageForensicsException("Failed to create result store directory: " + std::string(e.what()));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    openSegments();
+    if (segments.empty()) {
+        rotateSegment();
+    }
+    openIndex();
+
+    // 各段的有效字节数由索引统计，供压缩选择候选段
+    for (uint64_t i = 0; i < index.header->capacity; ++i) {
+        const IndexSlot& slot = index.slots[i];
+        if (slot.keyHash > DELETED_SLOT) {
+            auto it = segments.find(slot.segment);
+            if (it != segments.end()) {
+                it->second.liveBytes += slot.length;
+            }
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    Logger::get()->info("Opened result store at {}: {} records in {} segments ({} ms)",
+                        directory.string(), index.header->count, segments.size(), elapsed.count());
+
+    compactionThread = std::thread([this]() { compactionLoop(); });
+}
+
+ResultStore::~ResultStore() {
+    {
+        std::lock_guard<std::mutex> lock(compactionMutex);
+        stopping = true;
+    }
+    compactionCondition.notify_all();
+    if (compactionThread.joinable()) {
+        compactionThread.join();
+    }
+
+    unmapIndexFile(index);
+    for (auto& [id, segment] : segments) {
+        ::close(segment.fd);
+    }
+}
+
+bool ResultStore::put(const std::string& key, std::span<const uint8_t> value) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    Location location;
+    if (!appendRecord(key, value, nowSeconds(), false, location)) {
+        return false;
+    }
+    updateSlot(hashKey(key), location);
+    return true;
+}
+
+std::optional<std::vector<uint8_t>> ResultStore::get(const std::string& key) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    IndexSlot* slot = findSlot(index, hashKey(key));
+    if (!slot || isExpired(slot->timestamp)) {
+        return std::nullopt;
+    }
+
+    auto it = segments.find(slot->segment);
+    if (it == segments.end()) {
+        return std::nullopt;
+    }
+
+    std::string storedKey;
+    std::vector<uint8_t> value;
+    int64_t timestamp;
+    bool tombstone;
+    uint32_t length;
+    if (!readRecord(it->second, slot->offset, slot->offset + slot->length, storedKey, value, timestamp, tombstone, length)) {
+        Logger::get()->warn("Corrupt result store record for key {}", key);
+        return std::nullopt;
+    }
+
+    // 64位哈希冲突时键不同，视为未命中
+    if (tombstone || storedKey != key) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+void ResultStore::erase(const std::string& key) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    IndexSlot* slot = findSlot(index, hashKey(key));
+    if (!slot) {
+        return;
+    }
+
+    // 追加删除标记，索引丢失后从日志重建时该键不会复活
+    Location location;
+    appendRecord(key, {}, nowSeconds(), true, location);
+    removeSlot(slot);
+}
+
+size_t ResultStore::compact() {
+    std::lock_guard<std::mutex> compactLock(compactMutex);
+
+    std::vector<uint32_t> expired;
+    std::vector<uint32_t> candidates;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+
+        // 过期记录在被读到或压缩之前仍占着索引槽位，选择候选段时不能算作有效数据
+        int64_t cutoff = nowSeconds() - options.maxAge.count();
+        std::map<uint32_t, uint64_t> expiredBytes;
+        for (uint64_t i = 0; i < index.header->capacity; ++i) {
+            const IndexSlot& slot = index.slots[i];
+            if (slot.keyHash > DELETED_SLOT && slot.timestamp < cutoff) {
+                expiredBytes[slot.segment] += slot.length;
+            }
+        }
+
+        for (const auto& [id, segment] : segments) {
+            if (id == activeSegment) {
+                continue;
+            }
+            if (isExpired(segment.newestTimestamp)) {
+                expired.push_back(id);
+                continue;
+            }
+            uint64_t live = segment.liveBytes - std::min(segment.liveBytes, expiredBytes[id]);
+            if (static_cast<double>(live) < static_cast<double>(segment.size) * options.compactionRatio) {
+                candidates.push_back(id);
+            }
+        }
+    }
+
+    // 段内的删除标记不比最新记录新，同样已过期，不需要保留
+    for (uint32_t id : expired) {
+        dropSegment(id);
+    }
+    for (uint32_t id : candidates) {
+        compactSegment(id);
+    }
+
+    size_t removed = expired.size() + candidates.size();
+    if (removed > 0) {
+        Logger::get()->info("Compacted {} result store segments ({} fully expired)", removed, expired.size());
+    }
+    return removed;
+}
+
+size_t ResultStore::enforceByteBudget() {
+    if (options.maxBytes == 0) {
+        return 0;
+    }
+
+    // 与压缩互斥：压缩线程在不持有锁的情况下读取旧段
+    std::lock_guard<std::mutex> compactLock(compactMutex);
+
+    size_t dropped = 0;
+    while (true) {
+        uint32_t oldest;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            uint64_t total = 0;
+            for (const auto& [id, segment] : segments) {
+                total += segment.size;
+            }
+            if (total <= options.maxBytes || segments.begin()->first == activeSegment) {
+                break;
+            }
+            oldest = segments.begin()->first;
+        }
+        dropSegment(oldest);
+        dropped++;
+    }
+
+    if (dropped > 0) {
+        Logger::get()->info("Dropped {} oldest result store segments to stay within {} bytes", dropped, options.maxBytes);
+    }
+    return dropped;
+}
+
+size_t ResultStore::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return index.header->count;
+}
+
+uint64_t ResultStore::diskBytes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    uint64_t total = 0;
+    for (const auto& [id, segment] : segments) {
+        total += segment.size;
+    }
+    return total;
+}
+
+bool ResultStore::sync() {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    bool ok = true;
+    for (const auto& [id, segment] : segments) {
+        if (::fdatasync(segment.fd) != 0) {
+            Logger::get()->warn("Failed to sync result store segment {}: {}", id, std::strerror(errno));
+            ok = false;
+        }
+    }
+    if (index.mapping && ::msync(index.mapping, index.mappingSize, MS_SYNC) != 0) {
+        Logger::get()->warn("Failed to sync result store index: {}", std::strerror(errno));
+        ok = false;
+    }
+    return ok;
+}
+
+bool ResultStore::mapIndexFile(const std::filesystem::path& path, uint64_t capacity, bool create, IndexFile& file) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t size;
+    if (create) {
+        size = INDEX_HEADER_SIZE + capacity * sizeof(IndexSlot);
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            ::close(fd);
+            return false;
+        }
+    } else {
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < INDEX_HEADER_SIZE) {
+            ::close(fd);
+            return false;
+        }
+        size = static_cast<size_t>(st.st_size);
+    }
+
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    auto* header = static_cast<IndexHeader*>(mapping);
+    if (create) {
+        // ftruncate得到的文件内容全为0，即所有槽位为空
+        header->magic = INDEX_MAGIC;
+        header->version = INDEX_VERSION;
+        header->capacity = capacity;
+    } else if (header->magic != INDEX_MAGIC || header->version != INDEX_VERSION ||
+               !std::has_single_bit(header->capacity) ||
+               size != INDEX_HEADER_SIZE + header->capacity * sizeof(IndexSlot)) {
+        ::munmap(mapping, size);
+        ::close(fd);
+        return false;
+    }
+
+    file.fd = fd;
+    file.mapping = mapping;
+    file.mappingSize = size;
+    file.header = header;
+    file.slots = reinterpret_cast<IndexSlot*>(static_cast<unsigned char*>(mapping) + INDEX_HEADER_SIZE);
+    return true;
+}
+
+void ResultStore::unmapIndexFile(IndexFile& file) {
+    if (file.mapping) {
+        ::msync(file.mapping, file.mappingSize, MS_ASYNC);
+        ::munmap(file.mapping, file.mappingSize);
+    }
+    if (file.fd >= 0) {
+        ::close(file.fd);
+    }
+    file = IndexFile{};
+}
+
+ResultStore::IndexSlot* ResultStore::findSlot(const IndexFile& file, uint64_t keyHash) {
+    uint64_t mask = file.header->capacity - 1;
+    for (uint64_t i = keyHash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        IndexSlot& slot = file.slots[i];
+        if (slot.keyHash == keyHash) {
+            return &slot;
+        }
+        if (slot.keyHash == EMPTY_SLOT) {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void ResultStore::insertSlot(IndexFile& file, uint64_t keyHash, const Location& location) {
+    uint64_t mask = file.header->capacity - 1;
+    IndexSlot* target = nullptr;
+
+    for (uint64_t i = keyHash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        IndexSlot& slot = file.slots[i];
+        if (slot.keyHash == keyHash) {
+            target = &slot;
+            break;
+        }
+        if (slot.keyHash == DELETED_SLOT && !target) {
+            target = &slot;
+        } else if (slot.keyHash == EMPTY_SLOT) {
+            if (!target) {
+                target = &slot;
+            }
+            break;
+        }
+    }
+
+    if (target->keyHash == EMPTY_SLOT) {
+        file.header->count++;
+    } else if (target->keyHash == DELETED_SLOT) {
+        file.header->deleted--;
+        file.header->count++;
+    }
+
+    target->offset = location.offset;
+    target->timestamp = location.timestamp;
+    target->segment = location.segment;
+    target->length = location.length;
+    target->keyHash = keyHash;
+}
+
+std::filesystem::path ResultStore::segmentPath(uint32_t id) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%08u", id);
+    return directory / (SEGMENT_PREFIX + name + SEGMENT_SUFFIX);
+}
+
+void ResultStore::openSegments() {
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::string name = entry.path().filename().string();
+        if (!entry.is_regular_file() || !name.starts_with(SEGMENT_PREFIX) || !name.ends_with(SEGMENT_SUFFIX)) {
+            continue;
+        }
+
+        std::string digits = name.substr(SEGMENT_PREFIX.size(), name.size() - SEGMENT_PREFIX.size() - SEGMENT_SUFFIX.size());
+        if (digits.empty() || !std::all_of(digits.begin(), digits.end(), ::isdigit)) {
+            continue;
+        }
+
+        int fd = ::open(entry.path().c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            Logger::get()->warn("Failed to open result store segment {}: {}", name, std::strerror(errno));
+            continue;
+        }
+
+        // 没有重放的段无法得知记录的写入时间，用修改时间作为上界
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            Logger::get()->warn("Failed to stat result store segment {}: {}", name, std::strerror(errno));
+            ::close(fd);
+            continue;
+        }
+
+        uint32_t id = static_cast<uint32_t>(std::stoul(digits));
+        segments[id] = Segment{fd, static_cast<uint64_t>(st.st_size), 0, static_cast<int64_t>(st.st_mtime)};
+        activeSegment = std::max(activeSegment, id);
+    }
+}
+
+void ResultStore::openIndex() {
+    std::filesystem::path indexPath = directory / INDEX_FILE;
+
+    if (!mapIndexFile(indexPath, 0, false, index)) {
+        bool hasRecords = std::any_of(segments.begin(), segments.end(),
+                                      [](const auto& item) { return item.second.size > 0; });
+        if (hasRecords || std::filesystem::exists(indexPath)) {
+            Logger::get()->warn("Result store index missing or invalid, rebuilding from segments");
+        }
+        rebuildIndex();
+        return;
+    }
+
+    // 只重放索引建立之后追加的记录（上次退出前未同步到索引的部分）
+    uint32_t indexedSegment = index.header->activeSegment;
+    uint64_t indexedOffset = index.header->activeOffset;
+    for (const auto& [id, segment] : segments) {
+        if (id == indexedSegment && segment.size > indexedOffset) {
+            replaySegment(id, indexedOffset);
+        } else if (id > indexedSegment) {
+            replaySegment(id, 0);
+        }
+    }
+
+    index.header->activeSegment = activeSegment;
+    index.header->activeOffset = segments[activeSegment].size;
+}
+
+void ResultStore::rebuildIndex() {
+    // 新索引记录的已索引位置为0，重建中途退出时下次启动会重新重放全部段
+    uint64_t capacity = std::bit_ceil(std::max<uint64_t>(options.initialIndexCapacity, 64));
+    if (!mapIndexFile(directory / INDEX_FILE, capacity, true, index)) {
+        throw ImageForensicsException("Failed to create result store index: " + std::string(std::strerror(errno)));
+    }
+
+    for (const auto& [id, segment] : segments) {
+        replaySegment(id, 0);
+    }
+
+    index.header->activeSegment = activeSegment;
+    index.header->activeOffset = segments[activeSegment].size;
+}
+
+void ResultStore::replaySegment(uint32_t id, uint64_t fromOffset) {
+    Segment& segment = segments[id];
+    uint64_t offset = fromOffset;
+
+    while (offset < segment.size) {
+        std::string key;
+        std::vector<uint8_t> value;
+        int64_t timestamp;
+        bool tombstone;
+        uint32_t length;
+
+        if (!readRecord(segment, offset, segment.size, key, value, timestamp, tombstone, length)) {
+            // 进程在写入过程中退出会留下不完整的尾部记录，截掉它
+            Logger::get()->warn("Truncating result store segment {} at offset {} (incomplete record)", id, offset);
+            if (::ftruncate(segment.fd, static_cast<off_t>(offset)) == 0) {
+                segment.size = offset;
+            }
+            break;
+        }
+
+        segment.newestTimestamp = std::max(segment.newestTimestamp, timestamp);
+        uint64_t keyHash = hashKey(key);
+        if (tombstone || isExpired(timestamp)) {
+            if (IndexSlot* slot = findSlot(index, keyHash)) {
+                removeSlot(slot);
+            }
+        } else {
+            if ((index.header->count + index.header->deleted + 1) * 100 > index.header->capacity * MAX_LOAD_PERCENT) {
+                growIndex();
+            }
+            insertSlot(index, keyHash, Location{id, offset, length, timestamp});
+        }
+        offset += length;
+    }
+}
+
+void ResultStore::rotateSegment() {
+    uint32_t id = activeSegment + 1;
+    std::filesystem::path path = segmentPath(id);
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw ImageForensicsException("Failed to create result store segment: " + std::string(std::strerror(errno)));
+    }
+
+    segments[id] = Segment{fd, 0, 0, 0};
+    activeSegment = id;
+    if (index.header) {
+        index.header->activeSegment = id;
+        index.header->activeOffset = 0;
+    }
+
+    Logger::get()->debug("Started result store segment {}", path.string());
+}
+
+void ResultStore::growIndex() {
+    // 已删除的槽位较多时原容量重建即可
+    uint64_t capacity = index.header->capacity;
+    if ((index.header->count + 1) * 100 > capacity * MAX_LOAD_PERCENT / 2) {
+        capacity *= 2;
+    }
+
+    std::filesystem::path tempPath = directory / (INDEX_FILE + ".tmp");
+    IndexFile grown;
+    if (!mapIndexFile(tempPath, capacity, true, grown)) {
+        throw ImageForensicsException("Failed to grow result store index: " + std::string(std::strerror(errno)));
+    }
+
+    for (uint64_t i = 0; i < index.header->capacity; ++i) {
+        const IndexSlot& slot = index.slots[i];
+        if (slot.keyHash > DELETED_SLOT) {
+            insertSlot(grown, slot.keyHash, Location{slot.segment, slot.offset, slot.length, slot.timestamp});
+        }
+    }
+    grown.header->activeSegment = index.header->activeSegment;
+    grown.header->activeOffset = index.header->activeOffset;
+
+    std::filesystem::rename(tempPath, directory / INDEX_FILE);
+    unmapIndexFile(index);
+    index = grown;
+
+    Logger::get()->debug("Result store index resized to {} slots", capacity);
+}
+
+void ResultStore::updateSlot(uint64_t keyHash, const Location& location) {
+    if (IndexSlot* old = findSlot(index, keyHash)) {
+        auto it = segments.find(old->segment);
+        if (it != segments.end()) {
+            it->second.liveBytes -= std::min<uint64_t>(it->second.liveBytes, old->length);
+        }
+    } else if ((index.header->count + index.header->deleted + 1) * 100 > index.header->capacity * MAX_LOAD_PERCENT) {
+        growIndex();
+    }
+
+    insertSlot(index, keyHash, location);
+    segments[location.segment].liveBytes += location.length;
+}
+
+void ResultStore::removeSlot(IndexSlot* slot) {
+    auto it = segments.find(slot->segment);
+    if (it != segments.end()) {
+        it->second.liveBytes -= std::min<uint64_t>(it->second.liveBytes, slot->length);
+    }
+    slot->keyHash = DELETED_SLOT;
+    index.header->count--;
+    index.header->deleted++;
+}
+
+bool ResultStore::appendRecord(const std::string& key, std::span<const uint8_t> value, int64_t timestamp,
+                               bool tombstone, Location& location) {
+    size_t length = sizeof(RecordHeader) + key.size() + value.size();
+    if (segments[activeSegment].size > 0 && segments[activeSegment].size + length > options.segmentSize) {
+        rotateSegment();
+    }
+    Segment& segment = segments[activeSegment];
+
+    std::vector<unsigned char> buffer(length);
+    RecordHeader header{};
+    header.magic = tombstone ? TOMBSTONE_MAGIC : RECORD_MAGIC;
+    header.keyLength = static_cast<uint32_t>(key.size());
+    header.valueLength = static_cast<uint32_t>(value.size());
+    header.timestamp = timestamp;
+
+    unsigned char* payload = buffer.data() + sizeof(RecordHeader);
+    std::memcpy(payload, key.data(), key.size());
+    if (!value.empty()) {
+        std::memcpy(payload + key.size(), value.data(), value.size());
+    }
+    header.crc = recordCrc(header, payload, key.size() + value.size());
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    if (!pwriteFully(segment.fd, buffer.data(), buffer.size(), segment.size)) {
+        Logger::get()->error("Failed to append to result store: {}", std::strerror(errno));
+        // 丢弃可能写入了一部分的记录
+        if (::ftruncate(segment.fd, static_cast<off_t>(segment.size)) != 0) {
+            Logger::get()->error("Failed to truncate result store segment: {}", std::strerror(errno));
+        }
+        return false;
+    }
+
+    location = Location{activeSegment, segment.size, static_cast<uint32_t>(length), timestamp};
+    segment.size += length;
+    segment.newestTimestamp = std::max(segment.newestTimestamp, timestamp);
+    index.header->activeSegment = activeSegment;
+    index.header->activeOffset = segment.size;
+    return true;
+}
+
+bool ResultStore::readRecord(const Segment& segment, uint64_t offset, uint64_t limit, std::string& key,
+                             std::vector<uint8_t>& value, int64_t& timestamp, bool& tombstone, uint32_t& length) const {
+    RecordHeader header;
+    if (offset + sizeof(header) > limit || !preadFully(segment.fd, &header, sizeof(header), offset)) {
+        return false;
+    }
+    if ((header.magic != RECORD_MAGIC && header.magic != TOMBSTONE_MAGIC) ||
+        header.keyLength > MAX_RECORD_FIELD || header.valueLength > MAX_RECORD_FIELD) {
+        return false;
+    }
+
+    uint64_t payloadSize = uint64_t(header.keyLength) + header.valueLength;
+    if (offset + sizeof(header) + payloadSize > limit) {
+        return false;
+    }
+
+    std::vector<unsigned char> payload(payloadSize);
+    if (payloadSize > 0 && !preadFully(segment.fd, payload.data(), payload.size(), offset + sizeof(header))) {
+        return false;
+    }
+    if (recordCrc(header, payload.data(), payload.size()) != header.crc) {
+        return false;
+    }
+
+    key.assign(reinterpret_cast<const char*>(payload.data()), header.keyLength);
+    value.assign(payload.begin() + header.keyLength, payload.end());
+    timestamp = header.timestamp;
+    tombstone = header.magic == TOMBSTONE_MAGIC;
+    length = static_cast<uint32_t>(sizeof(header) + payloadSize);
+    return true;
+}
+
+bool ResultStore::isExpired(int64_t timestamp) const {
+    return nowSeconds() - timestamp > options.maxAge.count();
+}
+
+void ResultStore::compactSegment(uint32_t id) {
+    Segment segment;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = segments.find(id);
+        if (it == segments.end()) {
+            return;
+        }
+        segment = it->second;
+    }
+
+    // 旧段不再写入，读取时无需持有锁；只有压缩线程会删除段
+    uint64_t offset = 0;
+    size_t moved = 0;
+    while (offset < segment.size) {
+        std::string key;
+        std::vector<uint8_t> value;
+        int64_t timestamp;
+        bool tombstone;
+        uint32_t length;
+        if (!readRecord(segment, offset, segment.size, key, value, timestamp, tombstone, length)) {
+            Logger::get()->warn("Corrupt record in result store segment {} at offset {}", id, offset);
+            break;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        IndexSlot* slot = findSlot(index, hashKey(key));
+        if (tombstone) {
+            // 更早的段里可能还有被删除的记录，删除标记要保留到这些段都被压缩掉为止，否则重建索引时键会复活；
+            // 键之后又被写入，或标记已过期（被删除的记录更早，同样已过期）时不再需要
+            if (!slot && !isExpired(timestamp) && segments.begin()->first < id) {
+                Location location;
+                if (appendRecord(key, {}, timestamp, true, location)) {
+                    moved++;
+                }
+            }
+        } else if (slot && slot->segment == id && slot->offset == offset) {
+            if (isExpired(timestamp)) {
+                removeSlot(slot);
+            } else {
+                // 保留原来的写入时间，过期时间不因压缩而延长
+                Location location;
+                if (appendRecord(key, value, timestamp, false, location)) {
+                    updateSlot(hashKey(key), location);
+                    moved++;
+                }
+            }
+        }
+        offset += length;
+    }
+
+    dropSegment(id);
+    Logger::get()->debug("Compacted result store segment {}: {} records moved", id, moved);
+}
+
+void ResultStore::dropSegment(uint32_t id) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = segments.find(id);
+    if (it == segments.end()) {
+        return;
+    }
+
+    // 记录损坏而无法迁移或记录已过期时，索引中可能还有指向该段的槽位
+    for (uint64_t i = 0; i < index.header->capacity; ++i) {
+        if (index.slots[i].keyHash > DELETED_SLOT && index.slots[i].segment == id) {
+            removeSlot(&index.slots[i]);
+        }
+    }
+
+    ::close(it->second.fd);
+    segments.erase(it);
+    std::error_code ec;
+    std::filesystem::remove(segmentPath(id), ec);
+}
+
+void ResultStore::compactionLoop() {
+    std::unique_lock<std::mutex> lock(compactionMutex);
+    while (!compactionCondition.wait_for(lock, options.compactionInterval, [this]() { return stopping; })) {
+        lock.unlock();
+        try {
+            compact();
+        } catch (const std::exception& e) {
+            Logger::get()->error("Result store compaction failed: {}", e.what());
+        }
+        lock.lock();
+    }
+}
+
+} // namespace ImageForensics
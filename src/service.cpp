@@ -2,13 +2,19 @@
 #include "metadata.hpp"
 #include "storage.hpp"
 #include "util.hpp"
-#include <future>
+#include "file_reader.hpp"
+#include "probe.hpp"
+#include "multipart.hpp"
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 #include <algorithm>
 #include <spdlog/spdlog.h>
 #include <fstream>
 #include <iomanip>
 #include <sstream>
+#include <cstring>
 
 namespace ImageForensics {
 
@@ -17,11 +23,17 @@ const std::vector<std::string> SUPPORTED_EXTENSIONS = {
     ".jpg", ".jpeg", ".png", ".tiff", ".tif", ".bmp", ".gif"
 };
 
-ImageService::ImageService() {
+// 单个图像的大小上限；上传请求的大小另由server.max_request_size在读取请求时限制
+static uint64_t maxImageSize() {
+    return Config::settings().maxFileSize;
+}
+
+ImageService::ImageService(FileCache* resultCache, PeerCache* peerCache, ThreadPool* workerPool)
+    : resultCache(resultCache), peerCache(peerCache), workerPool(workerPool), inflightRequests(workerPool) {
     Logger::get()->info("Initializing image service");
 }
 
-json ImageService::processImage(const std::filesystem::path& imagePath) {
+json ImageService::processImage(const std::filesystem::path& imagePath, const CancellationToken& token) {
     Logger::get()->info("Processing image: {}", imagePath.string());
     
     // 验证图像
@@ -33,8 +45,11 @@ json ImageService::processImage(const std::filesystem::path& imagePath) {
         };
     }
     
+    // 验证完成后、开始解析前检查一次取消
+    token.throwIfCancelled();
+    
     // 创建元数据提取器
-    MetadataExtractor extractor;
+    MetadataExtractor extractor(token);
     
     // 提取元数据
     auto metadataOpt = extractor.extractMetadata(imagePath);
@@ -53,21 +68,99 @@ json ImageService::processImage(const std::filesystem::path& imagePath) {
     };
 }
 
-json ImageService::processBatch(const std::vector<std::filesystem::path>& images) {
+json ImageService::processBatch(const std::vector<std::filesystem::path>& images,
+                               const CancellationToken& token) {
     Logger::get()->info("Processing batch of {} images", images.size());
     
-    // 存储异步任务
-    std::vector<std::future<json>> tasks;
-    
-    // 为每个图像创建异步任务
+    // JPEG的元数据段都位于扫描数据之前，只需读取文件开头的窗口；其他格式读取整个文件
+    auto settings = Config::settings();
+    uint64_t metadataWindow = settings.metadataWindow;
+    std::vector<FileReadRequest> requests;
+    requests.reserve(images.size());
     for (const auto& imagePath : images) {
-        tasks.push_back(processImageAsync(imagePath));
+        auto mimeType = detectMimeType(std::span<const unsigned char>(), imagePath);
+        requests.push_back({imagePath, mimeType == "image/jpeg" ? metadataWindow : 0});
+    }
+    
+    // 读完的文件排队等待解析，解析任务投递到共享的工作线程池，并发度受线程池大小限制；
+    // 读取结束后调用线程也参与解析，因此在池内线程上调用时不会因等待自己而阻塞
+    struct BatchState {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::deque<FileReadResult> pending;
+        std::vector<json> results;
+        size_t completed = 0;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<BatchState>();
+    state->results.resize(images.size());
+    
+    // 取出一个排队的文件解析，队列为空时返回false
+    auto processNext = [this, state, token]() {
+        FileReadResult readResult;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->pending.empty()) {
+                return false;
+            }
+            readResult = std::move(state->pending.front());
+            state->pending.pop_front();
+        }
+        
+        size_t index = readResult.index;
+        json result;
+        std::exception_ptr error;
+        try {
+            result = this->processReadResult(std::move(readResult), token);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->results[index] = std::move(result);
+            if (error && !state->error) {
+                state->error = error;
+            }
+            ++state->completed;
+        }
+        state->done.notify_all();
+        return true;
+    };
+    
+    // 批量提交读请求，每个文件读完立即交给解析任务
+    BatchFileReader reader(settings.ioQueueDepth, settings.ioBufferSize);
+    reader.readAll(requests, [this, &state, &processNext](FileReadResult&& readResult) {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->pending.push_back(std::move(readResult));
+        }
+        
+        if (!workerPool) {
+            processNext();
+            return;
+        }
+        try {
+            workerPool->post([processNext]() { processNext(); });
+        } catch (const ImageForensicsException&) {
+            // 线程池正在关闭，留给调用线程处理
+        }
+    });
+    
+    // 处理尚未被工作线程取走的文件，再等待已取走的完成
+    while (processNext()) {
     }
     
-    // 收集结果
     json results = json::array();
-    for (auto& task : tasks) {
-        results.push_back(task.get());
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&state]() { return state->completed == state->results.size(); });
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+        for (auto& result : state->results) {
+            results.push_back(std::move(result));
+        }
     }
     
     return {
@@ -76,7 +169,7 @@ json ImageService::processBatch(const std::vector<std::filesystem::path>& images
     };
 }
 
-json ImageService::analyzeForensics(const std::filesystem::path& imagePath) {
+json ImageService::analyzeForensics(const std::filesystem::path& imagePath, const CancellationToken& token) {
     Logger::get()->info("Analyzing forensics for image: {}", imagePath.string());
     
     // 验证图像
@@ -88,8 +181,11 @@ json ImageService::analyzeForensics(const std::filesystem::path& imagePath) {
         };
     }
     
+    // 验证完成后、开始解析前检查一次取消
+    token.throwIfCancelled();
+    
     // 创建元数据提取器
-    MetadataExtractor extractor;
+    MetadataExtractor extractor(token);
     
     // 检测篡改
     auto tamperingOpt = extractor.detectTampering(imagePath);
@@ -108,6 +204,247 @@ json ImageService::analyzeForensics(const std::filesystem::path& imagePath) {
     };
 }
 
+json ImageService::processImageBuffer(std::span<const unsigned char> data, const std::string& filename,
+                                      const CancellationToken& token) {
+    Logger::get()->info("Processing image buffer: {} ({} bytes)", filename, data.size());
+    
+    // 验证图像
+    if (!validateImageBuffer(data, filename)) {
+        Logger::get()->warn("Invalid image buffer: {}", filename);
+        return {
+            {"status", "error"},
+            {"message", "Invalid image file"}
+        };
+    }
+    
+    // 验证完成后、开始解析前检查一次取消
+    token.throwIfCancelled();
+    
+    // 创建元数据提取器
+    MetadataExtractor extractor(token);
+    
+    // 提取元数据
+    auto metadataOpt = extractor.extractMetadata(data, filename);
+    
+    if (!metadataOpt) {
+        Logger::get()->warn("Failed to extract metadata from: {}", filename);
+        return {
+            {"status", "error"},
+            {"message", "Failed to extract metadata"}
+        };
+    }
+    
+    return {
+        {"status", "success"},
+        {"metadata", metadataOpt.value()}
+    };
+}
+
+json ImageService::analyzeForensicsBuffer(std::span<const unsigned char> data, const std::string& filename,
+                                          const CancellationToken& token) {
+    Logger::get()->info("Analyzing forensics for image buffer: {} ({} bytes)", filename, data.size());
+    
+    // 验证图像
+    if (!validateImageBuffer(data, filename)) {
+        Logger::get()->warn("Invalid image buffer: {}", filename);
+        return {
+            {"status", "error"},
+            {"message", "Invalid image file"}
+        };
+    }
+    
+    // 验证完成后、开始解析前检查一次取消
+    token.throwIfCancelled();
+    
+    // 创建元数据提取器
+    MetadataExtractor extractor(token);
+    
+    // 提取元数据后直接检测篡改，图像只解析一次
+    auto metadataOpt = extractor.extractMetadata(data, filename);
+    auto tamperingOpt = metadataOpt ? extractor.detectTampering(*metadataOpt) : std::nullopt;
+    
+    if (!tamperingOpt) {
+        Logger::get()->warn("Failed to analyze forensics for: {}", filename);
+        return {
+            {"status", "error"},
+            {"message", "Failed to analyze forensics"}
+        };
+    }
+    
+    return {
+        {"status", "success"},
+        {"forensics", tamperingOpt.value()}
+    };
+}
+
+Task<SharedResponse> ImageService::processImageShared(std::span<const unsigned char> data, const std::string& filename,
+                                                      const CancellationToken& token) {
+    co_return co_await processImageShared(data, filename, computeContentHash(data), token);
+}
+
+Task<SharedResponse> ImageService::processImageShared(std::span<const unsigned char> data, const std::string& filename,
+                                                      const std::string& contentHash, const CancellationToken& token) {
+    // 响应中包含文件名，缓存的是最终字节，因此文件名也是缓存键的一部分
+    std::string cacheKey = makeCacheKey("metadata", contentHash) + ":" + filename;
+    
+    co_return co_await runShared(cacheKey, token, [&]() {
+        return processImageBuffer(data, filename, token);
+    });
+}
+
+Task<SharedResponse> ImageService::analyzeForensicsShared(std::span<const unsigned char> data, const std::string& filename,
+                                                          const CancellationToken& token) {
+    co_return co_await analyzeForensicsShared(data, filename, computeContentHash(data), token);
+}
+
+Task<SharedResponse> ImageService::analyzeForensicsShared(std::span<const unsigned char> data, const std::string& filename,
+                                                          const std::string& contentHash, const CancellationToken& token) {
+    std::string cacheKey = makeCacheKey("forensics", contentHash);
+    
+    co_return co_await runShared(cacheKey, token, [&]() {
+        return analyzeForensicsBuffer(data, filename, token);
+    });
+}
+
+Task<SharedResponse> ImageService::processUploadShared(UploadedPart& part, const CancellationToken& token) {
+    if (part.contentHash.empty()) {
+        auto data = readUpload(part);
+        co_return co_await processImageShared(data, part.filename, token);
+    }
+    
+    std::string cacheKey = makeCacheKey("metadata", part.contentHash) + ":" + part.filename;
+    co_return co_await runShared(cacheKey, token, [&]() {
+        return processImageBuffer(readUpload(part), part.filename, token);
+    });
+}
+
+Task<SharedResponse> ImageService::analyzeUploadShared(UploadedPart& part, const CancellationToken& token) {
+    if (part.contentHash.empty()) {
+        auto data = readUpload(part);
+        co_return co_await analyzeForensicsShared(data, part.filename, token);
+    }
+    
+    std::string cacheKey = makeCacheKey("forensics", part.contentHash);
+    co_return co_await runShared(cacheKey, token, [&]() {
+        return analyzeForensicsBuffer(readUpload(part), part.filename, token);
+    });
+}
+
+std::span<const unsigned char> ImageService::readUpload(UploadedPart& part) {
+    auto data = part.content();
+    if (!data) {
+        throw ImageForensicsException("Failed to read uploaded file");
+    }
+    return *data;
+}
+
+Task<SharedResponse> ImageService::runShared(const std::string& cacheKey, const CancellationToken& token,
+                                             const std::function<json()>& compute) {
+    // 解析之前先查缓存，命中时直接返回已编码的响应
+    if (resultCache) {
+        if (auto cached = resultCache->getCachedResponse(cacheKey)) {
+            Logger::get()->info("Result cache hit for {}", cacheKey);
+            co_return cached;
+        }
+    }
+    
+    auto computeResponse = [&]() -> SharedResponse {
+        // 本地未命中时先向负责该键的实例查询，命中则回填本地缓存
+        if (resultCache && peerCache) {
+            if (auto entry = peerCache->fetch(cacheKey)) {
+                auto accept = [&cacheKey](const json& result) { return matchesCacheKey(cacheKey, result); };
+                if (auto response = resultCache->cacheEncodedResult(cacheKey, *entry, accept)) {
+                    Logger::get()->info("Peer cache hit for {}", cacheKey);
+                    return response;
+                }
+            }
+            token.throwIfCancelled();
+        }
+        
+        json result = compute();
+        
+        // 失败的结果可能与文件名有关（按扩展名判断格式），不缓存也不带ETag
+        if (result["status"] != "success") {
+            return makeCachedResponse(result);
+        }
+        
+        auto response = makeCachedResponse(result, true);
+        if (resultCache) {
+            resultCache->cacheResponse(cacheKey, response);
+            
+            // 同时回填负责该键的实例，其他实例之后可以直接取用
+            if (peerCache) {
+                peerCache->push(cacheKey, response->cborBody);
+            }
+        }
+        return response;
+    };
+    
+    while (true) {
+        try {
+            co_return co_await inflightRequests.join(cacheKey, computeResponse, token);
+        } catch (const OperationCancelled&) {
+            // 计算按首个请求的令牌执行；首个请求放弃后，仍在等待的请求重新发起计算
+            if (token.isCancelled()) {
+                throw;
+            }
+            Logger::get()->debug("Shared computation for {} was cancelled, retrying", cacheKey);
+        }
+    }
+}
+
+std::string ImageService::makeCacheKey(const std::string& operation, const std::string& contentHash) {
+    return operation + ":" + MetadataExtractor::EXTRACTOR_VERSION + "." + MetadataExtractor::RULESET_VERSION + ":" +
+           ContentHasher::algorithm() + ":" + contentHash;
+}
+
+bool ImageService::matchesCacheKey(const std::string& cacheKey, const json& result) {
+    for (const char* operation : {"metadata", "forensics"}) {
+        std::string prefix = makeCacheKey(operation, "");
+        if (cacheKey.size() > prefix.size() && cacheKey.compare(0, prefix.size(), prefix) == 0) {
+            return result.is_object() && result.value("status", "") == "success" &&
+                   result.contains(operation) && result[operation].is_object();
+        }
+    }
+    return false;
+}
+
+bool ImageService::isSupportedFormat(const std::filesystem::path& imagePath) {
+    auto extension = imagePath.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return std::find(SUPPORTED_EXTENSIONS.begin(), SUPPORTED_EXTENSIONS.end(), extension) != SUPPORTED_EXTENSIONS.end();
+}
+
+bool ImageService::validateImageBuffer(std::span<const unsigned char> data, const std::string& filename) {
+    // 检查数据大小
+    if (data.empty() || data.size() > maxImageSize()) {
+        Logger::get()->warn("Invalid buffer size: {} bytes", data.size());
+        return false;
+    }
+    
+    // 检查文件扩展名
+    if (!isSupportedFormat(filename)) {
+        Logger::get()->warn("Unsupported file extension: {}", filename);
+        return false;
+    }
+    
+    // 检查MIME类型
+    auto mimeType = detectMimeType(data.first(std::min<size_t>(data.size(), 12)), filename);
+    if (mimeType.find("image/") != 0) {
+        Logger::get()->warn("Invalid MIME type: {}", mimeType);
+        return false;
+    }
+    
+    // 解码前按格式头中的尺寸拒绝解压炸弹
+    auto probe = probeImage(data, data.size());
+    if (probe && exceedsPixelLimit(*probe, Config::settings().maxPixels)) {
+        Logger::get()->warn("Image dimensions too large: {}x{}", probe->width, probe->height);
+        return false;
+    }
+    
+    return true;
+}
+
 bool ImageService::validateImage(const std::filesystem::path& imagePath) {
     Logger::get()->info("Validating image: {}", imagePath.string());
     
@@ -121,7 +458,7 @@ bool ImageService::validateImage(const std::filesystem::path& imagePath) {
     auto fileSize = std::filesystem::file_size(imagePath);
     Logger::get()->info("File size: {} bytes", fileSize);
     
-    if (fileSize == 0 || fileSize > 1024 * 1024 * 50) { // 最大50MB
+    if (fileSize == 0 || fileSize > maxImageSize()) {
         Logger::get()->warn("Invalid file size: {} bytes", fileSize);
         return false;
     }
@@ -145,6 +482,13 @@ bool ImageService::validateImage(const std::filesystem::path& imagePath) {
         return false;
     }
     
+    // 解码前按格式头中的尺寸拒绝解压炸弹
+    auto probe = probeImage(imagePath);
+    if (probe && exceedsPixelLimit(*probe, Config::settings().maxPixels)) {
+        Logger::get()->warn("Image dimensions too large: {}x{}", probe->width, probe->height);
+        return false;
+    }
+    
     // 尝试打开图像文件
     try {
         std::ifstream file(imagePath, std::ios::binary);
@@ -176,10 +520,37 @@ bool ImageService::validateImage(const std::filesystem::path& imagePath) {
     return true;
 }
 
-std::future<json> ImageService::processImageAsync(const std::filesystem::path& imagePath) {
-    return std::async(std::launch::async, [this, imagePath]() {
-        return this->processImage(imagePath);
-    });
+json ImageService::processReadResult(FileReadResult&& readResult, const CancellationToken& token) {
+    const auto& imagePath = readResult.path;
+    
+    if (readResult.error != 0) {
+        Logger::get()->warn("Failed to read {}: {}", imagePath.string(), std::strerror(readResult.error));
+        return {
+            {"status", "error"},
+            {"message", "Invalid image file"}
+        };
+    }
+    
+    if (readResult.fileSize > maxImageSize()) {
+        Logger::get()->warn("Invalid file size: {} bytes", readResult.fileSize);
+        return {
+            {"status", "error"},
+            {"message", "Invalid image file"}
+        };
+    }
+    
+    json result = processImageBuffer(readResult.data, imagePath.filename().string(), token);
+    
+    if (result["status"] == "success") {
+        // 窗口读取时缓冲区大小不是文件大小
+        result["metadata"]["filesize"] = readResult.fileSize;
+    } else if (readResult.truncated) {
+        // 元数据超出读取窗口，回退到完整的文件解析
+        Logger::get()->info("Metadata window too small for {}, reading whole file", imagePath.string());
+        result = processImage(imagePath, token);
+    }
+    
+    return result;
 }
 
 } // namespace ImageForensics 
\ No newline at end of file
@@ -0,0 +1,512 @@
+#include "shm_ingest.hpp"
+#include "util.hpp"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace ImageForensics {
+
+namespace {
+
+constexpr size_t PAGE_SIZE = 4096;
+static_assert(sizeof(IngestRingHeader) <= PAGE_SIZE);
+
+size_t roundUpToPage(size_t size) {
+    return (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+sockaddr_un socketAddress(const std::filesystem::path& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof(address.sun_path)) {
+        throw ImageForensicsException("Unix socket path too long: " + path.string());
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.native().size());
+    return address;
+}
+
+std::string errorBody(const std::string& message) {
+    nlohmann::json error = {
+        {"status", "error"},
+        {"message", message}
+    };
+    return error.dump();
+}
+
+} // namespace
+
+/**
+ * @brief 一个客户端连接：控制通道和映射的共享内存
+ *
+ * 布局参数保存在服务端自己的内存中，不从客户端可写的区域头读取。
+ */
+struct SharedMemoryIngestServer::Session {
+    int fd = -1;
+    unsigned char* base = nullptr;
+    size_t size = 0;
+    uint32_t slotCount = 0;
+    uint32_t slotSize = 0;
+    uint32_t completionMask = 0;
+    size_t slotsOffset = 0;
+    IngestRingHeader* header = nullptr;
+    IngestCompletion* completions = nullptr;
+    std::unique_ptr<std::atomic<bool>[]> inFlight;
+
+    std::mutex completionMutex;
+    uint32_t completionHead = 0;
+
+    ~Session() {
+        if (base) {
+            ::munmap(base, size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    std::span<unsigned char> slot(uint32_t index) {
+        return {base + slotsOffset + static_cast<size_t>(index) * slotSize, slotSize};
+    }
+
+    // 结果写回槽位，追加完成项后唤醒客户端；客户端不读取控制通道时唤醒字节被丢弃，完成项仍在环中。
+    // ownsSlot为false时（提交无效或槽位正在处理）不写入槽位，也不释放槽位。
+    // 完成环已满时不覆盖客户端尚未读取的项：拒绝的提交直接丢弃，已处理的结果无法送达时断开连接
+    void complete(const IngestSubmission& submission, uint32_t status, std::string_view body, bool ownsSlot = true) {
+        IngestCompletion completion;
+        completion.userData = submission.userData;
+        completion.slot = submission.slot;
+        completion.status = status;
+
+        if (ownsSlot && body.size() > slotSize) {
+            completion.status = 507;
+        } else if (ownsSlot) {
+            std::memcpy(slot(submission.slot).data(), body.data(), body.size());
+            completion.length = static_cast<uint32_t>(body.size());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(completionMutex);
+            if (ownsSlot) {
+                inFlight[submission.slot].store(false, std::memory_order_relaxed);
+            }
+
+            // 读取位置由客户端写入，超过写入位置时差值回绕成很大的数，同样按已满处理
+            uint32_t pending = completionHead - header->completionTail.load(std::memory_order_acquire);
+            if (pending > completionMask) {
+                if (ownsSlot) {
+                    Logger::get()->warn("Ingest completion ring full, disconnecting client");
+                    ::shutdown(fd, SHUT_RDWR);
+                } else {
+                    Logger::get()->warn("Ingest completion ring full, dropping rejected submission for slot {}",
+                                        submission.slot);
+                }
+                return;
+            }
+
+            completions[completionHead & completionMask] = completion;
+            ++completionHead;
+            header->completionHead.store(completionHead, std::memory_order_release);
+        }
+
+        char wake = 1;
+        ::send(fd, &wake, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+};
+
+SharedMemoryIngestOptions SharedMemoryIngestOptions::fromConfig() {
+    SharedMemoryIngestOptions options;
+    options.socketPath = Config::get<std::string>("ingest.socket", "");
+    options.slotCount = Config::get<uint32_t>("ingest.slot_count", options.slotCount);
+    options.slotSize = Config::get<uint32_t>("ingest.slot_size", options.slotSize);
+    options.maxSessions = Config::get<size_t>("ingest.max_sessions", options.maxSessions);
+
+    // 权限以八进制字符串配置，如"0660"
+    auto mode = Config::get<std::string>("ingest.socket_mode", "0660");
+    try {
+        options.socketPerms = std::filesystem::perms(std::stoi(mode, nullptr, 8));
+    } catch (const std::exception&) {
+        Logger::get()->warn("Invalid ingest.socket_mode '{}', using 0660", mode);
+    }
+    return options;
+}
+
+SharedMemoryIngestServer::SharedMemoryIngestServer(SharedMemoryIngestOptions options, ThreadPool& pool, Handler handler)
+    : options(std::move(options)), pool(pool), handler(std::make_shared<const Handler>(std::move(handler))) {
+    this->options.slotCount = std::max<uint32_t>(this->options.slotCount, 1);
+    this->options.slotSize = static_cast<uint32_t>(roundUpToPage(std::max<uint32_t>(this->options.slotSize, 1)));
+}
+
+SharedMemoryIngestServer::~SharedMemoryIngestServer() {
+    stop();
+}
+
+void SharedMemoryIngestServer::start() {
+    if (running) {
+        return;
+    }
+
+    auto address = socketAddress(options.socketPath);
+    listenFd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw ImageForensicsException(std::string("Failed to create ingest socket: ") + std::strerror(errno));
+    }
+
+    // 上次运行留下的套接字文件会使bind失败；不删除其他类型的文件
+    std::error_code ec;
+    if (std::filesystem::is_socket(options.socketPath, ec)) {
+        std::filesystem::remove(options.socketPath, ec);
+    }
+
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd, 16) != 0) {
+        std::string message = std::strerror(errno);
+        ::close(listenFd);
+        listenFd = -1;
+        throw ImageForensicsException("Failed to listen on " + options.socketPath.string() + ": " + message);
+    }
+
+    std::filesystem::permissions(options.socketPath, options.socketPerms, ec);
+    if (ec) {
+        Logger::get()->warn("Failed to set permissions on {}: {}", options.socketPath.string(), ec.message());
+    }
+
+    running = true;
+    acceptThread = std::thread([this]() { acceptLoop(); });
+    Logger::get()->info("Shared-memory ingest listening on {} ({} slots of {} bytes per client)",
+                        options.socketPath.string(), options.slotCount, options.slotSize);
+}
+
+void SharedMemoryIngestServer::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+
+    // 关闭监听套接字使accept返回，再关闭各连接的读端使会话线程退出
+    ::shutdown(listenFd, SHUT_RDWR);
+    acceptThread.join();
+    ::close(listenFd);
+    listenFd = -1;
+
+    std::unique_lock<std::mutex> lock(sessionsMutex);
+    for (const auto& weak : sessions) {
+        if (auto session = weak.lock()) {
+            ::shutdown(session->fd, SHUT_RD);
+        }
+    }
+    sessionsDone.wait(lock, [this]() { return activeSessions == 0; });
+    sessions.clear();
+    lock.unlock();
+
+    std::error_code ec;
+    std::filesystem::remove(options.socketPath, ec);
+    Logger::get()->info("Shared-memory ingest stopped");
+}
+
+size_t SharedMemoryIngestServer::sessionCount() const {
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    return activeSessions;
+}
+
+void SharedMemoryIngestServer::acceptLoop() {
+    while (running) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (running) {
+                Logger::get()->error("Ingest accept failed: {}", std::strerror(errno));
+            }
+            break;
+        }
+
+        std::shared_ptr<Session> session;
+        {
+            std::lock_guard<std::mutex> lock(sessionsMutex);
+            if (activeSessions >= options.maxSessions) {
+                Logger::get()->warn("Rejecting ingest client: {} sessions already connected", activeSessions);
+                ::close(fd);
+                continue;
+            }
+        }
+
+        try {
+            session = createSession(fd);
+        } catch (const std::exception& e) {
+            Logger::get()->error("Failed to set up ingest session: {}", e.what());
+            ::close(fd);
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sessionsMutex);
+            std::erase_if(sessions, [](const std::weak_ptr<Session>& weak) { return weak.expired(); });
+            sessions.push_back(session);
+            ++activeSessions;
+        }
+        std::thread([this, session]() mutable { serveSession(std::move(session)); }).detach();
+    }
+}
+
+std::shared_ptr<SharedMemoryIngestServer::Session> SharedMemoryIngestServer::createSession(int fd) {
+    auto session = std::make_shared<Session>();
+    uint32_t capacity = std::bit_ceil(options.slotCount);
+    size_t completionsOffset = PAGE_SIZE;
+    size_t slotsOffset = completionsOffset + roundUpToPage(capacity * sizeof(IngestCompletion));
+    size_t size = slotsOffset + static_cast<size_t>(options.slotCount) * options.slotSize;
+
+    // 封住大小：客户端可以读写内容，但不能截断文件使服务端访问映射时收到SIGBUS
+    int memfd = ::memfd_create("image_forensics_ingest", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        throw ImageForensicsException(std::string("memfd_create failed: ") + std::strerror(errno));
+    }
+    if (::ftruncate(memfd, static_cast<off_t>(size)) != 0 ||
+        ::fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        std::string message = std::strerror(errno);
+        ::close(memfd);
+        throw ImageForensicsException("Failed to size shared memory: " + message);
+    }
+
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (mapping == MAP_FAILED) {
+        std::string message = std::strerror(errno);
+        ::close(memfd);
+        throw ImageForensicsException("Failed to map shared memory: " + message);
+    }
+
+    session->base = static_cast<unsigned char*>(mapping);
+    session->size = size;
+    session->slotCount = options.slotCount;
+    session->slotSize = options.slotSize;
+    session->completionMask = capacity - 1;
+    session->slotsOffset = slotsOffset;
+    session->header = new (session->base) IngestRingHeader();
+    session->header->slotCount = options.slotCount;
+    session->header->slotSize = options.slotSize;
+    session->header->completionCapacity = capacity;
+    session->header->completionsOffset = completionsOffset;
+    session->header->slotsOffset = slotsOffset;
+    session->header->totalSize = size;
+    session->completions = reinterpret_cast<IngestCompletion*>(session->base + completionsOffset);
+    session->inFlight = std::make_unique<std::atomic<bool>[]>(options.slotCount);
+
+    // 通过SCM_RIGHTS把memfd交给客户端，消息内容是区域大小
+    uint64_t payload = size;
+    iovec iov{&payload, sizeof(payload)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+
+    ssize_t sent = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+    int sendError = errno;
+    ::close(memfd);
+    if (sent != static_cast<ssize_t>(sizeof(payload))) {
+        throw ImageForensicsException(std::string("Failed to send shared memory to client: ") + std::strerror(sendError));
+    }
+
+    // 映射成功之后再交出fd的所有权，失败时由调用方关闭
+    session->fd = fd;
+    return session;
+}
+
+void SharedMemoryIngestServer::serveSession(std::shared_ptr<Session> session) {
+    Logger::get()->info("Ingest client connected");
+
+    while (true) {
+        IngestSubmission submission;
+        ssize_t received = ::recv(session->fd, &submission, sizeof(submission), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+
+        bool valid = received == static_cast<ssize_t>(sizeof(submission)) && submission.slot < session->slotCount &&
+                     submission.length <= session->slotSize &&
+                     (submission.operation == IngestOperation::Metadata ||
+                      submission.operation == IngestOperation::Forensics) &&
+                     (submission.format == IngestFormat::Json || submission.format == IngestFormat::Cbor);
+        if (!valid) {
+            session->complete(submission, 400, {}, false);
+            continue;
+        }
+
+        // 同一个槽位不能同时处理两次
+        if (session->inFlight[submission.slot].exchange(true, std::memory_order_relaxed)) {
+            session->complete(submission, 409, {}, false);
+            continue;
+        }
+
+        try {
+            pool.post([session, submission, handler = handler]() {
+                processSubmission(session, submission, handler);
+            });
+        } catch (const std::exception& e) {
+            session->complete(submission, 503, errorBody(e.what()));
+        }
+    }
+
+    Logger::get()->info("Ingest client disconnected");
+
+    // 处理中的任务仍持有会话，全部完成后才解除映射、关闭连接
+    session.reset();
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    --activeSessions;
+    sessionsDone.notify_all();
+}
+
+DetachedTask SharedMemoryIngestServer::processSubmission(std::shared_ptr<Session> session, IngestSubmission submission,
+                                                        std::shared_ptr<const Handler> handler) {
+    // 客户端在处理期间仍能改写槽位，先复制到服务端自己的内存，解析器不会看到变化中的内容
+    auto slot = session->slot(submission.slot).first(submission.length);
+    std::vector<unsigned char> data(slot.begin(), slot.end());
+    try {
+        Result result = co_await (*handler)(submission.operation, submission.format, data);
+        session->complete(submission, result.status, result.body);
+    } catch (const std::exception& e) {
+        Logger::get()->error("Ingest submission failed: {}", e.what());
+        session->complete(submission, 500, errorBody(e.what()));
+    }
+}
+
+SharedMemoryIngestClient::SharedMemoryIngestClient(const std::filesystem::path& socketPath) {
+    auto address = socketAddress(socketPath);
+    fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::string message = std::strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw ImageForensicsException("Failed to connect to " + socketPath.string() + ": " + message);
+    }
+
+    uint64_t payload = 0;
+    iovec iov{&payload, sizeof(payload)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    cmsghdr* cmsg = received == static_cast<ssize_t>(sizeof(payload)) ? CMSG_FIRSTHDR(&message) : nullptr;
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        ::close(fd);
+        throw ImageForensicsException("Ingest server did not send shared memory (too many clients?)");
+    }
+
+    int memfd = -1;
+    std::memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+    struct stat info{};
+    if (::fstat(memfd, &info) != 0 || static_cast<uint64_t>(info.st_size) != payload || payload < PAGE_SIZE) {
+        ::close(memfd);
+        ::close(fd);
+        throw ImageForensicsException("Invalid shared memory from ingest server");
+    }
+
+    size = static_cast<size_t>(payload);
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    ::close(memfd);
+    if (mapping == MAP_FAILED) {
+        ::close(fd);
+        throw ImageForensicsException(std::string("Failed to map shared memory: ") + std::strerror(errno));
+    }
+
+    base = static_cast<unsigned char*>(mapping);
+    header = reinterpret_cast<IngestRingHeader*>(base);
+    bool valid = header->magic == IngestRingHeader::MAGIC && header->version == IngestRingHeader::VERSION &&
+                 header->totalSize == size &&
+                 header->completionsOffset + static_cast<uint64_t>(header->completionCapacity) * sizeof(IngestCompletion) <=
+                     header->slotsOffset &&
+                 header->slotsOffset + static_cast<uint64_t>(header->slotCount) * header->slotSize <= size;
+    if (!valid) {
+        ::munmap(base, size);
+        ::close(fd);
+        throw ImageForensicsException("Unsupported shared memory layout from ingest server");
+    }
+    completions = reinterpret_cast<IngestCompletion*>(base + header->completionsOffset);
+}
+
+SharedMemoryIngestClient::~SharedMemoryIngestClient() {
+    ::munmap(base, size);
+    ::close(fd);
+}
+
+std::span<unsigned char> SharedMemoryIngestClient::slot(uint32_t index) {
+    if (index >= header->slotCount) {
+        throw ImageForensicsException("Ingest slot out of range: " + std::to_string(index));
+    }
+    return {base + header->slotsOffset + static_cast<size_t>(index) * header->slotSize, header->slotSize};
+}
+
+bool SharedMemoryIngestClient::submit(const IngestSubmission& submission) {
+    return ::send(fd, &submission, sizeof(submission), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(submission));
+}
+
+std::optional<IngestCompletion> SharedMemoryIngestClient::poll() {
+    uint32_t tail = header->completionTail.load(std::memory_order_relaxed);
+    if (tail == header->completionHead.load(std::memory_order_acquire)) {
+        return std::nullopt;
+    }
+    IngestCompletion completion = completions[tail & (header->completionCapacity - 1)];
+    header->completionTail.store(tail + 1, std::memory_order_release);
+    return completion;
+}
+
+std::optional<IngestCompletion> SharedMemoryIngestClient::wait(std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        if (auto completion = poll()) {
+            return completion;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            return std::nullopt;
+        }
+
+        // 唤醒字节只用于等待，完成项以环为准；读出所有积压的唤醒字节后重新检查
+        pollfd descriptor{fd, POLLIN, 0};
+        int ready = ::poll(&descriptor, 1, static_cast<int>(remaining.count()));
+        if (ready < 0 && errno != EINTR) {
+            return std::nullopt;
+        }
+        if (ready > 0) {
+            if (descriptor.revents & (POLLHUP | POLLERR)) {
+                return poll();
+            }
+            char wake[64];
+            while (::recv(fd, wake, sizeof(wake), MSG_DONTWAIT) > 0) {
+            }
+        }
+    }
+}
+
+std::span<const unsigned char> SharedMemoryIngestClient::result(const IngestCompletion& completion) const {
+    if (completion.slot >= header->slotCount || completion.length > header->slotSize) {
+        return {};
+    }
+    return {base + header->slotsOffset + static_cast<size_t>(completion.slot) * header->slotSize, completion.length};
+}
+
+} // namespace ImageForensics
@@ -1,21 +1,110 @@
 #include "storage.hpp"
+#include "compression.hpp"
+#include "multipart.hpp"
 #include "util.hpp"
 #include <spdlog/spdlog.h>
-#include <fstream>
-#include <algorithm>
-#include <random>
 #include <chrono>
-#include <iomanip>
-#include <sstream>
 
 namespace ImageForensics {
 
+namespace {
+
+// 内存缓存按编码后的字节数计费，包括已产生的压缩形式
+size_t responseCharge(const std::string& key, const CachedResponse& response) {
+    return sizeof(CachedResponse) + key.size() + response.jsonBody.size() + response.cborBody.size() +
+           response.jsonETag.size() + response.cborETag.size() + response.compressedBytes();
+}
+
+// 从EntryCodec编码的CBOR重建响应，所需字典未加载、内容损坏或未通过校验时返回nullptr
+SharedResponse decodeResult(const std::string& key, std::string_view entry,
+                            const std::function<bool(const json&)>& accept = {}) {
+    auto cbor = EntryCodec::decode(entry);
+    if (!cbor) {
+        return nullptr;
+    }
+    
+    try {
+        json result = json::from_cbor(*cbor);
+        if (accept && !accept(result)) {
+            Logger::get()->warn("Rejected cache entry for {}: result does not match the key", key);
+            return nullptr;
+        }
+        return makeCachedResponse(result, true);
+    } catch (const json::exception& e) {
+        Logger::get()->debug("Unreadable cache entry for {}: {}", key, e.what());
+        return nullptr;
+    }
+}
+
+} // namespace
+
+std::string CachedResponse::decodeJson() const {
+    auto body = EntryCodec::decode(jsonBody);
+    if (!body) {
+        throw ImageForensicsException("Failed to decode cached response");
+    }
+    return std::move(*body);
+}
+
+std::string CachedResponse::decodeCbor() const {
+    auto body = EntryCodec::decode(cborBody);
+    if (!body) {
+        throw ImageForensicsException("Failed to decode cached response");
+    }
+    return std::move(*body);
+}
+
+std::shared_ptr<const std::string> CachedResponse::compressed(bool cbor, ContentEncoding encoding) const {
+    if (encoding == ContentEncoding::Identity) {
+        return nullptr;
+    }
+    
+    // 持锁压缩，同一条目的并发请求等待第一次压缩的结果，而不是各自压缩一遍
+    auto& slot = compressedForms->bodies[cbor ? 1 : 0][encoding == ContentEncoding::Zstd ? 1 : 0];
+    std::lock_guard<std::mutex> lock(compressedForms->mutex);
+    if (!slot) {
+        auto body = ResponseEncoder::compress(cbor ? decodeCbor() : decodeJson(), encoding);
+        if (!body) {
+            return nullptr;
+        }
+        slot = std::make_shared<const std::string>(std::move(*body));
+        compressedForms->bytes += slot->size();
+    }
+    return slot;
+}
+
+size_t CachedResponse::compressedBytes() const {
+    std::lock_guard<std::mutex> lock(compressedForms->mutex);
+    return compressedForms->bytes;
+}
+
+SharedResponse makeCachedResponse(const json& result, bool withETag) {
+    auto cbor = json::to_cbor(result);
+    auto text = result.dump();
+    CachedResponse response{EntryCodec::encode(text),
+                            EntryCodec::encode(std::string_view(reinterpret_cast<const char*>(cbor.data()), cbor.size())),
+                            {}, {}, text.size(), cbor.size()};
+    
+    // 强ETag按实际发送的字节计算：从持久化存储重建的响应只要字节相同，ETag就相同
+    if (withETag) {
+        response.jsonETag = "\"" + computeContentHash(std::span<const unsigned char>(
+            reinterpret_cast<const unsigned char*>(text.data()), text.size())) + "\"";
+        response.cborETag = "\"" + computeContentHash(cbor) + "\"";
+    }
+    
+    return std::make_shared<const CachedResponse>(std::move(response));
+}
+
 FileCache::FileCache(const std::filesystem::path& cachePath, 
-                   size_t maxCacheSize, 
-                   std::chrono::seconds maxCacheAge)
-    : cachePath(cachePath), maxCacheSize(maxCacheSize), maxCacheAge(maxCacheAge) {
+                   std::chrono::seconds maxCacheAge,
+                   size_t memoryMaxSize,
+                   size_t shardCount,
+                   std::chrono::seconds janitorInterval)
+    : cachePath(cachePath), janitorInterval(janitorInterval),
+      responseCache(maxCacheAge, memoryMaxSize, shardCount) {
     
-    Logger::get()->info("Initializing file cache at: {}", cachePath.string());
+    Logger::get()->info("Initializing file cache at: {} (memory budget {} bytes, {} shards)",
+                        cachePath.string(), memoryMaxSize, responseCache.shardCount());
     
     // 创建缓存目录（如果不存在）
     if (!std::filesystem::exists(cachePath)) {
@@ -23,154 +112,199 @@ FileCache::FileCache(const std::filesystem::path& cachePath,
         Logger::get()->info("Created cache directory: {}", cachePath.string());
     }
     
-    // 清理过期缓存
-    cleanupCache();
+    // 清理在后台线程执行
+    janitorThread = std::thread(&FileCache::janitorLoop, this);
 }
 
-std::filesystem::path FileCache::saveUploadedFile(const std::filesystem::path& tempPath, 
-                                                const std::string& filename) {
-    try {
-        Logger::get()->info("Saving uploaded file: {} (temp: {})", filename, tempPath.string());
-        
-        // 生成唯一的缓存文件名
-        std::string uniqueName = generateUniqueName(filename);
-        std::filesystem::path cachePath = this->cachePath / uniqueName;
-        
-        // 复制文件到缓存目录
-        std::filesystem::copy_file(tempPath, cachePath, std::filesystem::copy_options::overwrite_existing);
-        
-        Logger::get()->info("Saved uploaded file to: {}", cachePath.string());
-        
-        return cachePath;
-    } catch (const std::exception& e) {
-        Logger::get()->error("Failed to save uploaded file: {}", e.what());
-        throw ImageForensicsException("Failed to save uploaded file: " + std::string(e.what()));
+FileCache::~FileCache() {
+    {
+        std::lock_guard<std::mutex> lock(janitorMutex);
+        stopping = true;
+    }
+    janitorCondition.notify_all();
+    if (janitorThread.joinable()) {
+        janitorThread.join();
     }
 }
 
 void FileCache::cacheMetadata(const std::filesystem::path& imagePath, const json& metadata) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    
-    std::string key = imagePath.string();
-    metadataCache[key] = metadata;
-    cacheTimestamps[key] = std::chrono::system_clock::now();
-    
-    Logger::get()->debug("Cached metadata for: {}", key);
+    cacheResponse(imagePath.string(), makeCachedResponse(metadata));
 }
 
 std::optional<json> FileCache::getCachedMetadata(const std::filesystem::path& imagePath) {
-    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto cached = getCachedResponse(imagePath.string());
+    if (!cached) {
+        return std::nullopt;
+    }
+    return json::parse(cached->decodeJson());
+}
+
+void FileCache::cacheResponse(const std::string& key, SharedResponse response) {
+    // 持久化存储只保存压缩后的CBOR编码，读取时再生成其他编码
+    if (resultStore) {
+        resultStore->put(key, std::span<const uint8_t>(
+            reinterpret_cast<const uint8_t*>(response->cborBody.data()), response->cborBody.size()));
+    }
     
-    std::string key = imagePath.string();
+    storeInMemory(key, response);
+}
+
+SharedResponse FileCache::getCachedResponse(const std::string& key) {
+    auto cached = responseCache.get(key);
+    if (cached) {
+        Logger::get()->debug("Retrieved cached response for: {}", key);
+        return cached;
+    }
     
-    // 检查缓存是否存在
-    if (metadataCache.find(key) == metadataCache.end()) {
-        return std::nullopt;
+    if (!resultStore) {
+        return nullptr;
     }
     
-    // 检查缓存是否过期
-    auto now = std::chrono::system_clock::now();
-    auto timestamp = cacheTimestamps[key];
-    auto age = std::chrono::duration_cast<std::chrono::seconds>(now - timestamp);
+    // 内存未命中时读取持久化存储，并回填内存缓存
+    auto stored = resultStore->get(key);
+    if (!stored) {
+        return nullptr;
+    }
     
-    if (age > maxCacheAge) {
-        // 删除过期缓存
-        metadataCache.erase(key);
-        cacheTimestamps.erase(key);
-        return std::nullopt;
+    // 条目所需的字典没有加载或内容损坏时无法解码，按未命中处理
+    auto response = decodeResult(key, std::string_view(reinterpret_cast<const char*>(stored->data()), stored->size()));
+    if (!response) {
+        Logger::get()->warn("Discarding unreadable stored result for {}", key);
+        resultStore->erase(key);
+        return nullptr;
     }
     
-    Logger::get()->debug("Retrieved cached metadata for: {}", key);
+    storeInMemory(key, response);
+    Logger::get()->debug("Loaded response for {} from persistent store", key);
+    return response;
+}
+
+SharedResponse FileCache::cacheEncodedResult(const std::string& key, std::string_view entry,
+                                             const std::function<bool(const json&)>& accept) {
+    auto response = decodeResult(key, entry, accept);
+    if (response) {
+        cacheResponse(key, response);
+    }
+    return response;
+}
+
+std::shared_ptr<const std::string> FileCache::compressedResponse(const SharedResponse& response, bool cbor,
+                                                                 ContentEncoding encoding) {
+    size_t before = response->compressedBytes();
+    auto body = response->compressed(cbor, encoding);
+    if (!body || response->compressedBytes() == before) {
+        return body;
+    }
     
-    return metadataCache[key];
+    // 新产生了压缩形式，按当前的总字节数重新计费；条目已被替换或淘汰时不影响缓存
+    std::string key;
+    {
+        std::lock_guard<std::mutex> lock(response->compressedForms->mutex);
+        key = response->compressedForms->cacheKey;
+    }
+    if (!key.empty()) {
+        responseCache.recharge(key, response.get(), responseCharge(key, *response));
+    }
+    return body;
 }
 
-void FileCache::cleanupCache() {
+bool FileCache::enablePersistence(const ResultStoreOptions& options) {
     try {
-        Logger::get()->info("Cleaning up cache");
-        
-        // 清理内存缓存
-        {
-            std::lock_guard<std::mutex> lock(cacheMutex);
-            
-            auto now = std::chrono::system_clock::now();
-            std::vector<std::string> keysToRemove;
-            
-            for (const auto& [key, timestamp] : cacheTimestamps) {
-                auto age = std::chrono::duration_cast<std::chrono::seconds>(now - timestamp);
-                if (age > maxCacheAge) {
-                    keysToRemove.push_back(key);
-                }
-            }
-            
-            for (const auto& key : keysToRemove) {
-                metadataCache.erase(key);
-                cacheTimestamps.erase(key);
-                Logger::get()->debug("Removed expired metadata cache for: {}", key);
-            }
+        auto store = std::make_unique<ResultStore>(cachePath / "results", options);
+        // 清理线程可能正在运行
+        std::lock_guard<std::mutex> lock(janitorMutex);
+        resultStore = std::move(store);
+        return true;
+    } catch (const std::exception& e) {
+        Logger::get()->error("Failed to open persistent result store, using memory cache only: {}", e.what());
+        return false;
+    }
+}
+
+size_t FileCache::cleanupCache() {
+    size_t expired = responseCache.removeExpired();
+    if (expired > 0) {
+        Logger::get()->debug("Removed {} expired result cache entries", expired);
+    }
+    removeStaleUploads();
+
+    ResultStore* store;
+    {
+        std::lock_guard<std::mutex> lock(janitorMutex);
+        store = resultStore.get();
+    }
+    if (store) {
+        store->enforceByteBudget();
+    }
+    return expired;
+}
+
+size_t FileCache::removeStaleUploads(std::chrono::seconds maxAge) {
+    std::string_view prefix = UploadReceiver::SPILL_PREFIX;
+    std::string_view suffix = UploadReceiver::SPILL_SUFFIX;
+    auto cutoff = std::filesystem::file_time_type::clock::now() - maxAge;
+    
+    size_t removed = 0;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(cachePath, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.size() <= prefix.size() + suffix.size() || !name.starts_with(prefix) || !name.ends_with(suffix)) {
+            continue;
         }
         
-        // 清理文件缓存
-        size_t totalSize = 0;
-        std::vector<std::pair<std::filesystem::path, std::filesystem::file_time_type>> files;
-        
-        // 收集文件信息
-        for (const auto& entry : std::filesystem::directory_iterator(cachePath)) {
-            if (entry.is_regular_file()) {
-                totalSize += entry.file_size();
-                files.emplace_back(entry.path(), entry.last_write_time());
-            }
+        // 正在接收或处理的上传会持续写入或很快删除，只回收长时间未修改的文件
+        std::error_code fileError;
+        auto modified = it->last_write_time(fileError);
+        if (fileError || modified > cutoff || !it->is_regular_file(fileError)) {
+            continue;
         }
-        
-        // 如果缓存大小超过限制，删除最旧的文件
-        if (totalSize > maxCacheSize) {
-            // 按最后修改时间排序
-            std::sort(files.begin(), files.end(), 
-                     [](const auto& a, const auto& b) {
-                         return a.second < b.second;
-                     });
-            
-            // 删除文件直到缓存大小低于限制
-            for (const auto& [path, time] : files) {
-                if (totalSize <= maxCacheSize) {
-                    break;
-                }
-                
-                try {
-                    auto fileSize = std::filesystem::file_size(path);
-                    std::filesystem::remove(path);
-                    totalSize -= fileSize;
-                    
-                    Logger::get()->debug("Removed cache file: {}", path.string());
-                } catch (const std::exception& e) {
-                    Logger::get()->warn("Failed to remove cache file {}: {}", path.string(), e.what());
-                }
-            }
+        if (std::filesystem::remove(it->path(), fileError)) {
+            ++removed;
+        } else if (fileError) {
+            Logger::get()->warn("Failed to remove stale upload {}: {}", it->path().string(), fileError.message());
         }
-        
-        Logger::get()->info("Cache cleanup completed. Current size: {} bytes", totalSize);
-    } catch (const std::exception& e) {
-        Logger::get()->error("Error during cache cleanup: {}", e.what());
     }
+    
+    if (removed > 0) {
+        Logger::get()->info("Removed {} stale upload spill files from {}", removed, cachePath.string());
+    }
+    return removed;
 }
 
-std::string FileCache::generateUniqueName(const std::string& originalFilename) {
-    // 获取文件扩展名
-    std::filesystem::path path(originalFilename);
-    std::string extension = path.extension().string();
-    
-    // 生成UUID
-    std::string uuid = generateUuid();
-    
-    // 生成时间戳
-    auto now = std::chrono::system_clock::now();
-    auto time = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&time), "%Y%m%d%H%M%S");
-    std::string timestamp = ss.str();
+size_t FileCache::memoryBytes() const {
+    return responseCache.bytes();
+}
+
+void FileCache::flush() {
+    if (resultStore) {
+        resultStore->sync();
+    }
+    Logger::get()->info("Cache flushed");
+}
+
+void FileCache::storeInMemory(const std::string& key, const SharedResponse& response) {
+    // 记录条目的键，之后产生的压缩形式按这个键补记字节数
+    {
+        std::lock_guard<std::mutex> lock(response->compressedForms->mutex);
+        response->compressedForms->cacheKey = key;
+    }
     
-    // 组合唯一文件名
-    return timestamp + "_" + uuid + extension;
+    size_t charge = responseCharge(key, *response);
+    if (!responseCache.put(key, response, charge)) {
+        Logger::get()->debug("Response for {} too large for memory cache ({} bytes)", key, charge);
+        return;
+    }
+    Logger::get()->debug("Cached response for: {} ({} bytes)", key, charge);
+}
+
+void FileCache::janitorLoop() {
+    std::unique_lock<std::mutex> lock(janitorMutex);
+    while (!stopping) {
+        lock.unlock();
+        cleanupCache();
+        lock.lock();
+        janitorCondition.wait_for(lock, janitorInterval, [this]() { return stopping; });
+    }
 }
 
 } // namespace ImageForensics 
\ No newline at end of file
@@ -9,15 +9,26 @@
 #include <cctype>
 #include <iomanip>
 #include <sstream>
+#include <cstring>
+
+#ifdef IMAGE_FORENSICS_HAVE_XXHASH
+#include <xxhash.h>
+#endif
 
 namespace ImageForensics {
 
 // 初始化静态成员
 std::shared_ptr<spdlog::logger> Logger::logger = nullptr;
-json Config::configData = json::object();
+std::shared_ptr<const Config::Snapshot> Config::current =
+    std::make_shared<const Config::Snapshot>(Config::Snapshot{json::object(), RuntimeSettings()});
+std::atomic<uint64_t> Config::version{1};
+thread_local Config::LocalSnapshot Config::local;
+std::mutex Config::writeMutex;
 std::filesystem::path Config::currentConfigPath;
+std::filesystem::file_time_type Config::loadedWriteTime;
 
-void Logger::init(spdlog::level::level_enum logLevel, const std::optional<std::string>& logFile) {
+void Logger::init(spdlog::level::level_enum logLevel, const std::optional<std::string>& logFile,
+                  bool consoleToStderr) {
     if (logger) {
         return; // 已经初始化
     }
@@ -29,7 +40,12 @@ void Logger::init(spdlog::level::level_enum logLevel, const std::optional<std::s
                 logFile.value(), 10 * 1024 * 1024, 3);
             
             // 创建控制台日志
-            auto consoleSink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+            spdlog::sink_ptr consoleSink;
+            if (consoleToStderr) {
+                consoleSink = std::make_shared<spdlog::sinks::stderr_color_sink_mt>();
+            } else {
+                consoleSink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+            }
             
             // 设置日志格式
             spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] [%t] %v");
@@ -39,7 +55,8 @@ void Logger::init(spdlog::level::level_enum logLevel, const std::optional<std::s
             logger = std::make_shared<spdlog::logger>("image_forensics", sinks.begin(), sinks.end());
         } else {
             // 只创建控制台日志
-            logger = spdlog::stdout_color_mt("image_forensics");
+            logger = consoleToStderr ? spdlog::stderr_color_mt("image_forensics")
+                                     : spdlog::stdout_color_mt("image_forensics");
         }
         
         // 设置日志级别
@@ -71,14 +88,23 @@ bool Config::load(const std::filesystem::path& configPath) {
             return false;
         }
         
+        // 先记录修改时间再读取，读取期间的修改会在下一次检查时重新加载
+        auto writeTime = std::filesystem::last_write_time(configPath);
         std::ifstream file(configPath);
         if (!file.is_open()) {
             Logger::get()->error("Failed to open config file: {}", configPath.string());
             return false;
         }
         
-        file >> configData;
-        currentConfigPath = configPath;
+        json data;
+        file >> data;
+        
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            currentConfigPath = configPath;
+            loadedWriteTime = writeTime;
+        }
+        publish(std::move(data));
         
         Logger::get()->info("Loaded config from: {}", configPath.string());
         return true;
@@ -88,6 +114,121 @@ bool Config::load(const std::filesystem::path& configPath) {
     }
 }
 
+bool Config::reload() {
+    std::filesystem::path path;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        path = currentConfigPath;
+    }
+    if (path.empty()) {
+        Logger::get()->warn("No config file to reload");
+        return false;
+    }
+    return load(path);
+}
+
+bool Config::reloadIfChanged() {
+    std::filesystem::path path;
+    std::filesystem::file_time_type writeTime;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        path = currentConfigPath;
+        writeTime = loadedWriteTime;
+    }
+    
+    std::error_code ec;
+    auto modified = path.empty() ? writeTime : std::filesystem::last_write_time(path, ec);
+    if (ec || modified == writeTime) {
+        return false;
+    }
+    
+    Logger::get()->info("Config file changed, reloading");
+    return load(path);
+}
+
+const json* Config::find(const json& data, const std::string& key) {
+    if (!data.is_object()) {
+        return nullptr;
+    }
+    
+    // 完整的键优先，兼容扁平写法的配置（如{"server.port": 8080}）
+    auto it = data.find(key);
+    if (it != data.end()) {
+        return &*it;
+    }
+    
+    const json* node = &data;
+    size_t start = 0;
+    while (node->is_object()) {
+        size_t dot = key.find('.', start);
+        auto child = node->find(key.substr(start, dot == std::string::npos ? std::string::npos : dot - start));
+        if (child == node->end()) {
+            return nullptr;
+        }
+        if (dot == std::string::npos) {
+            return &*child;
+        }
+        node = &*child;
+        start = dot + 1;
+    }
+    return nullptr;
+}
+
+void Config::assign(json& data, const std::string& key, json value) {
+    if (!data.is_object()) {
+        data = json::object();
+    }
+    if (data.contains(key)) {
+        data[key] = std::move(value);
+        return;
+    }
+    
+    json* node = &data;
+    size_t start = 0;
+    size_t dot;
+    while ((dot = key.find('.', start)) != std::string::npos) {
+        json& child = (*node)[key.substr(start, dot - start)];
+        if (!child.is_object()) {
+            child = json::object();
+        }
+        node = &child;
+        start = dot + 1;
+    }
+    (*node)[key.substr(start)] = std::move(value);
+}
+
+void Config::refreshLocal() {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    local.snapshot = current;
+    local.version = version.load(std::memory_order_relaxed);
+}
+
+void Config::update(const std::function<void(json&)>& change) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    json data = current->data;
+    change(data);
+    publishLocked(std::move(data));
+}
+
+void Config::publish(json data) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    publishLocked(std::move(data));
+}
+
+void Config::publishLocked(json data) {
+    RuntimeSettings settings;
+    settings.requestTimeout = std::chrono::seconds(lookup<int>(data, "server.timeout", 30));
+    settings.maxFileSize = lookup<uint64_t>(data, "metadata.max_file_size", settings.maxFileSize);
+    settings.maxPixels = lookup<uint64_t>(data, "metadata.max_pixels", settings.maxPixels);
+    settings.metadataWindow = lookup<uint64_t>(data, "io.metadata_window", settings.metadataWindow);
+    settings.ioQueueDepth = lookup<unsigned>(data, "io.queue_depth", settings.ioQueueDepth);
+    settings.ioBufferSize = lookup<size_t>(data, "io.buffer_size", settings.ioBufferSize);
+    
+    // 先替换快照再递增版本号，看到新版本号的线程在写锁内取得的一定是新快照
+    current = std::make_shared<const Snapshot>(Snapshot{std::move(data), settings});
+    version.fetch_add(1, std::memory_order_release);
+}
+
 bool Config::save(const std::optional<std::filesystem::path>& configPath) {
     try {
         auto path = configPath.value_or(currentConfigPath);
@@ -103,7 +244,7 @@ bool Config::save(const std::optional<std::filesystem::path>& configPath) {
             return false;
         }
         
-        file << std::setw(4) << configData << std::endl;
+        file << std::setw(4) << snapshot().data << std::endl;
         
         Logger::get()->info("Saved config to: {}", path.string());
         return true;
@@ -130,6 +271,12 @@ std::string detectMimeType(const std::filesystem::path& filePath) {
     file.read(reinterpret_cast<char*>(header.data()), header.size());
     size_t readSize = file.gcount();
     
+    return detectMimeType(std::span<const unsigned char>(header.data(), readSize), filePath);
+}
+
+std::string detectMimeType(std::span<const unsigned char> header, const std::filesystem::path& filenameHint) {
+    size_t readSize = header.size();
+    
     // JPEG: FF D8 FF
     if (readSize >= 3 && header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF) {
         return "image/jpeg";
@@ -159,7 +306,7 @@ std::string detectMimeType(const std::filesystem::path& filePath) {
     }
     
     // 如果无法识别，根据文件扩展名判断
-    std::string extension = filePath.extension().string();
+    std::string extension = filenameHint.extension().string();
     std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
     
     if (extension == ".jpg" || extension == ".jpeg") {
@@ -177,6 +324,26 @@ std::string detectMimeType(const std::filesystem::path& filePath) {
     return "application/octet-stream";
 }
 
+std::string extensionForMimeType(std::string_view mimeType) {
+    std::string type(mimeType.substr(0, mimeType.find(';')));
+    type.erase(type.find_last_not_of(" \t") + 1);
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    
+    if (type == "image/jpeg" || type == "image/jpg") {
+        return ".jpg";
+    } else if (type == "image/png") {
+        return ".png";
+    } else if (type == "image/gif") {
+        return ".gif";
+    } else if (type == "image/tiff") {
+        return ".tiff";
+    } else if (type == "image/bmp" || type == "image/x-ms-bmp") {
+        return ".bmp";
+    }
+    
+    return "";
+}
+
 std::string generateUuid() {
     static std::random_device rd;
     static std::mt19937 gen(rd());
@@ -214,4 +381,218 @@ std::string generateUuid() {
     return ss.str();
 }
 
+#ifdef IMAGE_FORENSICS_HAVE_XXHASH
+
+ContentHasher::ContentHasher()
+    : state(XXH3_createState()) {
+    if (!state) {
+        throw ImageForensicsException("Failed to allocate hash state");
+    }
+    XXH3_128bits_reset(state);
+}
+
+ContentHasher::~ContentHasher() {
+    XXH3_freeState(state);
+}
+
+void ContentHasher::update(std::span<const unsigned char> data) {
+    XXH3_128bits_update(state, data.data(), data.size());
+}
+
+std::string ContentHasher::hexDigest() const {
+    XXH128_hash_t hash = XXH3_128bits_digest(state);
+    
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0') << std::setw(16) << hash.high64 << std::setw(16) << hash.low64;
+    return ss.str();
+}
+
+const char* ContentHasher::algorithm() {
+    return "xxh3-128";
+}
+
+#else
+
+namespace {
+
+// MurmurHash3 x64 128位算法的常量和辅助函数
+constexpr uint64_t MURMUR_C1 = 0x87c37b91114253d5ULL;
+constexpr uint64_t MURMUR_C2 = 0x4cf5ad432745937fULL;
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+inline uint64_t load64(const unsigned char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+} // namespace
+
+ContentHasher::ContentHasher()
+    : h1(0), h2(0), totalLength(0), tail{}, tailSize(0) {
+}
+
+ContentHasher::~ContentHasher() = default;
+
+void ContentHasher::processBlock(const unsigned char* block) {
+    uint64_t k1 = load64(block);
+    uint64_t k2 = load64(block + 8);
+    
+    k1 *= MURMUR_C1; k1 = rotl64(k1, 31); k1 *= MURMUR_C2; h1 ^= k1;
+    h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+    
+    k2 *= MURMUR_C2; k2 = rotl64(k2, 33); k2 *= MURMUR_C1; h2 ^= k2;
+    h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+}
+
+void ContentHasher::update(std::span<const unsigned char> data) {
+    const unsigned char* p = data.data();
+    size_t remaining = data.size();
+    totalLength += remaining;
+    
+    // 先补齐上次剩余的不完整块
+    if (tailSize > 0) {
+        size_t take = std::min(remaining, tail.size() - tailSize);
+        std::memcpy(tail.data() + tailSize, p, take);
+        tailSize += take;
+        p += take;
+        remaining -= take;
+        
+        if (tailSize < tail.size()) {
+            return;
+        }
+        processBlock(tail.data());
+        tailSize = 0;
+    }
+    
+    for (; remaining >= 16; p += 16, remaining -= 16) {
+        processBlock(p);
+    }
+    
+    std::memcpy(tail.data(), p, remaining);
+    tailSize = remaining;
+}
+
+std::string ContentHasher::hexDigest() const {
+    uint64_t a = h1;
+    uint64_t b = h2;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    
+    for (size_t i = 8; i < tailSize; ++i) {
+        k2 ^= static_cast<uint64_t>(tail[i]) << ((i - 8) * 8);
+    }
+    if (tailSize > 8) {
+        k2 *= MURMUR_C2; k2 = rotl64(k2, 33); k2 *= MURMUR_C1; b ^= k2;
+    }
+    
+    for (size_t i = 0; i < std::min<size_t>(tailSize, 8); ++i) {
+        k1 ^= static_cast<uint64_t>(tail[i]) << (i * 8);
+    }
+    if (tailSize > 0) {
+        k1 *= MURMUR_C1; k1 = rotl64(k1, 31); k1 *= MURMUR_C2; a ^= k1;
+    }
+    
+    a ^= totalLength;
+    b ^= totalLength;
+    a += b;
+    b += a;
+    a = fmix64(a);
+    b = fmix64(b);
+    a += b;
+    b += a;
+    
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0') << std::setw(16) << b << std::setw(16) << a;
+    return ss.str();
+}
+
+const char* ContentHasher::algorithm() {
+    return "mmh3-128";
+}
+
+#endif
+
+std::string computeContentHash(std::span<const unsigned char> data) {
+    ContentHasher hasher;
+    hasher.update(data);
+    return hasher.hexDigest();
+}
+
+std::optional<std::vector<unsigned char>> readFileContents(const std::filesystem::path& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    
+    file.seekg(0, std::ios::end);
+    auto size = file.tellg();
+    if (size < 0) {
+        return std::nullopt;
+    }
+    file.seekg(0, std::ios::beg);
+    
+    std::vector<unsigned char> data(static_cast<size_t>(size));
+    file.read(reinterpret_cast<char*>(data.data()), size);
+    if (file.gcount() != size) {
+        return std::nullopt;
+    }
+    
+    return data;
+}
+
+std::optional<std::vector<unsigned char>> readFileContents(const std::filesystem::path& filePath,
+                                                           ContentHasher& hasher) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    
+    std::error_code ec;
+    auto size = std::filesystem::file_size(filePath, ec);
+    std::vector<unsigned char> data(ec ? 0 : static_cast<size_t>(size));
+    
+    // 分块读取，数据还在CPU缓存中时立即哈希
+    constexpr size_t CHUNK_SIZE = 64 * 1024;
+    size_t offset = 0;
+    while (true) {
+        if (offset == data.size()) {
+            // 已读到预期大小；文件在此期间变长时继续读取
+            if (file.peek() == std::char_traits<char>::eof()) {
+                break;
+            }
+            data.resize(offset + CHUNK_SIZE);
+        }
+        
+        size_t want = std::min(CHUNK_SIZE, data.size() - offset);
+        file.read(reinterpret_cast<char*>(data.data() + offset), static_cast<std::streamsize>(want));
+        size_t readSize = static_cast<size_t>(file.gcount());
+        hasher.update(std::span<const unsigned char>(data.data() + offset, readSize));
+        offset += readSize;
+        
+        if (readSize < want) {
+            break;
+        }
+    }
+    data.resize(offset);
+    
+    if (file.bad()) {
+        return std::nullopt;
+    }
+    
+    return data;
+}
+
 } // namespace ImageForensics 
\ No newline at end of file
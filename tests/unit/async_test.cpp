@@ -0,0 +1,282 @@
+#include <gtest/gtest.h>
+#include "async.hpp"
+#include "util.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace ImageForensics;
+using namespace testing;
+
+// 测试默认令牌永不取消
+TEST(CancellationTokenTest, DefaultTokenNeverCancels) {
+    CancellationToken token;
+    EXPECT_FALSE(token.isCancelled());
+    EXPECT_NO_THROW(token.throwIfCancelled());
+}
+
+// 测试截止时间到达后抛出DeadlineExceeded
+TEST(CancellationTokenTest, DeadlineExceeded) {
+    auto token = CancellationToken::withTimeout(std::chrono::milliseconds(0));
+    EXPECT_EQ(token.check(), CancelReason::DeadlineExceeded);
+
+    try {
+        token.throwIfCancelled();
+        FAIL() << "Expected OperationCancelled";
+    } catch (const OperationCancelled& e) {
+        EXPECT_EQ(e.reason(), CancelReason::DeadlineExceeded);
+    }
+}
+
+// 测试存活探测失败时视为客户端断开，且副本共享状态
+TEST(CancellationTokenTest, AliveProbeAndSharedState) {
+    auto alive = std::make_shared<std::atomic<bool>>(true);
+    CancellationToken token;
+    token.setAliveProbe([alive]() { return alive->load(); });
+
+    CancellationToken copy = token;
+    EXPECT_FALSE(copy.isCancelled());
+
+    alive->store(false);
+    EXPECT_EQ(copy.check(), CancelReason::ClientDisconnected);
+
+    CancellationToken other;
+    CancellationToken otherCopy = other;
+    other.cancel();
+    EXPECT_EQ(otherCopy.check(), CancelReason::Cancelled);
+}
+
+// 测试任务抛出任何异常都不会结束工作线程
+TEST(ThreadPoolTest, SurvivesThrowingTasks) {
+    Logger::init(spdlog::level::warn);
+    ThreadPool pool(1);
+    std::atomic<int> completed{0};
+    pool.post([]() { throw std::runtime_error("task failed"); });
+    pool.post([]() { throw 42; });
+    pool.post([&]() { completed++; });
+
+    for (int i = 0; i < 5000 && completed.load() == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(completed.load(), 1);
+}
+
+// 测试并发的相同请求只计算一次
+TEST(SingleFlightTest, CoalescesConcurrentCalls) {
+    SingleFlight<int> flight;
+    std::atomic<int> calls{0};
+    std::atomic<bool> release{false};
+
+    auto compute = [&]() {
+        calls++;
+        while (!release.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return 42;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<int> results(4, 0);
+    for (size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&, i]() { results[i] = flight.run("key", compute); });
+    }
+
+    while (flight.inflightCount() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    release.store(true);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(calls.load(), 1);
+    for (int result : results) {
+        EXPECT_EQ(result, 42);
+    }
+    EXPECT_EQ(flight.inflightCount(), 0u);
+}
+
+// 测试等待者被取消后不再等待首个调用者的结果
+TEST(SingleFlightTest, CancelledFollowerStopsWaiting) {
+    SingleFlight<int> flight;
+    std::atomic<bool> release{false};
+
+    std::thread leader([&]() {
+        flight.run("key", [&]() {
+            while (!release.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return 1;
+        });
+    });
+
+    while (flight.inflightCount() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    auto token = CancellationToken::withTimeout(std::chrono::milliseconds(20));
+    EXPECT_THROW(flight.run("key", []() { return 2; }, token), OperationCancelled);
+
+    release.store(true);
+    leader.join();
+}
+
+// 测试协程等待者挂起而不占用线程，首个调用者完成计算后由它的线程恢复
+TEST(SingleFlightTest, JoiningCoroutineSuspendsUntilLeaderCompletes) {
+    SingleFlight<int> flight;
+    std::atomic<bool> release{false};
+    std::atomic<int> calls{0};
+
+    std::thread leader([&]() {
+        flight.run("key", [&]() {
+            calls++;
+            while (!release.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return 7;
+        });
+    });
+
+    while (flight.inflightCount() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // 等待者在加入时挂起，调用立即返回
+    Task<int> follower = flight.join("key", [&]() {
+        calls++;
+        return 8;
+    });
+    EXPECT_FALSE(follower.finished());
+
+    release.store(true);
+    leader.join();
+
+    EXPECT_TRUE(follower.finished());
+    EXPECT_EQ(follower.get(), 7);
+    EXPECT_EQ(calls.load(), 1);
+    EXPECT_EQ(flight.inflightCount(), 0u);
+}
+
+// 测试等待者在线程池上恢复，而不是在执行计算的线程上；挂起期间被取消的等待者恢复后不使用结果
+TEST(SingleFlightTest, FollowersResumeOnPoolAndHonorTheirToken) {
+    ThreadPool pool(2);
+    SingleFlight<int> flight(&pool);
+    std::atomic<bool> release{false};
+    std::thread::id leaderThread;
+
+    std::thread leader([&]() {
+        leaderThread = std::this_thread::get_id();
+        flight.run("key", [&]() {
+            while (!release.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return 7;
+        });
+    });
+
+    while (flight.inflightCount() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    auto follow = [&](CancellationToken token) -> Task<std::thread::id> {
+        int value = co_await flight.join("key", []() { return 8; }, token);
+        EXPECT_EQ(value, 7);
+        co_return std::this_thread::get_id();
+    };
+    Task<std::thread::id> follower = follow(CancellationToken());
+    CancellationToken cancelled;
+    Task<std::thread::id> abandoned = follow(cancelled);
+    cancelled.cancel();
+
+    release.store(true);
+    leader.join();
+
+    std::thread::id resumedOn = follower.get();
+    EXPECT_NE(resumedOn, leaderThread);
+    EXPECT_NE(resumedOn, std::this_thread::get_id());
+    EXPECT_THROW(abandoned.get(), OperationCancelled);
+}
+
+// 测试get()在任务于其他线程完成后立即返回，随后销毁任务是安全的
+TEST(TaskTest, GetOnTaskCompletedByAnotherThread) {
+    ThreadPool pool(4);
+    auto hop = [](ThreadPool& pool, int value) -> Task<int> {
+        co_await resumeOn(pool);
+        co_return value;
+    };
+
+    for (int i = 0; i < 2000; ++i) {
+        Task<int> task = hop(pool, i);
+        EXPECT_EQ(task.get(), i);
+    }
+}
+
+// 测试任务完成后恢复等待它的协程，异常传递给等待者
+TEST(TaskTest, AwaitingCoroutineReceivesResult) {
+    ThreadPool pool(1);
+    std::atomic<bool> release{false};
+
+    auto work = [&]() -> Task<int> {
+        co_await offload(pool, [&]() {
+            while (!release.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return 0;
+        });
+        co_return 5;
+    };
+    auto outer = [&]() -> Task<int> {
+        int value = co_await work();
+        co_return value * 2;
+    };
+    auto failing = []() -> Task<int> {
+        throw std::runtime_error("failed");
+        co_return 0;
+    };
+
+    Task<int> task = outer();
+    EXPECT_FALSE(task.finished());
+    release.store(true);
+    EXPECT_EQ(task.get(), 10);
+
+    Task<int> failed = failing();
+    EXPECT_TRUE(failed.finished());
+    EXPECT_THROW(failed.get(), std::runtime_error);
+}
+
+// 测试协程帧持有作用域对象，直到卸载到线程池的工作完成、协程结束后才释放
+TEST(DetachedTaskTest, ScopeReleasedWhenCoroutineFinishes) {
+    ThreadPool pool(1);
+    std::atomic<bool> release{false};
+    std::atomic<bool> finished{false};
+    auto scope = std::make_shared<int>(0);
+    std::weak_ptr<int> observer = scope;
+
+    // 协程引用lambda的捕获，lambda必须活到协程结束；作用域对象作为参数传入，由promise取得
+    auto handler = [&](DetachedTask::Scope scope) -> DetachedTask {
+        scope.reset();
+        co_await offload(pool, [&]() {
+            while (!release.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return 0;
+        });
+        finished.store(true);
+    };
+    handler(std::move(scope));
+
+    // 协程体释放了自己的参数，promise仍然持有到协程结束
+    EXPECT_FALSE(observer.expired());
+
+    // 同一线程上之后创建的协程不会取走作用域对象
+    auto unrelated = []() -> DetachedTask { co_return; };
+    unrelated();
+    EXPECT_FALSE(observer.expired());
+
+    release.store(true);
+    pool.shutdown();
+    EXPECT_TRUE(finished.load());
+    EXPECT_TRUE(observer.expired());
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include "cache.hpp"
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+using namespace ImageForensics;
+using namespace testing;
+
+// 测试分片数量向上取整为2的幂
+TEST(ShardedCacheTest, ShardCountIsPowerOfTwo) {
+    ShardedCache<int> cache(std::chrono::seconds(60), 64 * 1024 * 1024, 5);
+    EXPECT_EQ(cache.shardCount(), 8u);
+
+    ShardedCache<int> automatic(std::chrono::seconds(60), 1024 * 1024 * 1024);
+    EXPECT_GT(automatic.shardCount(), 0u);
+    EXPECT_EQ(automatic.shardCount() & (automatic.shardCount() - 1), 0u);
+
+    // 预算太小时减少分片，保证每个分片至少能放下几个条目
+    ShardedCache<int> small(std::chrono::seconds(60), 2 * ShardedCache<int>::MIN_SHARD_BYTES, 16);
+    EXPECT_EQ(small.shardCount(), 2u);
+}
+
+// 测试写入、读取、替换和删除
+TEST(ShardedCacheTest, PutGetErase) {
+    ShardedCache<std::string> cache(std::chrono::seconds(60), 1024 * 1024, 1);
+    EXPECT_EQ(cache.get("missing"), nullptr);
+
+    cache.put("a", std::make_shared<const std::string>("first"), 100);
+    auto value = cache.get("a");
+    ASSERT_NE(value, nullptr);
+    EXPECT_EQ(*value, "first");
+
+    // 替换后旧值仍由持有者共享，不受影响
+    cache.put("a", std::make_shared<const std::string>("second"), 100);
+    EXPECT_EQ(*value, "first");
+    EXPECT_EQ(*cache.get("a"), "second");
+
+    cache.erase("a");
+    EXPECT_EQ(cache.get("a"), nullptr);
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.bytes(), 0u);
+}
+
+// 测试过期条目不再返回并可被批量清理
+TEST(ShardedCacheTest, ExpiredEntries) {
+    ShardedCache<int> cache(std::chrono::seconds(0), 1024 * 1024, 1);
+    cache.put("a", std::make_shared<const int>(1), 10);
+    cache.put("b", std::make_shared<const int>(2), 10);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(cache.get("a"), nullptr);
+    EXPECT_EQ(cache.removeExpired(), 1u);
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+// 测试多线程并发读写
+TEST(ShardedCacheTest, ConcurrentAccess) {
+    ShardedCache<int> cache(std::chrono::seconds(60), 64 * 1024 * 1024, 16);
+    constexpr int KEYS = 256;
+    for (int i = 0; i < KEYS; ++i) {
+        cache.put("key" + std::to_string(i), std::make_shared<const int>(i), 64);
+    }
+
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches{0};
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 10000; ++i) {
+                int k = (i * 7 + t) % KEYS;
+                if (i % 100 == 0) {
+                    cache.put("key" + std::to_string(k), std::make_shared<const int>(k), 64);
+                }
+                auto value = cache.get("key" + std::to_string(k));
+                if (!value || *value != k) {
+                    mismatches++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(mismatches.load(), 0);
+    EXPECT_EQ(cache.size(), static_cast<size_t>(KEYS));
+}
+
+// 测试内存占用不超过预算，超过单个分片预算的条目不缓存
+TEST(ShardedCacheTest, StaysWithinByteBudget) {
+    constexpr size_t BUDGET = 1024 * 1024;
+    ShardedCache<int> cache(std::chrono::seconds(60), BUDGET, 1);
+
+    EXPECT_FALSE(cache.put("huge", std::make_shared<const int>(0), BUDGET + 1));
+
+    for (int i = 0; i < 10000; ++i) {
+        cache.put("key" + std::to_string(i), std::make_shared<const int>(i), 1000);
+        ASSERT_LE(cache.bytes(), BUDGET);
+    }
+    EXPECT_GT(cache.size(), 0u);
+}
+
+// 测试打包的4位计数器在15处饱和，且不影响同一字中的其他计数器
+TEST(FrequencySketchTest, CountersSaturateIndependently) {
+    FrequencySketch sketch(1024);
+    for (int i = 0; i < 40; ++i) {
+        sketch.increment(1);
+    }
+    sketch.increment(2);
+    sketch.increment(2);
+
+    EXPECT_EQ(sketch.estimate(1), 15u);
+    EXPECT_EQ(sketch.estimate(2), 2u);
+    EXPECT_EQ(sketch.estimate(3), 0u);
+}
+
+// 测试增加次数达到采样上限后计数减半
+TEST(FrequencySketchTest, HalvesAfterSampleSize) {
+    FrequencySketch sketch(1024);
+    for (int i = 0; i < 8; ++i) {
+        sketch.increment(1);
+    }
+    // 采样上限为宽度的10倍
+    for (uint64_t key = 100; key < 100 + 1024 * 10; ++key) {
+        sketch.increment(key * 0x9e3779b97f4a7c15ULL);
+    }
+    EXPECT_LE(sketch.estimate(1), 6u);
+    EXPECT_GE(sketch.estimate(1), 4u);
+}
+
+// 测试只出现一次的键不会挤掉频繁访问的热点数据
+TEST(ShardedCacheTest, OneHitWondersDoNotEvictHotSet) {
+    constexpr size_t ENTRY = 1000;
+    ShardedCache<int> cache(std::chrono::seconds(60), ENTRY * 100, 1);
+
+    // 热点集合占预算的一半，反复访问
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 50; ++i) {
+            std::string key = "hot" + std::to_string(i);
+            if (!cache.get(key)) {
+                cache.put(key, std::make_shared<const int>(i), ENTRY);
+            }
+        }
+    }
+
+    // 大量只出现一次的键
+    for (int i = 0; i < 5000; ++i) {
+        cache.put("cold" + std::to_string(i), std::make_shared<const int>(i), ENTRY);
+    }
+
+    int hits = 0;
+    for (int i = 0; i < 50; ++i) {
+        if (cache.get("hot" + std::to_string(i))) {
+            hits++;
+        }
+    }
+    EXPECT_GE(hits, 45);
+    EXPECT_LE(cache.bytes(), ENTRY * 100);
+}
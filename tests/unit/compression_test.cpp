@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include "compression.hpp"
+#include "util.hpp"
+#include <nlohmann/json.hpp>
+#include <zlib.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace ImageForensics;
+using namespace testing;
+using json = nlohmann::json;
+
+namespace {
+
+// 生成与真实元数据结构相似、键名和厂商字符串重复的样本
+std::string makeSample(int i) {
+    json metadata = {
+        {"status", "success"},
+        {"metadata", {
+            {"filename", "IMG_" + std::to_string(1000 + i) + ".jpg"},
+            {"width", 4000 + i % 7},
+            {"height", 3000 + i % 5},
+            {"exif", {
+                {"Exif.Image.Make", i % 2 ? "Canon" : "NIKON CORPORATION"},
+                {"Exif.Image.Model", i % 2 ? "Canon EOS 5D Mark IV" : "NIKON D850"},
+                {"Exif.Photo.ExposureTime", "1/" + std::to_string(60 + i % 200)},
+                {"Exif.Photo.FNumber", "F" + std::to_string(2 + i % 9)},
+                {"Exif.Photo.ISOSpeedRatings", std::to_string(100 * (1 + i % 32))},
+                {"Exif.Image.Software", "Adobe Photoshop Lightroom Classic 12." + std::to_string(i % 4)}
+            }},
+            {"xmp", {
+                {"Xmp.xmp.CreatorTool", "Adobe Photoshop Lightroom Classic"},
+                {"Xmp.photoshop.DateCreated", "2023-0" + std::to_string(1 + i % 9) + "-1" + std::to_string(i % 10)}
+            }}
+        }}
+    };
+    return metadata.dump();
+}
+
+} // namespace
+
+// 测试编码后可以还原，引入压缩之前的裸条目按原样返回
+TEST(EntryCodecTest, RoundTripAndLegacyEntries) {
+    std::string data = makeSample(1);
+    auto decoded = EntryCodec::decode(EntryCodec::encode(data));
+    ASSERT_TRUE(decoded.has_value());
+    EXPECT_EQ(*decoded, data);
+
+    EXPECT_EQ(EntryCodec::decode(data), data);
+    EXPECT_EQ(EntryCodec::decode(EntryCodec::encode("")), "");
+}
+
+// 测试训练的字典压缩效果以及字典ID的版本管理
+TEST(EntryCodecTest, DictionaryCompression) {
+    if (!EntryCodec::available()) {
+        GTEST_SKIP() << "built without zstd support";
+    }
+    Logger::init(spdlog::level::warn);
+
+    std::vector<std::string> samples;
+    for (int i = 0; i < 2000; ++i) {
+        samples.push_back(makeSample(i));
+    }
+    auto dictionary = EntryCodec::trainDictionary(samples, 16 * 1024);
+    ASSERT_TRUE(dictionary.has_value());
+
+    auto directory = std::filesystem::temp_directory_path() / ("codec_test_" + generateUuid());
+    std::filesystem::create_directories(directory);
+    auto path = directory / "metadata.dict";
+    std::ofstream(path, std::ios::binary) << *dictionary;
+
+    std::string data = makeSample(5000);
+    auto plain = EntryCodec::encode(data);
+
+    auto id = EntryCodec::loadDictionary(path);
+    ASSERT_TRUE(id.has_value());
+    EXPECT_EQ(EntryCodec::currentDictionaryId(), *id);
+
+    auto withDictionary = EntryCodec::encode(data);
+    EXPECT_LT(withDictionary.size() * 2, plain.size());
+    EXPECT_EQ(EntryCodec::decode(withDictionary), data);
+
+    // 没有字典时压缩的条目在加载字典之后仍然可以解码
+    EXPECT_EQ(EntryCodec::decode(plain), data);
+
+    std::filesystem::remove_all(directory);
+}
+
+// 测试Accept-Encoding协商：q值、"*"、大小阈值和关闭压缩
+TEST(ResponseEncoderTest, Negotiate) {
+    ResponseEncoder::configure(true, 1024);
+    auto zstdIfAvailable = EntryCodec::available() ? ContentEncoding::Zstd : ContentEncoding::Gzip;
+
+    EXPECT_EQ(ResponseEncoder::negotiate("gzip, deflate", 4096), ContentEncoding::Gzip);
+    EXPECT_EQ(ResponseEncoder::negotiate("gzip, zstd", 4096), zstdIfAvailable);
+    EXPECT_EQ(ResponseEncoder::negotiate("zstd;q=0.5, GZIP;q=0.8", 4096), ContentEncoding::Gzip);
+    EXPECT_EQ(ResponseEncoder::negotiate("*", 4096), zstdIfAvailable);
+    EXPECT_EQ(ResponseEncoder::negotiate("*;q=0.1, gzip;q=0", 4096),
+              EntryCodec::available() ? ContentEncoding::Zstd : ContentEncoding::Identity);
+    EXPECT_EQ(ResponseEncoder::negotiate("br, identity", 4096), ContentEncoding::Identity);
+    EXPECT_EQ(ResponseEncoder::negotiate("", 4096), ContentEncoding::Identity);
+    EXPECT_EQ(ResponseEncoder::negotiate("gzip", 100), ContentEncoding::Identity);
+
+    ResponseEncoder::configure(false);
+    EXPECT_EQ(ResponseEncoder::negotiate("gzip", 4096), ContentEncoding::Identity);
+    ResponseEncoder::configure(true);
+}
+
+// 测试gzip压缩的结果可以用标准zlib解压
+TEST(ResponseEncoderTest, GzipRoundTrip) {
+    std::string data;
+    for (int i = 0; i < 20; ++i) {
+        data += makeSample(i);
+    }
+
+    auto compressed = ResponseEncoder::compress(data, ContentEncoding::Gzip);
+    ASSERT_TRUE(compressed.has_value());
+    EXPECT_LT(compressed->size(), data.size());
+    ASSERT_GE(compressed->size(), 2u);
+    EXPECT_EQ(static_cast<unsigned char>((*compressed)[0]), 0x1f);
+    EXPECT_EQ(static_cast<unsigned char>((*compressed)[1]), 0x8b);
+
+    z_stream stream{};
+    ASSERT_EQ(inflateInit2(&stream, 15 + 16), Z_OK);
+    std::string output(data.size(), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(compressed->data());
+    stream.avail_in = static_cast<uInt>(compressed->size());
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+    EXPECT_EQ(inflate(&stream, Z_FINISH), Z_STREAM_END);
+    inflateEnd(&stream);
+    EXPECT_EQ(output, data);
+}
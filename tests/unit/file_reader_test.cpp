@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include "file_reader.hpp"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <vector>
+
+using namespace ImageForensics;
+using namespace testing;
+
+class FileReaderTest : public Test {
+protected:
+    void SetUp() override {
+        testDir = std::filesystem::temp_directory_path() / "file_reader_test";
+        std::filesystem::create_directories(testDir);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(testDir);
+    }
+
+    // 创建指定大小的测试文件，内容为可校验的字节序列
+    std::filesystem::path createTestFile(const std::string& name, size_t size) {
+        auto path = testDir / name;
+        std::ofstream file(path, std::ios::binary);
+        for (size_t i = 0; i < size; ++i) {
+            file.put(static_cast<char>(i % 251));
+        }
+        return path;
+    }
+
+    std::filesystem::path testDir;
+};
+
+// 测试整文件读取，文件大于单个缓冲区时需要分块
+TEST_F(FileReaderTest, ReadsWholeFilesInChunks) {
+    BatchFileReader reader(4, 4096);
+    std::vector<FileReadRequest> requests = {
+        {createTestFile("small.jpg", 100), 0},
+        {createTestFile("large.jpg", 4096 * 3 + 17), 0}
+    };
+
+    std::map<size_t, FileReadResult> results;
+    reader.readAll(requests, [&](FileReadResult&& result) {
+        results[result.index] = std::move(result);
+    });
+
+    ASSERT_EQ(results.size(), 2);
+    EXPECT_EQ(results[0].data.size(), 100);
+    EXPECT_EQ(results[1].data.size(), 4096 * 3 + 17);
+    EXPECT_FALSE(results[1].truncated);
+    for (size_t i = 0; i < results[1].data.size(); ++i) {
+        ASSERT_EQ(results[1].data[i], i % 251);
+    }
+}
+
+// 测试窗口读取只返回文件开头，同时报告真实文件大小
+TEST_F(FileReaderTest, ReadsMetadataWindow) {
+    BatchFileReader reader(2, 4096);
+    std::vector<FileReadRequest> requests = {{createTestFile("window.jpg", 10000), 1024}};
+
+    std::vector<FileReadResult> results;
+    reader.readAll(requests, [&](FileReadResult&& result) {
+        results.push_back(std::move(result));
+    });
+
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_EQ(results[0].data.size(), 1024);
+    EXPECT_EQ(results[0].fileSize, 10000);
+    EXPECT_TRUE(results[0].truncated);
+}
+
+// 测试批次大于队列深度以及不存在的文件
+TEST_F(FileReaderTest, HandlesMoreFilesThanQueueDepthAndErrors) {
+    BatchFileReader reader(2, 4096);
+    std::vector<FileReadRequest> requests;
+    for (int i = 0; i < 8; ++i) {
+        requests.push_back({createTestFile("file" + std::to_string(i) + ".jpg", 500 + i), 0});
+    }
+    requests.push_back({testDir / "missing.jpg", 0});
+
+    std::map<size_t, FileReadResult> results;
+    reader.readAll(requests, [&](FileReadResult&& result) {
+        results[result.index] = std::move(result);
+    });
+
+    ASSERT_EQ(results.size(), 9);
+    for (size_t i = 0; i < 8; ++i) {
+        EXPECT_EQ(results[i].error, 0);
+        EXPECT_EQ(results[i].data.size(), 500 + i);
+    }
+    EXPECT_NE(results[8].error, 0);
+}
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include "health_monitor.hpp"
+#include <atomic>
+#include <string>
+
+using namespace ImageForensics;
+using namespace testing;
+
+// 测试就绪检查按注册顺序执行，报告第一个不通过的原因
+TEST(HealthMonitorTest, ReadinessChecks) {
+    HealthMonitor monitor;
+    EXPECT_FALSE(monitor.notReadyReason().has_value());
+
+    std::atomic<bool> draining{false};
+    std::atomic<size_t> queueDepth{0};
+    monitor.addReadinessCheck("draining", [&]() { return !draining.load(); });
+    monitor.addReadinessCheck("overloaded", [&]() { return queueDepth.load() <= 8; });
+    EXPECT_FALSE(monitor.notReadyReason().has_value());
+
+    queueDepth = 9;
+    EXPECT_EQ(monitor.notReadyReason(), "overloaded");
+    draining = true;
+    EXPECT_EQ(monitor.notReadyReason(), "draining");
+}
+
+// 测试指标按Prometheus文本格式输出，整数值不带小数
+TEST(HealthMonitorTest, RenderMetrics) {
+    HealthMonitor monitor;
+    double depth = 3;
+    monitor.addMetric("image_forensics_worker_queue_depth", "Tasks waiting", MetricType::Gauge, [&]() { return depth; });
+    monitor.addMetric("image_forensics_requests_total", "Requests", MetricType::Counter, []() { return 42.0; });
+    monitor.addReadinessCheck("overloaded", [&]() { return depth < 10; });
+
+    std::string text = monitor.renderMetrics();
+    EXPECT_NE(text.find("# TYPE image_forensics_ready gauge\nimage_forensics_ready 1\n"), std::string::npos);
+    EXPECT_NE(text.find("# HELP image_forensics_worker_queue_depth Tasks waiting\n"), std::string::npos);
+    EXPECT_NE(text.find("image_forensics_worker_queue_depth 3\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE image_forensics_requests_total counter\nimage_forensics_requests_total 42\n"), std::string::npos);
+
+    depth = 12.5;
+    text = monitor.renderMetrics();
+    EXPECT_NE(text.find("image_forensics_ready 0\n"), std::string::npos);
+    EXPECT_NE(text.find("image_forensics_worker_queue_depth 12.5\n"), std::string::npos);
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include "multipart.hpp"
+#include "util.hpp"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace ImageForensics;
+using namespace testing;
+
+namespace {
+
+const std::string BOUNDARY = "----FormBoundary7MA4YWxkTrZu0gW";
+
+std::string makePart(const std::string& name, const std::string& filename, const std::string& content) {
+    std::string part = "--" + BOUNDARY + "\r\nContent-Disposition: form-data; name=\"" + name + "\"";
+    if (!filename.empty()) {
+        part += "; filename=\"" + filename + "\"\r\nContent-Type: image/jpeg";
+    }
+    return part + "\r\n\r\n" + content + "\r\n";
+}
+
+// 内容中包含CRLF和分隔符的前缀，解析器不能把它们当成分隔符
+std::string makeJpegContent(size_t size) {
+    std::string content = "\xFF\xD8\xFF\xE0";
+    while (content.size() < size) {
+        content += "\r\n--" + BOUNDARY.substr(0, 10) + "\r\n-";
+        content.push_back(static_cast<char>(content.size() & 0xff));
+    }
+    content.resize(size);
+    return content;
+}
+
+std::span<const unsigned char> asBytes(const std::string& text) {
+    return {reinterpret_cast<const unsigned char*>(text.data()), text.size()};
+}
+
+} // namespace
+
+// 测试从Content-Type中取出boundary
+TEST(MultipartTest, BoundaryFromContentType) {
+    EXPECT_EQ(MultipartParser::boundaryFromContentType("multipart/form-data; boundary=abc123").value_or(""), "abc123");
+    EXPECT_EQ(MultipartParser::boundaryFromContentType("Multipart/Form-Data; charset=utf-8; boundary=\"a b\"").value_or(""),
+              "a b");
+    EXPECT_FALSE(MultipartParser::boundaryFromContentType("multipart/form-data").has_value());
+    EXPECT_FALSE(MultipartParser::boundaryFromContentType("application/json; boundary=abc").has_value());
+}
+
+// 测试整段送入时文件内容直接引用请求体，同时计算哈希和识别格式，普通字段被忽略
+TEST(MultipartTest, WholeBodyIsZeroCopy) {
+    std::string first = makeJpegContent(5000);
+    std::string second = "GIF89a\x10\x00\x10\x00";
+    std::string body = "preamble\r\n" + makePart("comment", "", "hello") + makePart("image", "../a.jpg", first) +
+                       makePart("image", "b.gif", second) + "--" + BOUNDARY + "--\r\nepilogue";
+
+    std::vector<UploadedPart> parts;
+    UploadReceiver receiver(BOUNDARY, UploadOptions(), [&](UploadedPart&& part) { parts.push_back(std::move(part)); });
+    ASSERT_TRUE(receiver.feed(body));
+    EXPECT_TRUE(receiver.finished());
+    ASSERT_EQ(parts.size(), 2u);
+
+    EXPECT_EQ(parts[0].fieldName, "image");
+    EXPECT_EQ(parts[0].filename, "a.jpg");
+    EXPECT_EQ(parts[0].contentType, "image/jpeg");
+    EXPECT_EQ(parts[0].mimeType, "image/jpeg");
+    EXPECT_EQ(parts[0].size, first.size());
+    EXPECT_EQ(parts[0].contentHash, computeContentHash(asBytes(first)));
+    EXPECT_FALSE(parts[0].spilled());
+    EXPECT_GE(reinterpret_cast<const char*>(parts[0].data.data()), body.data());
+    EXPECT_LE(reinterpret_cast<const char*>(parts[0].data.data() + parts[0].data.size()), body.data() + body.size());
+
+    EXPECT_EQ(parts[1].mimeType, "image/gif");
+    EXPECT_EQ(std::string(parts[1].data.begin(), parts[1].data.end()), second);
+}
+
+// 测试逐字节送入：跨送入的分隔符和部分头都能识别，内容复制到自有缓冲区
+TEST(MultipartTest, ByteAtATime) {
+    std::string content = makeJpegContent(3000);
+    std::string body = makePart("image", "a.jpg", content) + "--" + BOUNDARY + "--";
+
+    std::vector<UploadedPart> parts;
+    UploadReceiver receiver(BOUNDARY, UploadOptions(), [&](UploadedPart&& part) { parts.push_back(std::move(part)); });
+    for (char c : body) {
+        ASSERT_TRUE(receiver.feed(std::string_view(&c, 1)));
+    }
+    EXPECT_TRUE(receiver.finished());
+    ASSERT_EQ(parts.size(), 1u);
+
+    EXPECT_EQ(std::string(parts[0].data.begin(), parts[0].data.end()), content);
+    EXPECT_EQ(parts[0].contentHash, computeContentHash(asBytes(content)));
+    EXPECT_EQ(parts[0].mimeType, "image/jpeg");
+}
+
+// 测试需要复制的内容超过阈值时写入临时文件，读回的内容一致，析构时删除
+TEST(MultipartTest, SpillsLargeBufferedParts) {
+    std::string content = makeJpegContent(200000);
+    std::string body = makePart("image", "big.jpg", content) + "--" + BOUNDARY + "--";
+
+    UploadOptions options;
+    options.spillThreshold = 64 * 1024;
+    std::vector<UploadedPart> parts;
+    UploadReceiver receiver(BOUNDARY, options, [&](UploadedPart&& part) { parts.push_back(std::move(part)); });
+    for (size_t pos = 0; pos < body.size(); pos += 4093) {
+        ASSERT_TRUE(receiver.feed(std::string_view(body).substr(pos, 4093)));
+    }
+    ASSERT_EQ(parts.size(), 1u);
+    ASSERT_TRUE(parts[0].spilled());
+    EXPECT_EQ(parts[0].size, content.size());
+
+    auto spillPath = parts[0].spillPath;
+    EXPECT_TRUE(std::filesystem::exists(spillPath));
+    auto data = parts[0].content();
+    ASSERT_TRUE(data.has_value());
+    EXPECT_EQ(std::string(data->begin(), data->end()), content);
+
+    parts.clear();
+    EXPECT_FALSE(std::filesystem::exists(spillPath));
+}
+
+// 测试格式错误和文件数量上限
+TEST(MultipartTest, Errors) {
+    std::string truncated = makePart("image", "a.jpg", "data");
+    UploadReceiver incomplete(BOUNDARY, UploadOptions(), nullptr);
+    EXPECT_TRUE(incomplete.feed(truncated));
+    EXPECT_FALSE(incomplete.finished());
+
+    UploadReceiver malformed(BOUNDARY, UploadOptions(), nullptr);
+    EXPECT_FALSE(malformed.feed("--" + BOUNDARY + "garbage\r\n\r\n"));
+    EXPECT_FALSE(malformed.error().empty());
+
+    UploadOptions options;
+    options.maxFiles = 1;
+    size_t received = 0;
+    UploadReceiver limited(BOUNDARY, options, [&](UploadedPart&&) { ++received; });
+    EXPECT_FALSE(limited.feed(makePart("a", "1.jpg", "x") + makePart("b", "2.jpg", "y") + "--" + BOUNDARY + "--"));
+    EXPECT_EQ(received, 1u);
+    EXPECT_NE(limited.error().find("Too many files"), std::string::npos);
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include "peer_cache.hpp"
+#include "util.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace ImageForensics;
+using namespace testing;
+
+// 测试节点顺序不影响归属，且各节点分到的键大致均匀
+TEST(ConsistentHashRingTest, StableAndBalanced) {
+    ConsistentHashRing ring({"http://a:8080", "http://b:8080", "http://c:8080"});
+    ConsistentHashRing reordered({"http://c:8080", "http://a:8080", "http://b:8080"});
+
+    std::map<std::string, int> counts;
+    for (int i = 0; i < 30000; ++i) {
+        std::string key = "metadata:1.1:xxh3-128:" + std::to_string(i);
+        ASSERT_EQ(*ring.nodeFor(key), *reordered.nodeFor(key));
+        counts[*ring.nodeFor(key)]++;
+    }
+
+    ASSERT_EQ(counts.size(), 3u);
+    for (const auto& [node, count] : counts) {
+        EXPECT_GT(count, 7000) << node;
+        EXPECT_LT(count, 13000) << node;
+    }
+}
+
+// 测试增加节点时只有分给新节点的键改变归属
+TEST(ConsistentHashRingTest, MinimalRemapping) {
+    ConsistentHashRing before({"a", "b", "c"});
+    ConsistentHashRing after({"a", "b", "c", "d"});
+
+    int moved = 0;
+    for (int i = 0; i < 10000; ++i) {
+        std::string key = std::to_string(i);
+        if (*before.nodeFor(key) != *after.nodeFor(key)) {
+            EXPECT_EQ(*after.nodeFor(key), "d");
+            moved++;
+        }
+    }
+    EXPECT_GT(moved, 1500);
+    EXPECT_LT(moved, 3500);
+
+    EXPECT_EQ(ConsistentHashRing({}).nodeFor("key"), nullptr);
+}
+
+// 测试缓存键的URL编码
+TEST(PeerCacheTest, KeyEncoding) {
+    std::string key = "metadata:1.1:xxh3-128:abc:photo 1/2.jpg";
+    auto encoded = PeerCache::encodeKey(key);
+    EXPECT_EQ(encoded.find_first_not_of("0123456789abcdef"), std::string::npos);
+    EXPECT_EQ(PeerCache::decodeKey(encoded), key);
+
+    EXPECT_FALSE(PeerCache::decodeKey("abc").has_value());
+    EXPECT_FALSE(PeerCache::decodeKey("zz").has_value());
+}
+
+// 测试本实例负责的键不访问网络，不可达的实例被暂时跳过
+TEST(PeerCacheTest, OwnershipAndUnreachablePeer) {
+    Logger::init(spdlog::level::off);
+
+    PeerCacheOptions options;
+    options.self = "http://127.0.0.1:1/";
+    options.peers = {"http://127.0.0.1:1", "http://127.0.0.1:2"};
+    options.timeout = std::chrono::milliseconds(100);
+    PeerCache cache(options);
+
+    std::string local;
+    std::string remote;
+    for (int i = 0; (local.empty() || remote.empty()) && i < 1000; ++i) {
+        std::string key = "key" + std::to_string(i);
+        (cache.ownerOf(key) ? remote : local) = key;
+    }
+    ASSERT_FALSE(local.empty());
+    ASSERT_FALSE(remote.empty());
+    EXPECT_EQ(cache.ownerOf(remote), "http://127.0.0.1:2");
+
+    EXPECT_FALSE(cache.fetch(local).has_value());
+    EXPECT_FALSE(cache.fetch(remote).has_value());
+
+    // 失败后在retryAfter期间内直接返回，不再等待连接
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(cache.fetch(remote).has_value());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+
+    // 未配置密钥时拒绝所有内部请求
+    std::optional<std::string> none;
+    EXPECT_FALSE(cache.authorize(none));
+    EXPECT_FALSE(cache.authorize(std::string()));
+}
+
+// 测试内部接口的密钥校验
+TEST(PeerCacheTest, AuthorizesMatchingToken) {
+    Logger::init(spdlog::level::off);
+
+    PeerCacheOptions options;
+    options.self = "http://127.0.0.1:1";
+    options.peers = {"http://127.0.0.1:1"};
+    options.secret = "s3cret";
+    PeerCache cache(options);
+
+    EXPECT_TRUE(cache.authorize(std::string("s3cret")));
+    EXPECT_FALSE(cache.authorize(std::nullopt));
+    EXPECT_FALSE(cache.authorize(std::string()));
+    EXPECT_FALSE(cache.authorize(std::string("s3cre")));
+    EXPECT_FALSE(cache.authorize(std::string("s3cret!")));
+    EXPECT_FALSE(cache.authorize(std::string("S3cret")));
+}
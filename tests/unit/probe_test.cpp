@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include "probe.hpp"
+#include "util.hpp"
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+using namespace ImageForensics;
+using namespace testing;
+
+namespace {
+
+void appendBe16(std::vector<unsigned char>& data, uint16_t value) {
+    data.push_back(static_cast<unsigned char>(value >> 8));
+    data.push_back(static_cast<unsigned char>(value & 0xff));
+}
+
+void appendLe16(std::vector<unsigned char>& data, uint16_t value) {
+    data.push_back(static_cast<unsigned char>(value & 0xff));
+    data.push_back(static_cast<unsigned char>(value >> 8));
+}
+
+void appendLe32(std::vector<unsigned char>& data, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        data.push_back(static_cast<unsigned char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+// 小端TIFF头和只包含SHORT类型条目的IFD0
+std::vector<unsigned char> makeTiff(const std::vector<std::pair<uint16_t, uint16_t>>& entries) {
+    std::vector<unsigned char> tiff = {'I', 'I', 42, 0};
+    appendLe32(tiff, 8);
+    appendLe16(tiff, static_cast<uint16_t>(entries.size()));
+    for (const auto& [tag, value] : entries) {
+        appendLe16(tiff, tag);
+        appendLe16(tiff, 3);
+        appendLe32(tiff, 1);
+        appendLe16(tiff, value);
+        appendLe16(tiff, 0);
+    }
+    appendLe32(tiff, 0);
+    return tiff;
+}
+
+// SOI、带方向的EXIF段、DQT和SOF0
+std::vector<unsigned char> makeJpeg(uint16_t width, uint16_t height, uint16_t orientation) {
+    std::vector<unsigned char> jpeg = {0xFF, 0xD8};
+
+    auto tiff = makeTiff({{0x0112, orientation}});
+    jpeg.insert(jpeg.end(), {0xFF, 0xE1});
+    appendBe16(jpeg, static_cast<uint16_t>(2 + 6 + tiff.size()));
+    jpeg.insert(jpeg.end(), {'E', 'x', 'i', 'f', 0, 0});
+    jpeg.insert(jpeg.end(), tiff.begin(), tiff.end());
+
+    jpeg.insert(jpeg.end(), {0xFF, 0xDB});
+    appendBe16(jpeg, 67);
+    jpeg.insert(jpeg.end(), 65, 1);
+
+    jpeg.insert(jpeg.end(), {0xFF, 0xC0});
+    appendBe16(jpeg, 17);
+    jpeg.push_back(8);
+    appendBe16(jpeg, height);
+    appendBe16(jpeg, width);
+    jpeg.insert(jpeg.end(), 10, 0);
+
+    jpeg.insert(jpeg.end(), {0xFF, 0xDA, 0x00, 0x08});
+    return jpeg;
+}
+
+} // namespace
+
+// 测试JPEG：跳过APP段找到SOF，并读取EXIF中的方向
+TEST(ProbeTest, Jpeg) {
+    auto jpeg = makeJpeg(4032, 3024, 6);
+
+    auto result = probeImage(jpeg, 123456);
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->mimeType, "image/jpeg");
+    EXPECT_EQ(result->width, 4032u);
+    EXPECT_EQ(result->height, 3024u);
+    EXPECT_EQ(result->orientation, 6);
+    EXPECT_EQ(result->fileSize, 123456u);
+
+    // SOF之前截断时格式已知，尺寸未知
+    auto truncated = probeImage(std::span<const unsigned char>(jpeg).first(40), 123456);
+    ASSERT_TRUE(truncated.has_value());
+    EXPECT_EQ(truncated->mimeType, "image/jpeg");
+    EXPECT_FALSE(truncated->hasDimensions());
+    EXPECT_FALSE(truncated->toJson().contains("width"));
+}
+
+// 测试PNG、GIF、BMP和TIFF的尺寸
+TEST(ProbeTest, OtherFormats) {
+    std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A, 0, 0, 0, 13, 'I', 'H', 'D', 'R',
+                                      0, 0, 0x07, 0x80, 0, 0, 0x04, 0x38};
+    auto pngResult = probeImage(png, png.size());
+    ASSERT_TRUE(pngResult.has_value());
+    EXPECT_EQ(pngResult->mimeType, "image/png");
+    EXPECT_EQ(pngResult->width, 1920u);
+    EXPECT_EQ(pngResult->height, 1080u);
+
+    std::vector<unsigned char> gif = {'G', 'I', 'F', '8', '9', 'a'};
+    appendLe16(gif, 640);
+    appendLe16(gif, 480);
+    auto gifResult = probeImage(gif, gif.size());
+    ASSERT_TRUE(gifResult.has_value());
+    EXPECT_EQ(gifResult->width, 640u);
+    EXPECT_EQ(gifResult->height, 480u);
+
+    // 高度为负的自上而下BMP
+    std::vector<unsigned char> bmp = {'B', 'M'};
+    bmp.insert(bmp.end(), 12, 0);
+    appendLe32(bmp, 40);
+    appendLe32(bmp, 800);
+    appendLe32(bmp, static_cast<uint32_t>(-600));
+    auto bmpResult = probeImage(bmp, bmp.size());
+    ASSERT_TRUE(bmpResult.has_value());
+    EXPECT_EQ(bmpResult->width, 800u);
+    EXPECT_EQ(bmpResult->height, 600u);
+
+    auto tiff = makeTiff({{0x0100, 300}, {0x0101, 200}, {0x0112, 3}});
+    auto tiffResult = probeImage(tiff, tiff.size());
+    ASSERT_TRUE(tiffResult.has_value());
+    EXPECT_EQ(tiffResult->mimeType, "image/tiff");
+    EXPECT_EQ(tiffResult->width, 300u);
+    EXPECT_EQ(tiffResult->height, 200u);
+    EXPECT_EQ(tiffResult->orientation, 3);
+
+    std::vector<unsigned char> text = {'h', 'e', 'l', 'l', 'o', ' ', 'w', 'o', 'r', 'l', 'd', '!'};
+    EXPECT_FALSE(probeImage(text, text.size()).has_value());
+}
+
+// 测试从文件探测和像素数上限
+TEST(ProbeTest, FileAndPixelLimit) {
+    // 声明65535x65535的PNG，只有文件头
+    std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A, 0, 0, 0, 13, 'I', 'H', 'D', 'R',
+                                      0, 0, 0xFF, 0xFF, 0, 0, 0xFF, 0xFF};
+    auto path = std::filesystem::temp_directory_path() / "probe_test_bomb.png";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+    }
+
+    auto result = probeImage(path);
+    std::filesystem::remove(path);
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->fileSize, png.size());
+    EXPECT_EQ(result->pixels(), 65535ull * 65535ull);
+    EXPECT_TRUE(exceedsPixelLimit(*result, DEFAULT_MAX_PIXELS));
+    EXPECT_FALSE(exceedsPixelLimit(*result, 0));
+
+    EXPECT_FALSE(probeImage(std::filesystem::path("/nonexistent/probe.png")).has_value());
+}
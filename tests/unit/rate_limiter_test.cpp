@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include "rate_limiter.hpp"
+#include "util.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ImageForensics;
+using namespace testing;
+
+namespace {
+
+RateLimitOptions makeOptions(double requestsPerMinute, double burst, size_t shards = 64) {
+    RateLimitOptions options;
+    options.enabled = true;
+    options.requestsPerMinute = requestsPerMinute;
+    options.burst = burst;
+    options.shards = shards;
+    return options;
+}
+
+} // namespace
+
+// 测试令牌桶容量、惰性补充和客户端之间相互独立
+TEST(RateLimiterTest, BurstAndRefill) {
+    Logger::init(spdlog::level::warn);
+    RateLimiter limiter(makeOptions(60, 3));
+    auto start = RateLimiter::Clock::now();
+
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_TRUE(limiter.acquire("ip:10.0.0.1", start).allowed);
+    }
+    auto rejected = limiter.acquire("ip:10.0.0.1", start);
+    EXPECT_FALSE(rejected.allowed);
+    EXPECT_GT(rejected.retryAfter.count(), 0);
+    EXPECT_LE(rejected.retryAfter.count(), 1000);
+
+    // 另一个客户端不受影响
+    EXPECT_TRUE(limiter.acquire("ip:10.0.0.2", start).allowed);
+
+    // 每分钟60个请求，1秒补充一个令牌
+    EXPECT_TRUE(limiter.acquire("ip:10.0.0.1", start + std::chrono::seconds(1)).allowed);
+    EXPECT_FALSE(limiter.acquire("ip:10.0.0.1", start + std::chrono::seconds(1)).allowed);
+
+    // 长时间空闲后令牌桶只恢复到容量
+    auto later = start + std::chrono::minutes(10);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_TRUE(limiter.acquire("ip:10.0.0.1", later).allowed);
+    }
+    EXPECT_FALSE(limiter.acquire("ip:10.0.0.1", later).allowed);
+}
+
+// 测试槽位被占满时：空闲客户端的槽位被接管，其余客户端共用溢出令牌桶
+TEST(RateLimiterTest, FullTable) {
+    RateLimiter limiter(makeOptions(60, 1, 1));
+    auto start = RateLimiter::Clock::now();
+
+    for (size_t i = 0; i < RateLimiter::SLOTS_PER_SHARD; ++i) {
+        EXPECT_TRUE(limiter.acquire("client" + std::to_string(i), start).allowed);
+    }
+    EXPECT_TRUE(limiter.acquire("overflow-a", start).allowed);
+    EXPECT_FALSE(limiter.acquire("overflow-b", start).allowed);
+
+    // 1秒后所有令牌桶都已装满，新客户端接管空闲的槽位
+    auto later = start + std::chrono::seconds(1);
+    EXPECT_TRUE(limiter.acquire("overflow-b", later).allowed);
+    EXPECT_FALSE(limiter.acquire("overflow-b", later).allowed);
+}
+
+// 测试并发获取时放行的请求数量恰好等于令牌桶容量
+TEST(RateLimiterTest, ConcurrentAcquire) {
+    RateLimiter limiter(makeOptions(1, 100));
+    auto start = RateLimiter::Clock::now();
+
+    std::atomic<int> allowed{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 50; ++i) {
+                if (limiter.acquire("key:shared", start).allowed) {
+                    ++allowed;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(allowed.load(), 100);
+}
+
+// 测试同一IP不断更换未知的API密钥无法绕开限流，配置过的密钥单独限流
+TEST(RateLimiterTest, RotatingKeysShareAddressBucket) {
+    RateLimitOptions options = makeOptions(60, 3);
+    options.apiKeys = {"known"};
+    RateLimiter limiter(options);
+    auto start = RateLimiter::Clock::now();
+
+    int allowed = 0;
+    for (int i = 0; i < 20; ++i) {
+        std::string key = "random" + std::to_string(i);
+        if (limiter.acquire(options.clientKey("10.0.0.1", key), start).allowed) {
+            allowed++;
+        }
+    }
+    EXPECT_EQ(allowed, 3);
+    EXPECT_FALSE(limiter.acquire(options.clientKey("10.0.0.1", std::nullopt), start).allowed);
+
+    // 配置过的密钥不占用所在地址的令牌桶
+    EXPECT_TRUE(limiter.acquire(options.clientKey("10.0.0.1", "known"), start).allowed);
+    EXPECT_NE(options.clientKey("10.0.0.1", "known"), options.clientKey("10.0.0.1", std::nullopt));
+}
+
+// 测试豁免路径按前缀匹配
+TEST(RateLimiterTest, ExemptPaths) {
+    RateLimitOptions options;
+    EXPECT_TRUE(options.isExempt("/health"));
+    EXPECT_FALSE(options.isExempt("/internal/cache/abc"));
+    EXPECT_FALSE(options.isExempt("/metadata"));
+}
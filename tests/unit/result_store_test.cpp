@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include "result_store.hpp"
+#include "util.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ImageForensics;
+using namespace testing;
+
+namespace {
+
+std::vector<uint8_t> bytes(const std::string& text) {
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+class ResultStoreTest : public Test {
+protected:
+    void SetUp() override {
+        Logger::init(spdlog::level::warn);
+        directory = std::filesystem::temp_directory_path() / ("result_store_test_" + generateUuid());
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(directory);
+    }
+
+    std::filesystem::path directory;
+};
+
+} // namespace
+
+// 测试写入、读取、覆盖和删除
+TEST_F(ResultStoreTest, PutGetOverwriteErase) {
+    ResultStore store(directory);
+    EXPECT_FALSE(store.get("missing").has_value());
+
+    ASSERT_TRUE(store.put("a", bytes("first")));
+    EXPECT_EQ(store.get("a"), bytes("first"));
+
+    ASSERT_TRUE(store.put("a", bytes("second")));
+    EXPECT_EQ(store.get("a"), bytes("second"));
+    EXPECT_EQ(store.size(), 1u);
+
+    store.erase("a");
+    EXPECT_FALSE(store.get("a").has_value());
+    EXPECT_EQ(store.size(), 0u);
+}
+
+// 测试重启后通过索引直接恢复
+TEST_F(ResultStoreTest, SurvivesRestart) {
+    {
+        ResultStore store(directory);
+        for (int i = 0; i < 100; ++i) {
+            store.put("key" + std::to_string(i), bytes("value" + std::to_string(i)));
+        }
+    }
+
+    ResultStore store(directory);
+    EXPECT_EQ(store.size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(store.get("key" + std::to_string(i)), bytes("value" + std::to_string(i)));
+    }
+}
+
+// 测试索引丢失时从日志重建，删除的键不会复活
+TEST_F(ResultStoreTest, RebuildsMissingIndex) {
+    {
+        ResultStore store(directory);
+        store.put("kept", bytes("value"));
+        store.put("erased", bytes("value"));
+        store.erase("erased");
+    }
+
+    std::filesystem::remove(directory / "index.bin");
+
+    ResultStore store(directory);
+    EXPECT_EQ(store.get("kept"), bytes("value"));
+    EXPECT_FALSE(store.get("erased").has_value());
+}
+
+// 测试不完整的尾部记录被截掉，之前的记录不受影响
+TEST_F(ResultStoreTest, TruncatesTornTail) {
+    {
+        ResultStore store(directory);
+        store.put("a", bytes("value"));
+    }
+
+    std::filesystem::remove(directory / "index.bin");
+    {
+        std::ofstream segment(directory / "segment-00000001.log", std::ios::binary | std::ios::app);
+        segment << "garbage";
+    }
+
+    ResultStore store(directory);
+    EXPECT_EQ(store.get("a"), bytes("value"));
+    ASSERT_TRUE(store.put("b", bytes("after")));
+    EXPECT_EQ(store.get("b"), bytes("after"));
+}
+
+// 测试索引扩容
+TEST_F(ResultStoreTest, GrowsIndex) {
+    ResultStoreOptions options;
+    options.initialIndexCapacity = 64;
+    ResultStore store(directory, options);
+
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(store.put("key" + std::to_string(i), bytes(std::to_string(i))));
+    }
+    EXPECT_EQ(store.size(), 1000u);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(store.get("key" + std::to_string(i)), bytes(std::to_string(i)));
+    }
+}
+
+// 测试压缩删除以失效记录为主的旧段，有效记录迁移后仍可读取
+TEST_F(ResultStoreTest, CompactsSegments) {
+    ResultStoreOptions options;
+    options.segmentSize = 4096;
+    ResultStore store(directory, options);
+
+    std::string payload(200, 'x');
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 20; ++i) {
+            store.put("key" + std::to_string(i), bytes(payload + std::to_string(round)));
+        }
+    }
+    uint64_t before = store.diskBytes();
+
+    EXPECT_GT(store.compact(), 0u);
+    EXPECT_LT(store.diskBytes(), before);
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(store.get("key" + std::to_string(i)), bytes(payload + "4"));
+    }
+}
+
+// 测试压缩掉删除标记所在的段时，更早的段里仍有原记录，重建索引后被删除的键不会复活
+TEST_F(ResultStoreTest, CompactionKeepsTombstonesForOlderSegments) {
+    ResultStoreOptions options;
+    options.segmentSize = 4096;
+    std::string payload(200, 'x');
+    {
+        ResultStore store(directory, options);
+
+        // 第一个段几乎全是有效记录，不会被压缩
+        store.put("erased", bytes(payload));
+        for (int i = 0; i < 14; ++i) {
+            store.put("kept" + std::to_string(i), bytes(payload));
+        }
+
+        // 删除标记写在之后的段里，该段的其他记录随后全部被覆盖
+        for (int i = 0; i < 10; ++i) {
+            store.put("filler" + std::to_string(i), bytes(payload));
+        }
+        store.erase("erased");
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 0; i < 10; ++i) {
+                store.put("filler" + std::to_string(i), bytes(payload + std::to_string(round)));
+            }
+        }
+
+        EXPECT_GT(store.compact(), 0u);
+        EXPECT_FALSE(store.get("erased").has_value());
+    }
+
+    std::filesystem::remove(directory / "index.bin");
+
+    ResultStore store(directory, options);
+    EXPECT_FALSE(store.get("erased").has_value());
+    EXPECT_EQ(store.get("kept0"), bytes(payload));
+    EXPECT_EQ(store.get("filler0"), bytes(payload + "1"));
+}
+
+// 测试所有记录都已过期的段被直接删除，即使它们从未被覆盖
+TEST_F(ResultStoreTest, DropsExpiredSegments) {
+    ResultStoreOptions options;
+    options.segmentSize = 4096;
+    options.maxAge = std::chrono::seconds(1);
+    options.compactionRatio = 0.0;
+    ResultStore store(directory, options);
+
+    std::string payload(200, 'x');
+    for (int i = 0; i < 60; ++i) {
+        store.put("old" + std::to_string(i), bytes(payload));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+    for (int i = 0; i < 20; ++i) {
+        store.put("new" + std::to_string(i), bytes(payload));
+    }
+    uint64_t before = store.diskBytes();
+
+    EXPECT_GE(store.compact(), 3u);
+    EXPECT_LT(store.diskBytes(), before / 2);
+    EXPECT_FALSE(store.get("old0").has_value());
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(store.get("new" + std::to_string(i)), bytes(payload));
+    }
+}
+
+// 测试选择压缩候选段时过期记录不算作有效数据
+TEST_F(ResultStoreTest, ExpiredRecordsCountAsDead) {
+    ResultStoreOptions options;
+    options.segmentSize = 4096;
+    options.maxAge = std::chrono::seconds(2);
+    options.compactionRatio = 0.6;
+    ResultStore store(directory, options);
+
+    // 同一个段里前一半记录过期，后一半仍有效，没有任何记录被覆盖
+    std::string payload(200, 'x');
+    for (int i = 0; i < 8; ++i) {
+        store.put("old" + std::to_string(i), bytes(payload));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    for (int i = 0; i < 20; ++i) {
+        store.put("new" + std::to_string(i), bytes(payload));
+    }
+
+    EXPECT_GT(store.compact(), 0u);
+    EXPECT_FALSE(store.get("old0").has_value());
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(store.get("new" + std::to_string(i)), bytes(payload));
+    }
+    EXPECT_EQ(store.size(), 20u);
+}
+
+// 测试超出字节上限时从最旧的段开始删除
+TEST_F(ResultStoreTest, EnforcesByteBudget) {
+    ResultStoreOptions options;
+    options.segmentSize = 4096;
+    options.maxBytes = 16384;
+    ResultStore store(directory, options);
+
+    std::string payload(200, 'x');
+    for (int i = 0; i < 200; ++i) {
+        store.put("key" + std::to_string(i), bytes(payload));
+    }
+    EXPECT_GT(store.diskBytes(), options.maxBytes);
+
+    EXPECT_GT(store.enforceByteBudget(), 0u);
+    EXPECT_LE(store.diskBytes(), options.maxBytes);
+    EXPECT_FALSE(store.get("key0").has_value());
+    EXPECT_EQ(store.get("key199"), bytes(payload));
+    EXPECT_LT(store.size(), 200u);
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include "shm_ingest.hpp"
+#include "util.hpp"
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using namespace ImageForensics;
+using namespace testing;
+
+namespace {
+
+std::filesystem::path socketPath() {
+    return std::filesystem::temp_directory_path() / ("shm_ingest_test_" + std::to_string(::getpid()) + ".sock");
+}
+
+} // namespace
+
+// 测试图像经共享内存提交，处理函数读取槽位的副本，结果写回槽位并出现在完成环中
+TEST(SharedMemoryIngestTest, SubmitAndComplete) {
+    Logger::init(spdlog::level::warn);
+    ThreadPool pool(2);
+    const unsigned char* seen = nullptr;
+
+    SharedMemoryIngestOptions options;
+    options.socketPath = socketPath();
+    options.slotCount = 4;
+    options.slotSize = 4096;
+    SharedMemoryIngestServer server(options, pool, [&](IngestOperation operation, IngestFormat format,
+                                                       std::span<const unsigned char> data)
+                                                       -> Task<SharedMemoryIngestServer::Result> {
+        seen = data.data();
+        if (data.size() > 100) {
+            co_return SharedMemoryIngestServer::Result{200, std::string(5000, 'x')};
+        }
+        std::string body = std::string(data.begin(), data.end()) + "|" +
+                           std::to_string(static_cast<int>(operation)) + std::to_string(static_cast<int>(format));
+        co_return SharedMemoryIngestServer::Result{200, body};
+    });
+    server.start();
+
+    SharedMemoryIngestClient client(options.socketPath);
+    ASSERT_EQ(client.slotCount(), 4u);
+    ASSERT_EQ(client.slotSize(), 4096u);
+
+    auto slot = client.slot(2);
+    std::memcpy(slot.data(), "image", 5);
+    IngestSubmission submission;
+    submission.userData = 42;
+    submission.slot = 2;
+    submission.length = 5;
+    submission.operation = IngestOperation::Forensics;
+    submission.format = IngestFormat::Cbor;
+    ASSERT_TRUE(client.submit(submission));
+
+    auto completion = client.wait(std::chrono::seconds(5));
+    ASSERT_TRUE(completion.has_value());
+    EXPECT_EQ(completion->userData, 42u);
+    EXPECT_EQ(completion->slot, 2u);
+    EXPECT_EQ(completion->status, 200u);
+    auto result = client.result(*completion);
+    EXPECT_EQ(std::string(result.begin(), result.end()), "image|21");
+    EXPECT_NE(seen, nullptr);
+    EXPECT_EQ(server.sessionCount(), 1u);
+
+    // 结果超过槽位大小
+    submission.userData = 43;
+    submission.length = 200;
+    ASSERT_TRUE(client.submit(submission));
+    completion = client.wait(std::chrono::seconds(5));
+    ASSERT_TRUE(completion.has_value());
+    EXPECT_EQ(completion->status, 507u);
+    EXPECT_EQ(completion->length, 0u);
+
+    // 无效的槽位和超过槽位大小的图像
+    submission.userData = 44;
+    submission.slot = 9;
+    submission.length = 5;
+    ASSERT_TRUE(client.submit(submission));
+    completion = client.wait(std::chrono::seconds(5));
+    ASSERT_TRUE(completion.has_value());
+    EXPECT_EQ(completion->userData, 44u);
+    EXPECT_EQ(completion->status, 400u);
+
+    submission.slot = 0;
+    submission.length = 8192;
+    ASSERT_TRUE(client.submit(submission));
+    completion = client.wait(std::chrono::seconds(5));
+    ASSERT_TRUE(completion.has_value());
+    EXPECT_EQ(completion->status, 400u);
+
+    EXPECT_FALSE(client.poll().has_value());
+    server.stop();
+    EXPECT_FALSE(std::filesystem::exists(options.socketPath));
+}
+
+// 测试客户端不读取完成项时服务端不覆盖完成环中尚未读取的项：拒绝被丢弃，结果无法送达时断开连接
+TEST(SharedMemoryIngestTest, FullCompletionRing) {
+    ThreadPool pool(1);
+    SharedMemoryIngestOptions options;
+    options.socketPath = socketPath();
+    options.slotCount = 2;
+    options.slotSize = 4096;
+    SharedMemoryIngestServer server(options, pool, [](IngestOperation, IngestFormat, std::span<const unsigned char>)
+                                                       -> Task<SharedMemoryIngestServer::Result> {
+        co_return SharedMemoryIngestServer::Result{200, "ok"};
+    });
+    server.start();
+
+    SharedMemoryIngestClient client(options.socketPath);
+    IngestSubmission submission;
+    submission.slot = 9;
+
+    // 收到第一个完成项时会话线程已经在运行，会话已经计入
+    ASSERT_TRUE(client.submit(submission));
+    ASSERT_TRUE(client.wait(std::chrono::seconds(5)).has_value());
+    EXPECT_EQ(server.sessionCount(), 1u);
+
+    for (uint64_t i = 1; i <= 3; ++i) {
+        submission.userData = i;
+        ASSERT_TRUE(client.submit(submission));
+    }
+    submission.userData = 4;
+    submission.slot = 0;
+    submission.length = 1;
+    ASSERT_TRUE(client.submit(submission));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (server.sessionCount() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(server.sessionCount(), 0u);
+
+    // 完成环容纳两项，第三个拒绝和无法送达的结果都没有覆盖它们
+    std::vector<uint64_t> received;
+    while (auto completion = client.poll()) {
+        received.push_back(completion->userData);
+    }
+    EXPECT_EQ(received, (std::vector<uint64_t>{1, 2}));
+}
+
+// 测试连接数量上限
+TEST(SharedMemoryIngestTest, SessionLimit) {
+    ThreadPool pool(1);
+    SharedMemoryIngestOptions options;
+    options.socketPath = socketPath();
+    options.slotCount = 1;
+    options.slotSize = 4096;
+    options.maxSessions = 1;
+    SharedMemoryIngestServer server(options, pool, [](IngestOperation, IngestFormat, std::span<const unsigned char>)
+                                                       -> Task<SharedMemoryIngestServer::Result> {
+        co_return SharedMemoryIngestServer::Result();
+    });
+    server.start();
+
+    SharedMemoryIngestClient first(options.socketPath);
+    EXPECT_THROW(SharedMemoryIngestClient second(options.socketPath), ImageForensicsException);
+}
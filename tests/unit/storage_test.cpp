@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+#include "storage.hpp"
+#include "multipart.hpp"
+#include "util.hpp"
+#include <filesystem>
+#include <fstream>
+
+using namespace ImageForensics;
+using namespace testing;
+
+namespace {
+
+class FileCacheTest : public Test {
+protected:
+    void SetUp() override {
+        Logger::init(spdlog::level::warn);
+        directory = std::filesystem::temp_directory_path() / ("storage_test_" + generateUuid());
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(directory);
+    }
+
+    std::filesystem::path directory;
+};
+
+} // namespace
+
+// 测试两种编码的内容和ETag
+TEST(CachedResponseTest, EncodesJsonAndCbor) {
+    json result = {{"status", "success"}, {"value", 42}};
+    auto response = makeCachedResponse(result, true);
+
+    EXPECT_EQ(json::parse(response->decodeJson()), result);
+    EXPECT_EQ(json::from_cbor(response->decodeCbor()), result);
+
+    EXPECT_EQ(response->jsonETag.front(), '"');
+    EXPECT_EQ(response->jsonETag.back(), '"');
+    EXPECT_NE(response->jsonETag, response->cborETag);
+    // ETag只取决于编码后的字节，从CBOR重建的相同结果得到相同的ETag
+    EXPECT_EQ(makeCachedResponse(json::from_cbor(response->decodeCbor()), true)->jsonETag, response->jsonETag);
+    EXPECT_NE(makeCachedResponse(json{{"status", "success"}, {"value", 43}}, true)->jsonETag, response->jsonETag);
+
+    // 不要求ETag时不生成
+    EXPECT_TRUE(makeCachedResponse(result)->jsonETag.empty());
+}
+
+// 测试内存缓存命中时返回同一个响应对象
+TEST_F(FileCacheTest, ReturnsSharedResponse) {
+    FileCache cache(directory, std::chrono::seconds(60));
+    auto response = makeCachedResponse({{"status", "success"}}, true);
+    cache.cacheResponse("key", response);
+
+    EXPECT_EQ(cache.getCachedResponse("key"), response);
+    EXPECT_EQ(cache.getCachedResponse("missing"), nullptr);
+}
+
+// 测试重启后从持久化存储恢复响应和ETag
+TEST_F(FileCacheTest, RestoresResponseFromStore) {
+    json result = {{"status", "success"}, {"metadata", {{"width", 640}}}};
+    auto response = makeCachedResponse(result, true);
+    {
+        FileCache cache(directory, std::chrono::seconds(60));
+        ASSERT_TRUE(cache.enablePersistence(ResultStoreOptions{}));
+        cache.cacheResponse("key", response);
+    }
+
+    FileCache cache(directory, std::chrono::seconds(60));
+    ASSERT_TRUE(cache.enablePersistence(ResultStoreOptions{}));
+    auto restored = cache.getCachedResponse("key");
+    ASSERT_NE(restored, nullptr);
+    EXPECT_EQ(restored->jsonBody, response->jsonBody);
+    EXPECT_EQ(restored->cborBody, response->cborBody);
+    EXPECT_EQ(restored->jsonETag, response->jsonETag);
+}
+
+// 测试压缩后的形式计入内存缓存的字节预算
+TEST_F(FileCacheTest, CompressedFormsCountTowardsBudget) {
+    constexpr size_t BUDGET = 1024 * 1024;
+    FileCache cache(directory, std::chrono::seconds(60), BUDGET, 1, std::chrono::hours(1));
+
+    auto makeResponse = [](int i) {
+        std::string noise;
+        for (int j = 0; j < 400; ++j) {
+            noise += generateUuid();
+        }
+        return makeCachedResponse({{"status", "success"}, {"index", i}, {"noise", noise}}, true);
+    };
+
+    cache.cacheResponse("first", makeResponse(0));
+    size_t before = cache.memoryBytes();
+    auto first = cache.getCachedResponse("first");
+    ASSERT_NE(first, nullptr);
+    auto body = cache.compressedResponse(first, false, ContentEncoding::Gzip);
+    ASSERT_NE(body, nullptr);
+    EXPECT_EQ(cache.memoryBytes(), before + body->size());
+
+    // 再次获取同一形式不重复计费
+    cache.compressedResponse(first, false, ContentEncoding::Gzip);
+    EXPECT_EQ(cache.memoryBytes(), before + body->size());
+
+    for (int i = 0; i < 64; ++i) {
+        std::string key = "key" + std::to_string(i);
+        cache.cacheResponse(key, makeResponse(i));
+        for (int j = 0; j <= i; ++j) {
+            if (auto cached = cache.getCachedResponse("key" + std::to_string(j))) {
+                cache.compressedResponse(cached, false, ContentEncoding::Gzip);
+                cache.compressedResponse(cached, true, ContentEncoding::Gzip);
+            }
+        }
+        EXPECT_LE(cache.memoryBytes(), BUDGET);
+    }
+}
+
+// 测试清理让持久化存储回到字节上限以内
+TEST_F(FileCacheTest, CleanupEnforcesDiskBudget) {
+    FileCache cache(directory, std::chrono::seconds(60), 1024 * 1024, 0, std::chrono::hours(1));
+    ResultStoreOptions options;
+    options.segmentSize = 4096;
+    options.maxBytes = 16384;
+    ASSERT_TRUE(cache.enablePersistence(options));
+
+    for (int i = 0; i < 200; ++i) {
+        cache.cacheResponse("key" + std::to_string(i),
+                            makeCachedResponse({{"status", "success"}, {"id", generateUuid()}, {"index", i}}));
+    }
+
+    auto diskBytes = [&]() {
+        uintmax_t total = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(directory / "results")) {
+            if (entry.path().extension() == ".log") {
+                total += entry.file_size();
+            }
+        }
+        return total;
+    };
+    EXPECT_GT(diskBytes(), options.maxBytes);
+
+    cache.cleanupCache();
+    EXPECT_LE(diskBytes(), options.maxBytes);
+    EXPECT_NE(cache.getCachedResponse("key199"), nullptr);
+}
+
+// 测试清理只删除长时间未修改的上传临时文件
+TEST_F(FileCacheTest, RemovesStaleUploads) {
+    FileCache cache(directory, std::chrono::seconds(60), 1024 * 1024, 0, std::chrono::hours(1));
+    auto spillPath = [&](const std::string& id) {
+        return directory / (std::string(UploadReceiver::SPILL_PREFIX) + id + UploadReceiver::SPILL_SUFFIX);
+    };
+    auto stale = spillPath("stale");
+    auto fresh = spillPath("fresh");
+    auto other = directory / "stale.tmp";
+    for (const auto& path : {stale, fresh, other}) {
+        std::ofstream(path) << "data";
+    }
+    auto old = std::filesystem::file_time_type::clock::now() - std::chrono::hours(2);
+    std::filesystem::last_write_time(stale, old);
+    std::filesystem::last_write_time(other, old);
+
+    EXPECT_EQ(cache.removeStaleUploads(), 1u);
+    EXPECT_FALSE(std::filesystem::exists(stale));
+    EXPECT_TRUE(std::filesystem::exists(fresh));
+    EXPECT_TRUE(std::filesystem::exists(other));
+}
@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+#include "util.hpp"
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <atomic>
+#include <thread>
+
+using namespace ImageForensics;
+using namespace testing;
+
+namespace {
+
+std::span<const unsigned char> asBytes(const std::string& text) {
+    return std::span<const unsigned char>(reinterpret_cast<const unsigned char*>(text.data()), text.size());
+}
+
+} // namespace
+
+// 测试MIME类型到扩展名的映射，原始请求体上传据此确定文件名
+TEST(MimeTypeTest, ExtensionForMimeType) {
+    EXPECT_EQ(extensionForMimeType("image/jpeg"), ".jpg");
+    EXPECT_EQ(extensionForMimeType("Image/PNG; charset=binary"), ".png");
+    EXPECT_EQ(extensionForMimeType("image/webp"), "");
+    EXPECT_EQ(extensionForMimeType("application/octet-stream"), "");
+}
+
+#ifndef IMAGE_FORENSICS_HAVE_XXHASH
+// 测试内容哈希与MurmurHash3 x64 128位参考实现一致
+TEST(ContentHashTest, MatchesReferenceVector) {
+    EXPECT_EQ(computeContentHash(asBytes("hello world, this is a test!")), "563d1507e16dbc1929ab27b965ecd740");
+    EXPECT_EQ(computeContentHash({}), "00000000000000000000000000000000");
+}
+#endif
+
+// 测试分块追加与一次性计算结果相同
+TEST(ContentHashTest, IncrementalUpdateMatchesOneShot) {
+    std::string data;
+    for (int i = 0; i < 1000; ++i) {
+        data.push_back(static_cast<char>(i * 7));
+    }
+
+    for (size_t chunkSize : {1, 3, 15, 16, 17, 255}) {
+        ContentHasher hasher;
+        for (size_t offset = 0; offset < data.size(); offset += chunkSize) {
+            hasher.update(asBytes(data).subspan(offset, std::min(chunkSize, data.size() - offset)));
+        }
+        EXPECT_EQ(hasher.hexDigest(), computeContentHash(asBytes(data))) << "chunk size " << chunkSize;
+    }
+}
+
+// 测试不同内容得到不同哈希
+TEST(ContentHashTest, DifferentContentDifferentHash) {
+    EXPECT_NE(computeContentHash(asBytes("image-a")), computeContentHash(asBytes("image-b")));
+}
+
+// 测试读取文件时计算的哈希与读取后计算的一致
+TEST(ContentHashTest, ReadFileContentsHashesWhileReading) {
+    std::string data(200 * 1024, '\0');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(i * 31);
+    }
+
+    auto path = std::filesystem::temp_directory_path() / "util_test_hash_read.bin";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+
+    ContentHasher hasher;
+    auto contents = readFileContents(path, hasher);
+    std::filesystem::remove(path);
+
+    ASSERT_TRUE(contents.has_value());
+    EXPECT_EQ(contents->size(), data.size());
+    EXPECT_EQ(hasher.hexDigest(), computeContentHash(asBytes(data)));
+}
+
+// 测试点分隔的键按层级读取嵌套的配置文件，顶层存在完整的键时优先
+TEST(ConfigTest, NestedKeys) {
+    Logger::init(spdlog::level::warn);
+    auto path = std::filesystem::temp_directory_path() / "config_test_nested.json";
+    {
+        std::ofstream file(path);
+        file << R"({"server": {"port": 9090, "timeout": 5}, "advanced": {"worker_threads": 3},)"
+             << R"( "security": {"rate_limit": {"enabled": true}}, "cache.path": "flat"})";
+    }
+    ASSERT_TRUE(Config::load(path));
+
+    EXPECT_EQ(Config::get<int>("server.port", 8080), 9090);
+    EXPECT_EQ(Config::get<int>("server.timeout", 30), 5);
+    EXPECT_EQ(Config::get<size_t>("advanced.worker_threads", 8), 3u);
+    EXPECT_TRUE(Config::get<bool>("security.rate_limit.enabled", false));
+    EXPECT_EQ(Config::get<std::string>("cache.path", "cache"), "flat");
+
+    // 缺失的键、穿过非对象的路径和类型不匹配时使用默认值
+    EXPECT_EQ(Config::get<int>("server.threads", 4), 4);
+    EXPECT_EQ(Config::get<int>("server.port.value", 1), 1);
+    EXPECT_EQ(Config::get<std::string>("server.port", "none"), "none");
+    std::filesystem::remove(path);
+}
+
+// 测试set创建缺失的层级，不影响同级的其他键
+TEST(ConfigTest, SetCreatesMissingLevels) {
+    auto path = std::filesystem::temp_directory_path() / "config_test_set.json";
+    {
+        std::ofstream file(path);
+        file << R"({"server": {"port": 9090, "route_limits": {"/metadata/batch": 100}}})";
+    }
+    ASSERT_TRUE(Config::load(path));
+
+    auto limits = Config::get<std::map<std::string, size_t>>("server.route_limits", {});
+    EXPECT_EQ(limits["/metadata/batch"], 100u);
+
+    Config::set("security.rate_limit.burst", 5);
+    Config::set("server.threads", 2);
+    EXPECT_EQ(Config::get<int>("security.rate_limit.burst", 0), 5);
+    EXPECT_EQ(Config::get<int>("server.threads", 4), 2);
+    EXPECT_EQ(Config::get<int>("server.port", 8080), 9090);
+    std::filesystem::remove(path);
+}
+
+// 测试其他线程在发布之后的下一次读取就看到新的设置，读取与写入并发时不出错
+TEST(ConfigTest, OtherThreadsSeePublishedSettings) {
+    Config::set("metadata.max_pixels", 1);
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> seen{0};
+
+    std::thread reader([&]() {
+        while (!stop.load()) {
+            seen.store(Config::settings().maxPixels);
+            Config::get<int>("server.port", 0);
+        }
+    });
+
+    for (uint64_t value = 2; value <= 200; ++value) {
+        Config::set("metadata.max_pixels", value);
+    }
+    while (seen.load() != 200) {
+        std::this_thread::yield();
+    }
+    stop.store(true);
+    reader.join();
+
+    // 新线程直接读到当前快照
+    uint64_t fresh = 0;
+    std::thread([&]() { fresh = Config::settings().maxPixels; }).join();
+    EXPECT_EQ(fresh, 200u);
+    Config::set("metadata.max_pixels", DEFAULT_MAX_PIXELS);
+}
+
+// 测试运行设置随重新加载更新，之前取得的设置不受影响
+TEST(ConfigTest, ReloadPublishesNewSettings) {
+    auto path = std::filesystem::temp_directory_path() / "config_test_reload.json";
+    {
+        std::ofstream file(path);
+        file << R"({"server": {"timeout": 10}, "metadata": {"max_pixels": 1000}})";
+    }
+    ASSERT_TRUE(Config::load(path));
+    RuntimeSettings before = Config::settings();
+    EXPECT_EQ(before.requestTimeout, std::chrono::seconds(10));
+    EXPECT_EQ(before.maxPixels, 1000u);
+    EXPECT_EQ(before.ioQueueDepth, 64u);
+    EXPECT_FALSE(Config::reloadIfChanged());
+
+    {
+        std::ofstream file(path, std::ios::trunc);
+        file << R"({"server": {"timeout": 20}, "io": {"queue_depth": 8}})";
+    }
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(1));
+    EXPECT_TRUE(Config::reloadIfChanged());
+    EXPECT_EQ(Config::settings().requestTimeout, std::chrono::seconds(20));
+    EXPECT_EQ(Config::settings().maxPixels, DEFAULT_MAX_PIXELS);
+    EXPECT_EQ(Config::settings().ioQueueDepth, 8u);
+    EXPECT_EQ(before.requestTimeout, std::chrono::seconds(10));
+
+    // 无法解析的文件不替换当前配置
+    {
+        std::ofstream file(path, std::ios::trunc);
+        file << "{";
+    }
+    EXPECT_FALSE(Config::reload());
+    EXPECT_EQ(Config::settings().requestTimeout, std::chrono::seconds(20));
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,552 @@
+#include "service.hpp"
+#include "metadata.hpp"
+#include "async.hpp"
+#include "file_reader.hpp"
+#include "util.hpp"
+#include <nlohmann/json.hpp>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <unordered_set>
+
+using namespace ImageForensics;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+// GNU长文件名和pax扩展头的大小上限，超过时视为损坏的归档，不按头中的大小分配内存
+constexpr uint64_t MAX_TAR_EXTENSION_SIZE = 1024 * 1024;
+
+// 每写出多少条记录同步一次输出和检查点
+constexpr size_t FLUSH_INTERVAL = 256;
+
+// 从标准输入读取tar流的特殊输入名
+const std::string STDIN_INPUT = "-";
+
+enum class OutputFormat {
+    Ndjson,
+    Cbor
+};
+
+struct CliOptions {
+    std::vector<std::string> inputs;
+    OutputFormat format = OutputFormat::Ndjson;
+    std::optional<fs::path> outputPath;
+    std::optional<fs::path> checkpointPath;
+    std::optional<fs::path> configPath;
+    bool forensics = false;
+    size_t readers = 4;
+    unsigned queueDepth = 64;
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    size_t queueSize = 256;
+};
+
+// 读取阶段的输入：目录中的文件和tar归档只带路径，由读取线程负责读入
+struct ReadItem {
+    std::string key;
+    fs::path path;
+    bool archive = false;
+};
+
+// 解析阶段的输入：已经读入内存的图像数据
+struct ParseItem {
+    std::string key;
+    std::string filename;
+    std::vector<unsigned char> data;
+};
+
+// 输出阶段的输入：一条完整的扫描记录
+struct OutputItem {
+    std::string key;
+    json record;
+};
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] <path>...\n"
+              << "\n"
+              << "Scan image files in directories, single files or tar archives ('-' reads a tar stream from stdin).\n"
+              << "\n"
+              << "Options:\n"
+              << "  --format <ndjson|cbor>   Output format (default: ndjson)\n"
+              << "  --output <file>          Output file (default: stdout)\n"
+              << "  --checkpoint <file>      Record finished inputs and skip them on the next run\n"
+              << "  --config <file>          Read limits such as metadata.max_file_size from a service config file\n"
+              << "  --forensics              Also run tampering detection on every image\n"
+              << "  --readers <n>            Number of read threads (default: 4)\n"
+              << "  --queue-depth <n>        Reads in flight per read thread (default: 64)\n"
+              << "  --workers <n>            Number of parse/analyze threads (default: CPU count)\n"
+              << "  --queue-size <n>         Capacity of each pipeline queue (default: 256)\n"
+              << "  --help                   Show this help\n";
+}
+
+std::optional<CliOptions> parseArgs(int argc, char* argv[]) {
+    CliOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto nextValue = [&]() -> std::optional<std::string> {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return std::nullopt;
+            }
+            return std::string(argv[++i]);
+        };
+
+        if (arg == "--help" || arg == "-h") {
+            return std::nullopt;
+        } else if (arg == "--forensics") {
+            options.forensics = true;
+        } else if (arg == "--format" || arg == "--output" || arg == "--checkpoint" || arg == "--config" ||
+                   arg == "--readers" || arg == "--queue-depth" || arg == "--workers" ||
+                   arg == "--queue-size") {
+            auto value = nextValue();
+            if (!value) {
+                return std::nullopt;
+            }
+
+            try {
+                if (arg == "--format") {
+                    if (*value == "ndjson") {
+                        options.format = OutputFormat::Ndjson;
+                    } else if (*value == "cbor") {
+                        options.format = OutputFormat::Cbor;
+                    } else {
+                        std::cerr << "Unknown output format: " << *value << std::endl;
+                        return std::nullopt;
+                    }
+                } else if (arg == "--output") {
+                    options.outputPath = *value;
+                } else if (arg == "--checkpoint") {
+                    options.checkpointPath = *value;
+                } else if (arg == "--config") {
+                    options.configPath = *value;
+                } else if (arg == "--readers") {
+                    options.readers = std::max<size_t>(1, std::stoul(*value));
+                } else if (arg == "--queue-depth") {
+                    options.queueDepth = static_cast<unsigned>(std::max<size_t>(1, std::stoul(*value)));
+                } else if (arg == "--workers") {
+                    options.workers = std::max<size_t>(1, std::stoul(*value));
+                } else {
+                    options.queueSize = std::max<size_t>(1, std::stoul(*value));
+                }
+            } catch (const std::exception&) {
+                std::cerr << "Invalid value for " << arg << ": " << *value << std::endl;
+                return std::nullopt;
+            }
+        } else if (arg.size() > 1 && arg[0] == '-' && arg != STDIN_INPUT) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return std::nullopt;
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    if (options.inputs.empty()) {
+        std::cerr << "No input paths given" << std::endl;
+        return std::nullopt;
+    }
+
+    return options;
+}
+
+std::unordered_set<std::string> loadCheckpoint(const fs::path& checkpointPath) {
+    std::unordered_set<std::string> done;
+
+    std::ifstream file(checkpointPath);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty()) {
+            done.insert(line);
+        }
+    }
+
+    return done;
+}
+
+bool isTarArchive(const fs::path& path) {
+    auto extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".tar";
+}
+
+// tar头中的数字字段：八进制文本，或首字节最高位置1的base-256大端编码
+uint64_t parseTarNumber(const char* field, size_t length) {
+    uint64_t value = 0;
+
+    if (static_cast<unsigned char>(field[0]) & 0x80) {
+        for (size_t i = 1; i < length; ++i) {
+            value = (value << 8) | static_cast<unsigned char>(field[i]);
+        }
+        return value;
+    }
+
+    size_t i = 0;
+    while (i < length && field[i] == ' ') {
+        ++i;
+    }
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i) {
+        value = value * 8 + static_cast<uint64_t>(field[i] - '0');
+    }
+    return value;
+}
+
+std::string tarField(const char* field, size_t length) {
+    return std::string(field, strnlen(field, length));
+}
+
+// 从pax扩展头中取出path记录，格式为"<长度> path=<值>\n"
+std::string paxPath(const std::string& records) {
+    size_t pos = 0;
+    while (pos < records.size()) {
+        size_t space = records.find(' ', pos);
+        if (space == std::string::npos) {
+            break;
+        }
+
+        size_t length = std::strtoul(records.c_str() + pos, nullptr, 10);
+        if (length == 0 || pos + length > records.size()) {
+            break;
+        }
+
+        std::string record = records.substr(space + 1, pos + length - space - 2);
+        if (record.rfind("path=", 0) == 0) {
+            return record.substr(5);
+        }
+        pos += length;
+    }
+    return {};
+}
+
+/**
+ * 顺序读取一个tar流，把支持格式的普通文件成员直接送入解析队列
+ * @return 归档损坏或被截断时返回false
+ */
+bool readTarStream(std::istream& in, const std::string& archiveName, uint64_t maxImageSize,
+                   const std::unordered_set<std::string>& done,
+                   BoundedQueue<ParseItem>& parseQueue,
+                   std::atomic<size_t>& skipped) {
+    std::array<char, 512> header;
+    std::string overrideName;
+    int zeroBlocks = 0;
+
+    while (in.read(header.data(), header.size())) {
+        if (std::all_of(header.begin(), header.end(), [](char c) { return c == '\0'; })) {
+            if (++zeroBlocks == 2) {
+                break;
+            }
+            continue;
+        }
+        zeroBlocks = 0;
+
+        uint64_t size = parseTarNumber(header.data() + 124, 12);
+        uint64_t padding = (512 - size % 512) % 512;
+        char type = header[156];
+
+        std::string name = tarField(header.data(), 100);
+        if (std::memcmp(header.data() + 257, "ustar", 5) == 0 && header[345] != '\0') {
+            name = tarField(header.data() + 345, 155) + "/" + name;
+        }
+        if (!overrideName.empty()) {
+            name = std::move(overrideName);
+            overrideName.clear();
+        }
+
+        // GNU长文件名和pax扩展头描述的是下一个成员
+        if (type == 'L' || type == 'x') {
+            if (size > MAX_TAR_EXTENSION_SIZE) {
+                Logger::get()->warn("Corrupt tar archive {}: {} byte extended header", archiveName, size);
+                return false;
+            }
+            std::string payload(size, '\0');
+            in.read(payload.data(), static_cast<std::streamsize>(size));
+            if (static_cast<uint64_t>(in.gcount()) != size) {
+                Logger::get()->warn("Truncated tar header in {}", archiveName);
+                return false;
+            }
+            in.ignore(static_cast<std::streamsize>(padding));
+            overrideName = type == 'L' ? std::string(payload.c_str()) : paxPath(payload);
+            continue;
+        }
+
+        std::string key = archiveName + ":" + name;
+        bool regularFile = type == '0' || type == '\0';
+
+        if (!regularFile || size > maxImageSize || !ImageService::isSupportedFormat(name) || done.count(key)) {
+            if (regularFile && done.count(key)) {
+                skipped++;
+            }
+            in.ignore(static_cast<std::streamsize>(size + padding));
+            continue;
+        }
+
+        ParseItem item;
+        item.key = std::move(key);
+        item.filename = fs::path(name).filename().string();
+        item.data.resize(size);
+        in.read(reinterpret_cast<char*>(item.data.data()), static_cast<std::streamsize>(size));
+        if (static_cast<uint64_t>(in.gcount()) != size) {
+            Logger::get()->warn("Truncated tar member {} in {}", name, archiveName);
+            return false;
+        }
+        in.ignore(static_cast<std::streamsize>(padding));
+
+        if (!parseQueue.push(std::move(item))) {
+            break;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    // stdout留给扫描结果，日志只输出警告和错误到stderr
+    Logger::init(spdlog::level::warn, std::nullopt, true);
+
+    auto optionsOpt = parseArgs(argc, argv);
+    if (!optionsOpt) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    const CliOptions options = *optionsOpt;
+
+    // 单文件大小上限与服务使用同一项配置，未指定配置文件时使用默认值
+    if (options.configPath && !Config::load(*options.configPath)) {
+        std::cerr << "Failed to load config file: " << options.configPath->string() << std::endl;
+        return 1;
+    }
+    const uint64_t maxImageSize = Config::settings().maxFileSize;
+
+    std::unordered_set<std::string> done;
+    std::ofstream checkpointFile;
+    if (options.checkpointPath) {
+        done = loadCheckpoint(*options.checkpointPath);
+        checkpointFile.open(*options.checkpointPath, std::ios::app);
+        if (!checkpointFile) {
+            std::cerr << "Failed to open checkpoint file: " << options.checkpointPath->string() << std::endl;
+            return 1;
+        }
+        if (!done.empty()) {
+            std::cerr << "Resuming, " << done.size() << " inputs already finished" << std::endl;
+        }
+    }
+
+    // 续扫时追加到已有输出，和检查点中的记录保持对应
+    std::ofstream outputFile;
+    if (options.outputPath) {
+        auto mode = std::ios::binary | (options.checkpointPath ? std::ios::app : std::ios::trunc);
+        outputFile.open(*options.outputPath, mode);
+        if (!outputFile) {
+            std::cerr << "Failed to open output file: " << options.outputPath->string() << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& output = options.outputPath ? outputFile : std::cout;
+
+    BoundedQueue<ReadItem> readQueue(options.queueSize);
+    BoundedQueue<ParseItem> parseQueue(options.queueSize);
+    BoundedQueue<OutputItem> outputQueue(options.queueSize);
+
+    std::atomic<size_t> skipped{0};
+    std::atomic<size_t> readErrors{0};
+    auto startTime = std::chrono::steady_clock::now();
+
+    // 阶段0：遍历输入，生成读取任务
+    std::thread enumerator([&]() {
+        auto enqueueFile = [&](const fs::path& path) {
+            std::string key = path.string();
+            if (done.count(key)) {
+                skipped++;
+                return;
+            }
+            readQueue.push({key, path, false});
+        };
+
+        for (const auto& input : options.inputs) {
+            if (input == STDIN_INPUT) {
+                readQueue.push({input, {}, true});
+                continue;
+            }
+
+            std::error_code ec;
+            fs::path path(input);
+
+            if (fs::is_directory(path, ec)) {
+                fs::recursive_directory_iterator it(path, fs::directory_options::skip_permission_denied, ec);
+                for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                    if (!it->is_regular_file(ec)) {
+                        continue;
+                    }
+                    if (isTarArchive(it->path())) {
+                        readQueue.push({it->path().string(), it->path(), true});
+                    } else if (ImageService::isSupportedFormat(it->path())) {
+                        enqueueFile(it->path());
+                    }
+                }
+                if (ec) {
+                    Logger::get()->warn("Error walking {}: {}", input, ec.message());
+                }
+            } else if (fs::is_regular_file(path, ec)) {
+                if (isTarArchive(path)) {
+                    readQueue.push({input, path, true});
+                } else {
+                    enqueueFile(path);
+                }
+            } else {
+                Logger::get()->warn("Skipping missing input: {}", input);
+            }
+        }
+
+        readQueue.close();
+    });
+
+    // 阶段1：读取文件或展开tar流，普通文件按批次通过BatchFileReader并发读取
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < options.readers; ++i) {
+        readers.emplace_back([&]() {
+            BatchFileReader fileReader(options.queueDepth);
+
+            while (auto first = readQueue.pop()) {
+                std::vector<ReadItem> batch;
+                batch.push_back(std::move(*first));
+                while (batch.size() < options.queueDepth) {
+                    auto more = readQueue.tryPop();
+                    if (!more) {
+                        break;
+                    }
+                    batch.push_back(std::move(*more));
+                }
+
+                std::vector<FileReadRequest> requests;
+                std::vector<std::string> keys;
+                for (auto& item : batch) {
+                    if (!item.archive) {
+                        // 多读一个字节即可判断文件是否超过大小上限
+                        requests.push_back({item.path, maxImageSize + 1});
+                        keys.push_back(std::move(item.key));
+                        continue;
+                    }
+
+                    if (item.key == STDIN_INPUT) {
+                        if (!readTarStream(std::cin, "stdin", maxImageSize, done, parseQueue, skipped)) {
+                            readErrors++;
+                        }
+                    } else {
+                        std::ifstream archive(item.path, std::ios::binary);
+                        if (!archive) {
+                            Logger::get()->warn("Failed to open archive: {}", item.key);
+                            readErrors++;
+                            continue;
+                        }
+                        if (!readTarStream(archive, item.key, maxImageSize, done, parseQueue, skipped)) {
+                            readErrors++;
+                        }
+                    }
+                }
+
+                fileReader.readAll(requests, [&](FileReadResult&& readResult) {
+                    if (readResult.error != 0 || readResult.truncated) {
+                        Logger::get()->warn("Failed to read file: {}", keys[readResult.index]);
+                        readErrors++;
+                        return;
+                    }
+
+                    parseQueue.push({std::move(keys[readResult.index]),
+                                     readResult.path.filename().string(),
+                                     std::move(readResult.data)});
+                });
+            }
+        });
+    }
+
+    // 阶段2：解析元数据并做取证分析
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < options.workers; ++i) {
+        workers.emplace_back([&]() {
+            ImageService imageService;
+            MetadataExtractor extractor;
+
+            while (auto item = parseQueue.pop()) {
+                json record = imageService.processImageBuffer(item->data, item->filename);
+
+                if (options.forensics && record["status"] == "success") {
+                    auto forensics = extractor.detectTampering(record["metadata"]);
+                    if (forensics) {
+                        record["forensics"] = std::move(*forensics);
+                    }
+                }
+
+                record["path"] = item->key;
+                outputQueue.push({std::move(item->key), std::move(record)});
+            }
+        });
+    }
+
+    // 阶段3：按完成顺序写出结果并记录检查点
+    size_t written = 0;
+    size_t failed = 0;
+    std::thread writer([&]() {
+        std::string pendingCheckpoint;
+
+        auto flush = [&]() {
+            // 先落盘输出，再记录检查点，中断后最多重复处理未同步的部分
+            output.flush();
+            if (checkpointFile.is_open() && !pendingCheckpoint.empty()) {
+                checkpointFile << pendingCheckpoint;
+                checkpointFile.flush();
+                pendingCheckpoint.clear();
+            }
+        };
+
+        while (auto item = outputQueue.pop()) {
+            if (item->record["status"] != "success") {
+                failed++;
+            }
+
+            if (options.format == OutputFormat::Cbor) {
+                auto bytes = json::to_cbor(item->record);
+                output.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            } else {
+                output << item->record.dump() << '\n';
+            }
+
+            if (checkpointFile.is_open()) {
+                pendingCheckpoint += item->key;
+                pendingCheckpoint += '\n';
+            }
+
+            if (++written % FLUSH_INTERVAL == 0) {
+                flush();
+            }
+        }
+
+        flush();
+    });
+
+    enumerator.join();
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    parseQueue.close();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    outputQueue.close();
+    writer.join();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cerr << "Scanned " << written << " images (" << failed << " failed, "
+              << skipped.load() << " skipped, " << readErrors.load() << " unreadable) in "
+              << elapsed << "s" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include "compression.hpp"
+#include "util.hpp"
+#include <nlohmann/json.hpp>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <optional>
+
+using namespace ImageForensics;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+// 从标准输入读取扫描结果的特殊输入名
+const std::string STDIN_INPUT = "-";
+
+struct DictOptions {
+    std::vector<std::string> inputs;
+    fs::path outputDirectory = "data/dictionaries";
+    size_t dictionarySize = 112640;
+    size_t maxSamples = 100000;
+};
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] <results.ndjson>...\n"
+              << "\n"
+              << "Train the cache compression dictionary from NDJSON scan results written by\n"
+              << "image_forensics_cli ('-' reads from stdin). The dictionary is written as\n"
+              << "metadata-<id>.dict; the service compresses new cache entries with the newest\n"
+              << "dictionary in cache.dictionary_dir and keeps older ones to read existing entries.\n"
+              << "\n"
+              << "Options:\n"
+              << "  --output <dir>           Dictionary directory (default: data/dictionaries)\n"
+              << "  --size <bytes>           Maximum dictionary size (default: 112640)\n"
+              << "  --max-samples <n>        Maximum number of results to sample (default: 100000)\n"
+              << "  --help                   Show this help\n";
+}
+
+std::optional<DictOptions> parseArgs(int argc, char* argv[]) {
+    DictOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") {
+            return std::nullopt;
+        } else if (arg == "--output" || arg == "--size" || arg == "--max-samples") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return std::nullopt;
+            }
+            std::string value = argv[++i];
+
+            try {
+                if (arg == "--output") {
+                    options.outputDirectory = value;
+                } else if (arg == "--size") {
+                    options.dictionarySize = std::max<size_t>(1024, std::stoul(value));
+                } else {
+                    options.maxSamples = std::max<size_t>(1, std::stoul(value));
+                }
+            } catch (const std::exception&) {
+                std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+                return std::nullopt;
+            }
+        } else if (arg.size() > 1 && arg[0] == '-' && arg != STDIN_INPUT) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return std::nullopt;
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    if (options.inputs.empty()) {
+        std::cerr << "No input files given" << std::endl;
+        return std::nullopt;
+    }
+
+    return options;
+}
+
+// 服务缓存的是响应的JSON和CBOR两种编码，样本也按这两种编码生成
+void addSamples(const json& response, std::vector<std::string>& samples) {
+    samples.push_back(response.dump());
+    auto cbor = json::to_cbor(response);
+    samples.emplace_back(cbor.begin(), cbor.end());
+}
+
+// 把一条扫描记录还原为服务返回的/metadata和/forensics响应
+void collectSamples(std::istream& in, const DictOptions& options, size_t& records, std::vector<std::string>& samples) {
+    std::string line;
+    while (records < options.maxSamples && std::getline(in, line)) {
+        json record = json::parse(line, nullptr, false);
+        if (record.is_discarded() || !record.is_object() || record.value("status", "") != "success") {
+            continue;
+        }
+
+        record.erase("path");
+        if (record.contains("forensics")) {
+            addSamples({{"status", "success"}, {"forensics", record["forensics"]}}, samples);
+            record.erase("forensics");
+        }
+        addSamples(record, samples);
+        ++records;
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Logger::init(spdlog::level::warn, std::nullopt, true);
+
+    auto options = parseArgs(argc, argv);
+    if (!options) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!EntryCodec::available()) {
+        std::cerr << "Built without zstd support, cannot train a dictionary" << std::endl;
+        return 1;
+    }
+
+    size_t records = 0;
+    std::vector<std::string> samples;
+    for (const auto& input : options->inputs) {
+        if (input == STDIN_INPUT) {
+            collectSamples(std::cin, *options, records, samples);
+            continue;
+        }
+
+        std::ifstream file(input);
+        if (!file) {
+            std::cerr << "Failed to open " << input << std::endl;
+            return 1;
+        }
+        collectSamples(file, *options, records, samples);
+    }
+
+    if (records == 0) {
+        std::cerr << "No successful results found in the input" << std::endl;
+        return 1;
+    }
+
+    auto dictionary = EntryCodec::trainDictionary(samples, options->dictionarySize);
+    if (!dictionary) {
+        std::cerr << "Training failed; more samples are usually needed" << std::endl;
+        return 1;
+    }
+
+    uint32_t id = EntryCodec::dictionaryId(*dictionary);
+    std::error_code ec;
+    fs::create_directories(options->outputDirectory, ec);
+    fs::path outputPath = options->outputDirectory / ("metadata-" + std::to_string(id) + ".dict");
+
+    // 先写临时文件再重命名，服务不会加载写了一半的字典
+    fs::path tempPath = outputPath;
+    tempPath += ".tmp";
+    {
+        std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+        output.write(dictionary->data(), static_cast<std::streamsize>(dictionary->size()));
+        if (!output.flush()) {
+            std::cerr << "Failed to write " << tempPath << std::endl;
+            return 1;
+        }
+    }
+    fs::rename(tempPath, outputPath, ec);
+    if (ec) {
+        std::cerr << "Failed to write " << outputPath << ": " << ec.message() << std::endl;
+        return 1;
+    }
+
+    // 统计新字典在样本上的压缩率
+    EntryCodec::loadDictionary(outputPath);
+    size_t originalBytes = 0;
+    size_t compressedBytes = 0;
+    for (const auto& sample : samples) {
+        originalBytes += sample.size();
+        compressedBytes += EntryCodec::encode(sample).size();
+    }
+
+    std::cerr << "Trained dictionary " << id << " (" << dictionary->size() << " bytes) from " << records
+              << " results, written to " << outputPath.string() << "\n"
+              << "Sample compression ratio: " << static_cast<double>(originalBytes) / compressedBytes << "x"
+              << std::endl;
+    return 0;
+}